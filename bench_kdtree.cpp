@@ -0,0 +1,1628 @@
+//============================================================================
+// Name        : bench_kdtree.cpp
+/*
+ This file is part of kdTree.
+
+ kdTree is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ kdTree is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with kdTree.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Description : Time tree building and querying for the different tree
+// layouts, either on csv files or on synthetic uniformly random points
+//============================================================================
+#include "fixedTree.h"
+#include "treeForest.h"
+#include <chrono>
+#include <random>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+//settings shared by every benchmark
+struct benchConfig {
+	string mode;
+	string dataFile;	//csv of tree points, synthetic data if empty
+	string queryFile;	//csv of query points, synthetic data if empty
+	string shape;		//synthetic data: uniform, clusters, manifold or duplicates
+	int points;
+	int queries;
+	int dims;
+	int axisMode;
+	int leafSize;
+	unsigned seed;
+	vector<int> sizes;	//point counts swept by the build benchmark
+	vector<int> threads;	//thread counts swept by the parallel benchmarks
+	vector<int> neighbors;	//average matches per query swept by the range benchmark
+	int warmup;			//untimed runs before the suite measures
+	int reps;			//timed runs of every suite phase
+	string jsonFile;	//suite report, standard output if empty
+};
+
+//parse a comma separated list of integers
+static vector<int> parseList(const char * text) {
+	vector<int> list;
+	stringstream stream(text);
+	string cell;
+	while (getline(stream, cell, ',')) {
+		list.push_back(atoi(cell.c_str()));
+	}
+	return list;
+}
+
+static double secondsSince(chrono::steady_clock::time_point start) {
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+//fill vector with n uniformly random points in the unit cube
+static void makeUniform(vector<nPoint*>& pointVector, int n, int dims,
+		unsigned seed) {
+	mt19937_64 gen(seed);
+	uniform_real_distribution<double> dist(0.0, 1.0);
+	for (int i = 0; i < n; i++) {
+		double * pCords = new double[dims];
+		for (int d = 0; d < dims; d++) {
+			pCords[d] = dist(gen);
+		}
+		pointVector.push_back(new nPoint(i, dims, pCords));
+	}
+}
+
+//fill vector with n points in gaussian clusters of differing widths around
+//random centers in the unit cube, the same seed gives the same centers
+static void makeClusters(vector<nPoint*>& pointVector, int n, int dims,
+		unsigned seed, unsigned pointSeed) {
+	const int clusters = 20;
+	mt19937_64 gen(seed);
+	uniform_real_distribution<double> dist(0.0, 1.0);
+	vector<double> centers(clusters * dims);
+	vector<double> widths(clusters);
+	for (int c = 0; c < clusters; c++) {
+		for (int d = 0; d < dims; d++) {
+			centers[c * dims + d] = dist(gen);
+		}
+		widths[c] = 0.002 + 0.05 * dist(gen) * dist(gen);
+	}
+	mt19937_64 pointGen(pointSeed);
+	normal_distribution<double> normal(0.0, 1.0);
+	for (int i = 0; i < n; i++) {
+		int c = pointGen() % clusters;
+		double * pCords = new double[dims];
+		for (int d = 0; d < dims; d++) {
+			pCords[d] = centers[c * dims + d] + widths[c] * normal(pointGen);
+		}
+		pointVector.push_back(new nPoint(i, dims, pCords));
+	}
+}
+
+//fill vector with n points on a curved 2 dimensional surface in the unit
+//cube, every axis a sine of its own mix of the two surface parameters, with
+//a little noise. the same seed gives the same surface
+static void makeManifold(vector<nPoint*>& pointVector, int n, int dims,
+		unsigned seed, unsigned pointSeed) {
+	mt19937_64 gen(seed);
+	uniform_real_distribution<double> dist(0.0, 1.0);
+	vector<double> mix(dims * 3);
+	for (int d = 0; d < dims; d++) {
+		mix[d * 3] = 6 * dist(gen) - 3;
+		mix[d * 3 + 1] = 6 * dist(gen) - 3;
+		mix[d * 3 + 2] = 6.28 * dist(gen);
+	}
+	mt19937_64 pointGen(pointSeed);
+	normal_distribution<double> noise(0.0, 0.001);
+	for (int i = 0; i < n; i++) {
+		double t = dist(pointGen);
+		double u = dims > 1 ? dist(pointGen) : 0;
+		double * pCords = new double[dims];
+		for (int d = 0; d < dims; d++) {
+			pCords[d] = 0.5
+					+ 0.45 * sin(mix[d * 3] * t + mix[d * 3 + 1] * u + mix[d * 3 + 2])
+					+ noise(pointGen);
+		}
+		pointVector.push_back(new nPoint(i, dims, pCords));
+	}
+}
+
+//fill vector with n copies of n / 100 distinct uniform points, the same
+//seed gives the same distinct points
+static void makeDuplicates(vector<nPoint*>& pointVector, int n, int dims,
+		unsigned seed, unsigned pointSeed) {
+	int distinct = max(1, n / 100);
+	mt19937_64 gen(seed);
+	uniform_real_distribution<double> dist(0.0, 1.0);
+	vector<double> pool((size_t) distinct * dims);
+	for (double& v : pool) {
+		v = dist(gen);
+	}
+	mt19937_64 pointGen(pointSeed);
+	for (int i = 0; i < n; i++) {
+		const double * from = &pool[(size_t) (pointGen() % distinct) * dims];
+		double * pCords = new double[dims];
+		memcpy(pCords, from, dims * sizeof(double));
+		pointVector.push_back(new nPoint(i, dims, pCords));
+	}
+}
+
+//fill vector with n synthetic points of the configured shape
+static void makePoints(const benchConfig& cfg, vector<nPoint*>& pointVector,
+		int n, int dims, unsigned pointSeed) {
+	if (cfg.shape == "clusters") {
+		makeClusters(pointVector, n, dims, cfg.seed, pointSeed);
+	} else if (cfg.shape == "manifold") {
+		makeManifold(pointVector, n, dims, cfg.seed, pointSeed);
+	} else if (cfg.shape == "duplicates") {
+		makeDuplicates(pointVector, n, dims, cfg.seed, pointSeed);
+	} else {
+		makeUniform(pointVector, n, dims, pointSeed);
+	}
+}
+
+//get tree and query points either from csv or from the generator
+static int loadPoints(const benchConfig& cfg, vector<nPoint*>& pointVector,
+		vector<nPoint*>& queries) {
+	int k = cfg.dims;
+	if (cfg.dataFile.empty()) {
+		makePoints(cfg, pointVector, cfg.points, k, cfg.seed);
+	} else {
+		k = getDataFile(cfg.dataFile, pointVector);
+	}
+	if (cfg.queryFile.empty()) {
+		makePoints(cfg, queries, cfg.queries, k, cfg.seed + 1);
+	} else if (getDataFile(cfg.queryFile, queries) != k) {
+		cout << "Query dimensions do not match tree dimensions\n";
+		return -1;
+	}
+	return k;
+}
+
+//compare pointer-linked treeNode layout against the flat array layout
+static void benchLayout(const benchConfig& cfg) {
+	vector<nPoint*> pointVector;
+	vector<nPoint*> queries;
+
+	int k = loadPoints(cfg, pointVector, queries);
+	if (k < 1 || pointVector.empty()) {
+		return;
+	}
+	int n = pointVector.size();
+	int q = queries.size();
+
+	cout << "Layout benchmark: " << n << " points, " << q << " queries, " << k
+			<< " dimensions" << endl << endl;
+
+	flatTree flat;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	flat.makeTree(pointVector, k, cfg.axisMode, cfg.leafSize);
+	double flatBuild = secondsSince(start);
+
+	treeNode * root = new treeNode;
+	start = chrono::steady_clock::now();
+	root->makeTree(pointVector, 0, k, cfg.axisMode); //tree takes ownership of points
+	double treeBuild = secondsSince(start);
+
+	//query both trees, summing the answers so the work cannot be skipped
+	double bestDistance;
+	nPoint * bestPt;
+	double treeSum = 0;
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < q; i++) {
+		bestDistance = DBL_MAX;
+		bestPt = nullptr;
+		queries[i]->findNear(root, bestPt, bestDistance);
+		treeSum += bestDistance + bestPt->getIndex();
+	}
+	double treeQuery = secondsSince(start);
+
+	int bestSlot;
+	double flatSum = 0;
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < q; i++) {
+		bestDistance = DBL_MAX;
+		bestSlot = -1;
+		queries[i]->findNear(&flat, bestSlot, bestDistance);
+		flatSum += bestDistance + flat.getIndex(bestSlot);
+	}
+	double flatQuery = secondsSince(start);
+
+	//memory held by each layout, not counting allocator overhead
+	double treeBytes = (double) flat.getNodeCount() * sizeof(treeNode)
+			+ (double) n * (sizeof(nPoint) + k * sizeof(double));
+	double flatBytes = (double) flat.getNodeCount() * sizeof(flatNode)
+			+ (double) n * (k * sizeof(double) + sizeof(int));
+
+	cout << "layout     build(s)    query(us/q)  bytes/point" << endl;
+	printf("treeNode   %-11.4f %-12.4f %.1f\n", treeBuild,
+			treeQuery * 1e6 / q, treeBytes / n);
+	printf("flatTree   %-11.4f %-12.4f %.1f\n", flatBuild,
+			flatQuery * 1e6 / q, flatBytes / n);
+	printf("speedup    %-11.2f %-12.2f\n", treeBuild / flatBuild,
+			treeQuery / flatQuery);
+
+	if (cfg.leafSize == 1 && treeSum != flatSum) {
+		cout << endl << "WARNING, LAYOUTS RETURNED DIFFERENT ANSWERS" << endl;
+	}
+
+	delete root; //deletes entire tree and associated data
+	for (nPoint * p : queries) {
+		delete p;
+	}
+}
+
+//sweep leaf sizes of the flat tree
+static void benchLeaf(const benchConfig& cfg) {
+	vector<nPoint*> pointVector;
+	vector<nPoint*> queries;
+
+	int k = loadPoints(cfg, pointVector, queries);
+	if (k < 1 || pointVector.empty()) {
+		return;
+	}
+	int n = pointVector.size();
+	int q = queries.size();
+
+	cout << "Leaf size benchmark: " << n << " points, " << q << " queries, " << k
+			<< " dimensions" << endl << endl;
+	cout << "leaf  nodes       build(s)    query(us/q)" << endl;
+
+	int leafSizes[7] = { 1, 2, 4, 8, 16, 32, 64 };
+	for (int leafSize : leafSizes) {
+		flatTree flat;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		flat.makeTree(pointVector, k, cfg.axisMode, leafSize);
+		double build = secondsSince(start);
+
+		double sum = 0;
+		start = chrono::steady_clock::now();
+		for (int i = 0; i < q; i++) {
+			double bestDistance = DBL_MAX;
+			int bestSlot = -1;
+			queries[i]->findNear(&flat, bestSlot, bestDistance);
+			sum += bestDistance;
+		}
+		double query = secondsSince(start);
+
+		printf("%-5d %-11d %-11.4f %.4f\n", leafSize, flat.getNodeCount(), build,
+				query * 1e6 / q);
+		if (sum < 0) {
+			cout << "impossible" << endl;
+		}
+	}
+
+	for (nPoint * p : pointVector) {
+		delete p;
+	}
+	for (nPoint * p : queries) {
+		delete p;
+	}
+}
+
+//build throughput of both layouts in points per second, the flat tree is
+//built once per thread count
+static void benchBuild(const benchConfig& cfg) {
+
+	cout << "Build benchmark: " << cfg.dims << " dimensions, axisMode "
+			<< cfg.axisMode << ", leaf size " << cfg.leafSize << endl << endl;
+	cout << "points      treeNode(pts/s)  ";
+	for (int t : cfg.threads) {
+		cout << "flatTree x" << t << "(pts/s)  ";
+	}
+	cout << endl;
+
+	for (int n : cfg.sizes) {
+		vector<nPoint*> pointVector;
+		makeUniform(pointVector, n, cfg.dims, cfg.seed);
+
+		vector<double> flatBuild;
+		for (int t : cfg.threads) {
+			taskPool * pool = t > 1 ? new taskPool(t) : nullptr;
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			flatTree * flat = new flatTree;
+			flat->makeTree(pointVector, cfg.dims, cfg.axisMode, cfg.leafSize,
+					pool);
+			flatBuild.push_back(secondsSince(start));
+			delete flat;
+			delete pool;
+		}
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		treeNode * root = new treeNode;
+		root->makeTree(pointVector, 0, cfg.dims, cfg.axisMode);
+		double treeBuild = secondsSince(start);
+		delete root; //deletes entire tree and associated data
+
+		printf("%-11d %-16.0f ", n, n / treeBuild);
+		for (double seconds : flatBuild) {
+			printf(" %-21.0f", n / seconds);
+		}
+		printf("\n");
+	}
+}
+
+//build, read, query and free time of heap allocated treeNodes against the
+//same tree in a nodeArena, both builds copy the points first
+static void benchArena(const benchConfig& cfg) {
+	vector<nPoint*> pointVector;
+	vector<nPoint*> queries;
+
+	int k = loadPoints(cfg, pointVector, queries);
+	if (k < 1 || pointVector.empty()) {
+		return;
+	}
+	int n = pointVector.size();
+	int q = queries.size();
+
+	cout << "Arena benchmark: " << n << " points, " << q << " queries, " << k
+			<< " dimensions" << endl << endl;
+
+	//heap tree, copied points are adopted by the tree
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	vector<nPoint*> copies(n);
+	for (int i = 0; i < n; i++) {
+		double * pCords = new double[k];
+		memcpy(pCords, pointVector[i]->getCords(), k * sizeof(double));
+		copies[i] = new nPoint(pointVector[i]->getIndex(), k, pCords);
+	}
+	treeNode * root = new treeNode;
+	root->makeTree(copies, 0, k, cfg.axisMode);
+	double heapBuild = secondsSince(start);
+	root->writeOut("benchTree.txt", k);
+
+	start = chrono::steady_clock::now();
+	delete root; //deletes entire tree and associated data
+	double heapFree = secondsSince(start);
+
+	start = chrono::steady_clock::now();
+	root = new treeNode;
+	root->readTree("benchTree.txt", k);
+	double heapLoad = secondsSince(start);
+
+	arenaTree arena;
+	start = chrono::steady_clock::now();
+	arena.makeTree(pointVector, k, cfg.axisMode);
+	double arenaBuild = secondsSince(start);
+
+	start = chrono::steady_clock::now();
+	arena.clear();
+	double arenaFree = secondsSince(start);
+
+	start = chrono::steady_clock::now();
+	arena.readTree("benchTree.txt", k);
+	double arenaLoad = secondsSince(start);
+
+	//query both trees, summing the answers so the work cannot be skipped
+	double sums[2] = { 0, 0 };
+	double query[2];
+	treeNode * roots[2] = { root, arena.getRoot() };
+	for (int t = 0; t < 2; t++) {
+		start = chrono::steady_clock::now();
+		for (int i = 0; i < q; i++) {
+			double bestDistance = DBL_MAX;
+			nPoint * bestPt = nullptr;
+			queries[i]->findNear(roots[t], bestPt, bestDistance);
+			sums[t] += bestDistance + bestPt->getIndex();
+		}
+		query[t] = secondsSince(start);
+	}
+
+	cout << "nodes   build(s)    load(s)     free(s)     query(us/q)" << endl;
+	printf("heap    %-11.4f %-11.4f %-11.4f %.4f\n", heapBuild, heapLoad,
+			heapFree, query[0] * 1e6 / q);
+	printf("arena   %-11.4f %-11.4f %-11.4f %.4f\n", arenaBuild, arenaLoad,
+			arenaFree, query[1] * 1e6 / q);
+	printf("arena holds %.1f bytes/point\n", (double) arena.getBytes() / n);
+
+	if (sums[0] != sums[1]) {
+		cout << endl << "WARNING, ARENA TREE RETURNED DIFFERENT ANSWERS" << endl;
+	}
+
+	delete root;
+	remove("benchTree.txt");
+	for (nPoint * p : pointVector) {
+		delete p;
+	}
+	for (nPoint * p : queries) {
+		delete p;
+	}
+}
+
+//last level cache misses of this thread, read through perf_event_open.
+//counts are -1 when the kernel does not allow the counter
+class missCounter {
+protected:
+	int fd;
+
+public:
+	missCounter() {
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	}
+
+	void start() {
+		if (fd >= 0) {
+			ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+
+	long stop() {
+		long long count = -1;
+		if (fd < 0) {
+			return -1;
+		}
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+			return -1;
+		}
+		return count;
+	}
+
+	~missCounter() {
+		if (fd >= 0) {
+			close(fd);
+		}
+	}
+};
+
+//nearest neighbor batches run in input, morton and hilbert order against
+//trees laid out in build, morton and hilbert order. the sort is part of the
+//batch time. --shape clusters gives query sets with more reuse to find
+static void benchCurve(const benchConfig& cfg) {
+	vector<nPoint*> pointVector;
+	vector<nPoint*> queries;
+
+	int k = loadPoints(cfg, pointVector, queries);
+	if (k < 1 || pointVector.empty()) {
+		return;
+	}
+	int n = pointVector.size();
+	int q = queries.size();
+
+	vector<double> rows((size_t) q * k);
+	for (int i = 0; i < q; i++) {
+		memcpy(&rows[(size_t) i * k], queries[i]->getCords(),
+				k * sizeof(double));
+	}
+	vector<int> slots(q);
+	vector<double> distances(q);
+
+	cout << "Curve order benchmark: " << n << " " << cfg.shape << " points, "
+			<< q << " queries, " << k << " dimensions, leaf size "
+			<< cfg.leafSize << endl << endl;
+	cout << "layout   queries  queries/s     LLC misses/q  speedup" << endl;
+
+	missCounter misses;
+	double baseline = 0;
+	double sums[3][3];
+	for (int layout = CURVE_NONE; layout <= CURVE_HILBERT; layout++) {
+		flatTree flat;
+		flat.setCurveLayout(layout);
+		flat.makeTree(pointVector, k, cfg.axisMode, cfg.leafSize);
+
+		for (int order = CURVE_NONE; order <= CURVE_HILBERT; order++) {
+			flat.setQueryOrder(order);
+			misses.start();
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			flat.findNearBatch(&rows[0], q, &slots[0], &distances[0]);
+			double seconds = secondsSince(start);
+			long missed = misses.stop();
+			if (layout == CURVE_NONE && order == CURVE_NONE) {
+				baseline = seconds;
+			}
+
+			sums[layout][order] = 0;
+			for (int i = 0; i < q; i++) {
+				sums[layout][order] += distances[i] + flat.getIndex(slots[i]);
+			}
+
+			printf("%-8s %-8s %-13.0f ", curveName(layout).c_str(),
+					curveName(order).c_str(), q / seconds);
+			if (missed >= 0) {
+				printf("%-13.2f ", (double) missed / q);
+			} else {
+				printf("%-13s ", "n/a");
+			}
+			printf("%.2f\n", baseline / seconds);
+			if (sums[layout][order] != sums[0][0]) {
+				cout << "WARNING, ORDERS RETURNED DIFFERENT ANSWERS" << endl;
+			}
+		}
+	}
+
+	for (nPoint * p : pointVector) {
+		delete p;
+	}
+	for (nPoint * p : queries) {
+		delete p;
+	}
+}
+
+//packet searches on a raster: the queries are the cells of a square grid
+//over the first two axes, row by row, with any other axis at the middle of
+//the cube, as a resampling job would ask them. every packet size runs with
+//the rows as given and in hilbert order
+static void benchPacket(const benchConfig& cfg) {
+	vector<nPoint*> pointVector;
+	vector<nPoint*> unused;
+
+	benchConfig gridCfg = cfg;
+	gridCfg.queries = 0;
+	gridCfg.queryFile.clear();
+	int k = loadPoints(gridCfg, pointVector, unused);
+	if (k < 2 || pointVector.empty()) {
+		cout << "Packet benchmark needs at least 2 dimensions" << endl;
+		return;
+	}
+	int n = pointVector.size();
+	int side = max(1, (int) sqrt((double) cfg.queries));
+	int q = side * side;
+
+	//grid over the bounding box of the points
+	vector<double> low(k, DBL_MAX);
+	vector<double> high(k, -DBL_MAX);
+	for (nPoint * p : pointVector) {
+		for (int d = 0; d < k; d++) {
+			low[d] = min(low[d], p->getAxisCord(d));
+			high[d] = max(high[d], p->getAxisCord(d));
+		}
+	}
+	vector<double> rows((size_t) q * k);
+	for (int y = 0; y < side; y++) {
+		for (int x = 0; x < side; x++) {
+			double * row = &rows[((size_t) y * side + x) * k];
+			for (int d = 0; d < k; d++) {
+				row[d] = (low[d] + high[d]) / 2;
+			}
+			row[0] = low[0] + (high[0] - low[0]) * (x + 0.5) / side;
+			row[1] = low[1] + (high[1] - low[1]) * (y + 0.5) / side;
+		}
+	}
+	vector<int> slots(q);
+	vector<double> distances(q);
+
+	flatTree flat;
+	flat.makeTree(pointVector, k, cfg.axisMode, cfg.leafSize);
+
+	cout << "Packet benchmark: " << n << " " << cfg.shape << " points, " << side
+			<< "x" << side << " query grid, " << k << " dimensions, leaf size "
+			<< cfg.leafSize << endl << endl;
+	cout << "order    packet  queries/s     speedup" << endl;
+
+	int orders[2] = { CURVE_NONE, CURVE_HILBERT };
+	int packets[4] = { 1, 4, 8, PACKET_LANES };
+	double baseline = 0;
+	double firstSum = 0;
+	for (int order : orders) {
+		flat.setQueryOrder(order);
+		for (int packet : packets) {
+			flat.setPacketSize(packet);
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			flat.findNearBatch(&rows[0], q, &slots[0], &distances[0]);
+			double seconds = secondsSince(start);
+			if (baseline == 0) {
+				baseline = seconds;
+			}
+
+			double sum = 0;
+			for (int i = 0; i < q; i++) {
+				sum += distances[i] + slots[i];
+			}
+			if (firstSum == 0) {
+				firstSum = sum;
+			}
+
+			printf("%-8s %-7d %-13.0f %.2f\n", curveName(order).c_str(), packet,
+					q / seconds, baseline / seconds);
+			if (sum != firstSum) {
+				cout << "WARNING, PACKETS RETURNED DIFFERENT ANSWERS" << endl;
+			}
+		}
+	}
+
+	for (nPoint * p : pointVector) {
+		delete p;
+	}
+}
+
+//bytes of fileName held in the page cache
+static double residentBytes(const string fileName) {
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return 0;
+	}
+	off_t size = lseek(fd, 0, SEEK_END);
+	void * map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return 0;
+	}
+	long page = sysconf(_SC_PAGESIZE);
+	vector<unsigned char> pages((size + page - 1) / page);
+	double bytes = 0;
+	if (mincore(map, size, &pages[0]) == 0) {
+		for (unsigned char p : pages) {
+			bytes += (p & 1) ? page : 0;
+		}
+	}
+	munmap(map, size);
+	return bytes;
+}
+
+//drop fileName from the page cache so the next mapping starts cold
+static void dropCache(const string fileName) {
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if (fd >= 0) {
+		fdatasync(fd);
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+}
+
+//memory and query time of every coordinate precision, with and without the
+//doubles kept. tree is the bytes of the built tree in memory. each tree is
+//then written, dropped from the page cache and mapped, so resident counts
+//the file pages the queries actually touched: nodes, indices and the stored
+//coordinates, plus the kept doubles of the points the copy could not rule
+//out. same is the share of queries answered with the point of the double
+//tree, trees keeping the doubles must also give its distance every time
+static void benchPrecision(const benchConfig& cfg) {
+	vector<nPoint*> pointVector;
+	vector<nPoint*> queries;
+
+	int k = loadPoints(cfg, pointVector, queries);
+	if (k < 1 || pointVector.empty()) {
+		return;
+	}
+	int n = pointVector.size();
+	int q = queries.size();
+
+	cout << "Precision benchmark: " << n << " " << cfg.shape << " points, "
+			<< q << " queries, " << k << " dimensions, leaf size "
+			<< cfg.leafSize << endl << endl;
+	cout << "precision       tree(B/pt)  file(B/pt)  resident(B/pt)  "
+			<< "cold(us/q)  warm(us/q)  same(%)" << endl;
+
+	int modes[5] = { PRECISION_DOUBLE, PRECISION_FLOAT, PRECISION_FLOAT,
+			PRECISION_QUANT16, PRECISION_QUANT16 };
+	bool exacts[5] = { true, false, true, false, true };
+	vector<int> baseIndices(q);
+	vector<double> baseDistances(q);
+	bool differ = false;
+	for (int m = 0; m < 5; m++) {
+		flatTree built;
+		built.setPrecision(modes[m]);
+		built.setExactCords(exacts[m]);
+		built.makeTree(pointVector, k, cfg.axisMode, cfg.leafSize);
+		double bytes = built.getBytes();
+		built.writeBinary("benchTree.kdt");
+		built.clear();
+		dropCache("benchTree.kdt");
+
+		flatTree flat;
+		flat.readTree("benchTree.kdt", k, false);
+
+		double seconds[2];
+		int same = 0;
+		for (int pass = 0; pass < 2; pass++) {
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			for (int i = 0; i < q; i++) {
+				int bestSlot = -1;
+				double bestDistance = DBL_MAX;
+				flat.findNear(queries[i]->getCords(), bestSlot, bestDistance);
+				if (pass > 0) {
+					continue;
+				}
+				int index = flat.getIndex(bestSlot);
+				if (m == 0) {
+					baseIndices[i] = index;
+					baseDistances[i] = bestDistance;
+				}
+				if (index == baseIndices[i]) {
+					same++;
+				}
+				differ = differ
+						|| (exacts[m] && bestDistance != baseDistances[i]);
+			}
+			seconds[pass] = secondsSince(start);
+		}
+		differ = differ || (exacts[m] && same != q);
+
+		struct stat info;
+		stat("benchTree.kdt", &info);
+		string name = precisionName(modes[m])
+				+ (m > 0 && !exacts[m] ? "+approx" : "");
+		printf("%-15s %-11.1f %-11.1f %-15.1f %-11.4f %-11.4f %.2f\n",
+				name.c_str(), bytes / n, (double) info.st_size / n,
+				residentBytes("benchTree.kdt") / n, seconds[0] * 1e6 / q,
+				seconds[1] * 1e6 / q, 100.0 * same / q);
+	}
+
+	if (differ) {
+		cout << endl << "WARNING, EXACT PRECISIONS RETURNED DIFFERENT ANSWERS"
+				<< endl;
+	}
+
+	remove("benchTree.kdt");
+	for (nPoint * p : pointVector) {
+		delete p;
+	}
+	for (nPoint * p : queries) {
+		delete p;
+	}
+}
+
+//time loading the text format against mapping the binary format
+static void benchLoad(const benchConfig& cfg) {
+	vector<nPoint*> pointVector;
+	vector<nPoint*> queries;
+
+	int k = loadPoints(cfg, pointVector, queries);
+	if (k < 1 || pointVector.empty()) {
+		return;
+	}
+
+	flatTree flat;
+	flat.makeTree(pointVector, k, cfg.axisMode, cfg.leafSize);
+	flat.writeOut("benchTree.txt");
+	flat.writeBinary("benchTree.kdt");
+
+	cout << "Load benchmark: " << pointVector.size() << " points, " << k
+			<< " dimensions, leaf size " << cfg.leafSize << endl << endl;
+	cout << "format              load(s)" << endl;
+
+	const char * names[3] = { "text", "binary, verified", "binary, mapped" };
+	const char * files[3] = { "benchTree.txt", "benchTree.kdt", "benchTree.kdt" };
+	for (int f = 0; f < 3; f++) {
+		flatTree loaded;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		loaded.readTree(files[f], k, f < 2);
+		double seconds = secondsSince(start);
+		printf("%-19s %.4f\n", names[f], seconds);
+	}
+
+	remove("benchTree.txt");
+	remove("benchTree.kdt");
+	for (nPoint * p : pointVector) {
+		delete p;
+	}
+	for (nPoint * p : queries) {
+		delete p;
+	}
+}
+
+//build and query time of the dynamic treeNode and flatTree paths against the
+//tree compiled for the dimension, picked at run time by makeSearchTree
+static void benchFixed(const benchConfig& cfg) {
+	vector<nPoint*> pointVector;
+	vector<nPoint*> queries;
+
+	int k = loadPoints(cfg, pointVector, queries);
+	if (k < 1 || pointVector.empty()) {
+		return;
+	}
+	int n = pointVector.size();
+	int q = queries.size();
+
+	vector<double> cords((size_t) n * k);
+	for (int i = 0; i < n; i++) {
+		memcpy(&cords[(size_t) i * k], pointVector[i]->getCords(),
+				k * sizeof(double));
+	}
+	pointBlock block;
+	block.assign(&cords[0], n, k);
+	vector<double> qCords((size_t) q * k);
+	for (int i = 0; i < q; i++) {
+		memcpy(&qCords[(size_t) i * k], queries[i]->getCords(),
+				k * sizeof(double));
+	}
+
+	cout << "Fixed dimension benchmark: " << n << " points, " << q
+			<< " queries, " << k << " dimensions, leaf size " << cfg.leafSize
+			<< endl << endl;
+
+	treeNode * root = new treeNode;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	root->makeTree(pointVector, 0, k, cfg.axisMode); //tree takes ownership of points
+	double treeBuild = secondsSince(start);
+
+	double bestDistance;
+	nPoint * bestPt;
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < q; i++) {
+		bestDistance = DBL_MAX;
+		bestPt = nullptr;
+		queries[i]->findNear(root, bestPt, bestDistance);
+	}
+	double treeQuery = secondsSince(start);
+	delete root; //deletes entire tree and associated data
+
+	vector<int> slots(q);
+	vector<double> distances(q);
+	flatTree flat;
+	start = chrono::steady_clock::now();
+	flat.makeTree(block, cfg.axisMode, cfg.leafSize);
+	double flatBuild = secondsSince(start);
+	start = chrono::steady_clock::now();
+	flat.findNearBatch(&qCords[0], q, &slots[0], &distances[0]);
+	double flatQuery = secondsSince(start);
+
+	searchTree * fixed = makeSearchTree(k);
+	start = chrono::steady_clock::now();
+	fixed->build(block, cfg.axisMode, cfg.leafSize);
+	double fixedBuild = secondsSince(start);
+	vector<double> fixedDistances(q);
+	start = chrono::steady_clock::now();
+	fixed->findNearBatch(&qCords[0], q, &slots[0], &fixedDistances[0]);
+	double fixedQuery = secondsSince(start);
+	delete fixed;
+
+	cout << "tree       build(s)    query(us/q)  query speedup" << endl;
+	printf("treeNode   %-11.4f %-12.4f 1.00\n", treeBuild, treeQuery * 1e6 / q);
+	printf("flatTree   %-11.4f %-12.4f %.2f\n", flatBuild, flatQuery * 1e6 / q,
+			treeQuery / flatQuery);
+	printf("%-10s %-11.4f %-12.4f %.2f\n",
+			k <= MAX_FIXED_DIMS ? "kdTree" : "fallback", fixedBuild,
+			fixedQuery * 1e6 / q, treeQuery / fixedQuery);
+
+	if (distances != fixedDistances) {
+		cout << endl << "WARNING, TREES RETURNED DIFFERENT ANSWERS" << endl;
+	}
+	for (nPoint * p : queries) {
+		delete p;
+	}
+}
+
+//radius search on uniform points, the radius is picked so the ball holds the
+//requested number of points on average, from sparse to dense
+static void benchRange(const benchConfig& cfg) {
+	vector<nPoint*> pointVector;
+	vector<nPoint*> queries;
+
+	int k = loadPoints(cfg, pointVector, queries);
+	if (k < 1 || pointVector.empty()) {
+		return;
+	}
+	int n = pointVector.size();
+	int q = queries.size();
+
+	flatTree flat;
+	flat.makeTree(pointVector, k, cfg.axisMode, cfg.leafSize);
+
+	cout << "Range benchmark: " << n << " points, " << q << " queries, " << k
+			<< " dimensions, leaf size " << cfg.leafSize << endl << endl;
+	cout << "neighbors  radius      found/q     collect(us/q)  count(us/q)"
+			<< endl;
+
+	double ballVolume = pow(M_PI, k / 2.0) / tgamma(k / 2.0 + 1); //unit ball
+	vector<int> found;
+	for (int target : cfg.neighbors) {
+		double radius = pow(target / (n * ballVolume), 1.0 / k);
+
+		long total = 0;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (int i = 0; i < q; i++) {
+			total += flat.findRange(queries[i]->getCords(), radius, found);
+		}
+		double collect = secondsSince(start);
+
+		long counted = 0;
+		start = chrono::steady_clock::now();
+		for (int i = 0; i < q; i++) {
+			counted += flat.countRange(queries[i]->getCords(), radius);
+		}
+		double countTime = secondsSince(start);
+
+		printf("%-10d %-11.6f %-11.1f %-14.4f %.4f\n", target, radius,
+				(double) total / q, collect * 1e6 / q, countTime * 1e6 / q);
+		if (counted != total) {
+			cout << "WARNING, COUNT AND COLLECT DISAGREE" << endl;
+		}
+	}
+
+	for (nPoint * p : pointVector) {
+		delete p;
+	}
+	for (nPoint * p : queries) {
+		delete p;
+	}
+}
+
+//nodes visited and latency of the nearest neighbor search with and without
+//per-node bounding boxes
+static void benchBoxes(const benchConfig& cfg) {
+	vector<nPoint*> pointVector;
+	vector<nPoint*> queries;
+
+	int k = loadPoints(cfg, pointVector, queries);
+	if (k < 1 || pointVector.empty()) {
+		return;
+	}
+	int n = pointVector.size();
+	int q = queries.size();
+
+	cout << "Bounding box benchmark: " << n << " points, " << q << " queries, "
+			<< k << " dimensions, leaf size " << cfg.leafSize << endl << endl;
+	cout << "boxes  build(s)    nodes/q     leaves/q    query(us/q)  box bytes/point"
+			<< endl;
+
+	for (int on = 0; on < 2; on++) {
+		flatTree flat;
+		flat.setBoundingBoxes(on == 1);
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		flat.makeTree(pointVector, k, cfg.axisMode, cfg.leafSize);
+		double build = secondsSince(start);
+
+		searchStats stats;
+		int bestSlot;
+		double bestDistance;
+		start = chrono::steady_clock::now();
+		for (int i = 0; i < q; i++) {
+			bestSlot = -1;
+			bestDistance = DBL_MAX;
+			flat.findNear(queries[i]->getCords(), bestSlot, bestDistance, stats);
+		}
+		double query = secondsSince(start);
+
+		double boxBytes = on ? 2.0 * k * sizeof(float) * flat.getNodeCount() : 0;
+		printf("%-6s %-11.4f %-11.1f %-11.1f %-12.4f %.1f\n", on ? "on" : "off",
+				build, (double) stats.nodes / q, (double) stats.leaves / q,
+				query * 1e6 / q, boxBytes / n);
+	}
+
+	for (nPoint * p : pointVector) {
+		delete p;
+	}
+	for (nPoint * p : queries) {
+		delete p;
+	}
+}
+
+//build with every split strategy and compare tree depth, work per query and
+//query time. --shape clusters gives data where the strategies differ most
+static void benchSplit(const benchConfig& cfg) {
+	vector<nPoint*> pointVector;
+	vector<nPoint*> queries;
+
+	int k = loadPoints(cfg, pointVector, queries);
+	if (k < 1 || pointVector.empty()) {
+		return;
+	}
+	int n = pointVector.size();
+	int q = queries.size();
+
+	cout << "Split strategy benchmark: " << n << " " << cfg.shape
+			<< " points, " << q << " queries, " << k << " dimensions, leaf size "
+			<< cfg.leafSize << endl << endl;
+	cout << "split      build(s)    nodes/q     leaves/q    query(us/q)" << endl;
+
+	const char * names[] = { "rotate", "range", "variance", "midpoint", "cost" };
+	for (int mode = SPLIT_ROTATE; mode <= SPLIT_COST; mode++) {
+		flatTree flat;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		flat.makeTree(pointVector, k, mode, cfg.leafSize);
+		double build = secondsSince(start);
+
+		searchStats stats;
+		int bestSlot;
+		double bestDistance;
+		start = chrono::steady_clock::now();
+		for (int i = 0; i < q; i++) {
+			bestSlot = -1;
+			bestDistance = DBL_MAX;
+			flat.findNear(queries[i]->getCords(), bestSlot, bestDistance, stats);
+		}
+		double query = secondsSince(start);
+
+		printf("%-10s %-11.4f %-11.1f %-11.1f %.4f\n", names[mode], build,
+				(double) stats.nodes / q, (double) stats.leaves / q,
+				query * 1e6 / q);
+	}
+
+	for (nPoint * p : pointVector) {
+		delete p;
+	}
+	for (nPoint * p : queries) {
+		delete p;
+	}
+}
+
+//mixed workloads of inserts, deletes and queries on one tree, against
+//building the tree again from the same points
+static void benchUpdate(const benchConfig& cfg) {
+	vector<nPoint*> pointVector;
+	vector<nPoint*> queries;
+
+	int k = loadPoints(cfg, pointVector, queries);
+	if (k < 1 || pointVector.empty()) {
+		return;
+	}
+	int n = pointVector.size();
+	int q = queries.size();
+
+	vector<nPoint*> extra; //points to insert
+	makePoints(cfg, extra, q, k, cfg.seed + 2);
+
+	cout << "Update benchmark: " << n << " points, " << q << " operations, "
+			<< k << " dimensions, leaf size " << cfg.leafSize << endl << endl;
+	cout << "updates  setup(s)  insert(us)  delete(us)  query(us/q)  nodes/q  "
+			"rebuilt nodes/q  rebuild(s)" << endl;
+
+	const double shares[] = { 0.01, 0.1, 0.5, 0.9 };
+	for (double share : shares) {
+		flatTree flat;
+		flat.makeTree(pointVector, k, cfg.axisMode, cfg.leafSize);
+
+		mt19937_64 gen(cfg.seed + 3);
+		uniform_real_distribution<double> unit(0.0, 1.0);
+		vector<int> live(n); //indices held, for picking deletes
+		for (int i = 0; i < n; i++) {
+			live[i] = pointVector[i]->getIndex();
+		}
+		int nextIndex = n;
+
+		//the first update sets up the bookkeeping for the whole tree
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		flat.remove(live.back());
+		double setup = secondsSince(start);
+		live.pop_back();
+
+		int nextExtra = 0;
+		int nextQuery = 0;
+		int inserts = 0;
+		int deletes = 0;
+		int searches = 0;
+		double insertTime = 0;
+		double deleteTime = 0;
+		double queryTime = 0;
+
+		for (int op = 0; op < q; op++) {
+			start = chrono::steady_clock::now();
+			if (unit(gen) >= share) {
+				int bestSlot = -1;
+				double bestDistance = DBL_MAX;
+				flat.findNear(queries[nextQuery++ % q]->getCords(), bestSlot,
+						bestDistance);
+				queryTime += secondsSince(start);
+				searches++;
+			} else if (op % 2 == 0 || live.empty()) {
+				flat.insert(extra[nextExtra++ % q]->getCords(), nextIndex);
+				insertTime += secondsSince(start);
+				live.push_back(nextIndex++);
+				inserts++;
+			} else {
+				size_t pick = gen() % live.size();
+				start = chrono::steady_clock::now();
+				flat.remove(live[pick]);
+				deleteTime += secondsSince(start);
+				live[pick] = live.back();
+				live.pop_back();
+				deletes++;
+			}
+		}
+
+		//search work on the updated tree against a fresh build of its points
+		searchStats updatedStats;
+		searchStats rebuiltStats;
+		int bestSlot;
+		double bestDistance;
+		for (int i = 0; i < q; i++) {
+			bestSlot = -1;
+			bestDistance = DBL_MAX;
+			flat.findNear(queries[i]->getCords(), bestSlot, bestDistance,
+					updatedStats);
+		}
+
+		flat.compact(); //slots now hold exactly the live points
+		vector<double> rows;
+		for (int slot = 0; slot < flat.getSize(); slot++) {
+			for (int d = 0; d < k; d++) {
+				rows.push_back(flat.getCord(slot, d));
+			}
+		}
+		pointBlock block;
+		block.assign(&rows[0], flat.getSize(), k);
+		start = chrono::steady_clock::now();
+		flatTree rebuilt;
+		rebuilt.makeTree(block, cfg.axisMode, cfg.leafSize);
+		double rebuild = secondsSince(start);
+		for (int i = 0; i < q; i++) {
+			bestSlot = -1;
+			bestDistance = DBL_MAX;
+			rebuilt.findNear(queries[i]->getCords(), bestSlot, bestDistance,
+					rebuiltStats);
+		}
+
+		printf("%-8.2f %-9.4f %-11.3f %-11.3f %-12.3f %-8.1f %-16.1f %.4f\n",
+				share, setup, inserts ? insertTime * 1e6 / inserts : 0,
+				deletes ? deleteTime * 1e6 / deletes : 0,
+				searches ? queryTime * 1e6 / searches : 0,
+				(double) updatedStats.nodes / q,
+				(double) rebuiltStats.nodes / q, rebuild);
+	}
+
+	for (nPoint * p : pointVector) {
+		delete p;
+	}
+	for (nPoint * p : queries) {
+		delete p;
+	}
+	for (nPoint * p : extra) {
+		delete p;
+	}
+}
+
+//sustained ingest into a treeForest with reader threads searching it the
+//whole time, then the finished forest against one tree built over everything
+static void benchStream(const benchConfig& cfg) {
+	vector<nPoint*> pointVector;
+	vector<nPoint*> queries;
+
+	int k = loadPoints(cfg, pointVector, queries);
+	if (k < 1 || pointVector.empty()) {
+		return;
+	}
+	int n = pointVector.size();
+	int q = queries.size();
+
+	cout << "Streaming benchmark: " << n << " points, " << q << " queries, "
+			<< k << " dimensions, leaf size " << cfg.leafSize << ", buffer "
+			<< FOREST_BUFFER << endl << endl;
+
+	//one static tree over every point, what a rebuild per batch would cost
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	flatTree flat;
+	flat.makeTree(pointVector, k, cfg.axisMode, cfg.leafSize);
+	double staticBuild = secondsSince(start);
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < q; i++) {
+		int bestSlot = -1;
+		double bestDistance = DBL_MAX;
+		flat.findNear(queries[i]->getCords(), bestSlot, bestDistance);
+	}
+	double staticQuery = secondsSince(start);
+
+	cout << "readers  ingest(pts/s)  queries/s  longest insert(s)  trees  "
+			"forest(us/q)  static(us/q)  static build(s)" << endl;
+
+	vector<int> readers = cfg.threads;
+	if (find(readers.begin(), readers.end(), 0) == readers.end()) {
+		readers.insert(readers.begin(), 0); //ingest alone as the reference
+	}
+	for (int r : readers) {
+		treeForest forest(k, cfg.axisMode, cfg.leafSize);
+		atomic<bool> done(false);
+		atomic<long> answered(0);
+		vector<thread> threads;
+		for (int t = 0; t < r; t++) {
+			threads.push_back(thread([&, t]() {
+				long local = 0;
+				for (int i = t; !done.load(memory_order_relaxed); i++) {
+					int bestIndex = -1;
+					double bestDistance = DBL_MAX;
+					forest.findNear(queries[i % q]->getCords(), bestIndex,
+							bestDistance);
+					local++;
+				}
+				answered += local;
+			}));
+		}
+
+		double longest = 0; //a merge into a large tree stalls its insert
+		start = chrono::steady_clock::now();
+		for (int i = 0; i < n; i++) {
+			chrono::steady_clock::time_point one = chrono::steady_clock::now();
+			forest.insert(pointVector[i]->getCords(), pointVector[i]->getIndex());
+			longest = max(longest, secondsSince(one));
+		}
+		double ingest = secondsSince(start);
+		done = true;
+		for (thread& t : threads) {
+			t.join();
+		}
+
+		start = chrono::steady_clock::now();
+		for (int i = 0; i < q; i++) {
+			int bestIndex = -1;
+			double bestDistance = DBL_MAX;
+			forest.findNear(queries[i]->getCords(), bestIndex, bestDistance);
+		}
+		double forestQuery = secondsSince(start);
+
+		printf("%-8d %-14.0f %-10.0f %-18.4f %-6d %-13.3f %-13.3f %.4f\n", r,
+				n / ingest, answered / ingest, longest, forest.getTreeCount(),
+				forestQuery * 1e6 / q, staticQuery * 1e6 / q, staticBuild);
+	}
+
+	for (nPoint * p : pointVector) {
+		delete p;
+	}
+	for (nPoint * p : queries) {
+		delete p;
+	}
+}
+
+//time getDataFile against pointBlock::readFile on the same csv, a generated
+//file is written first when no --data is given
+static void benchCsv(const benchConfig& cfg) {
+	string file = cfg.dataFile;
+	if (file.empty()) {
+		file = "benchPoints.csv";
+		vector<nPoint*> pointVector;
+		makeUniform(pointVector, cfg.points, cfg.dims, cfg.seed);
+		ofstream out(file);
+		out.precision(numeric_limits<double>::max_digits10);
+		for (nPoint * p : pointVector) {
+			for (int d = 0; d < cfg.dims; d++) {
+				out << (d > 0 ? "," : "") << p->getCords()[d];
+			}
+			out << "\n";
+			delete p;
+		}
+	}
+
+	vector<nPoint*> pointVector;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	int k = getDataFile(file, pointVector);
+	double legacy = secondsSince(start);
+	size_t n = pointVector.size();
+	for (nPoint * p : pointVector) {
+		delete p;
+	}
+
+	cout << "CSV benchmark: " << n << " points, " << k << " dimensions"
+			<< endl << endl;
+	cout << "reader              load(s)   rows/s" << endl;
+	printf("%-19s %-9.4f %.0f\n", "getDataFile", legacy, n / legacy);
+	for (int t : cfg.threads) {
+		taskPool * pool = t > 1 ? new taskPool(t) : nullptr;
+		pointBlock block;
+		start = chrono::steady_clock::now();
+		block.readFile(file, pool);
+		double seconds = secondsSince(start);
+		string name = "readFile x" + to_string(t);
+		printf("%-19s %-9.4f %.0f\n", name.c_str(), seconds, n / seconds);
+		delete pool;
+	}
+
+	if (cfg.dataFile.empty()) {
+		remove(file.c_str());
+	}
+}
+
+//write points to a csv file at full precision
+static void writeCsv(const string file, const vector<nPoint*>& pointVector) {
+	ofstream out(file);
+	out.precision(numeric_limits<double>::max_digits10);
+	for (nPoint * p : pointVector) {
+		for (int d = 0; d < p->getDims(); d++) {
+			out << (d > 0 ? "," : "") << p->getCords()[d];
+		}
+		out << "\n";
+	}
+}
+
+//value at fraction p of sorted values, nearest rank
+static double percentile(const vector<double>& sorted, double p) {
+	return sorted.empty() ? 0 : sorted[(size_t) ((sorted.size() - 1) * p)];
+}
+
+//one phase of the suite: seconds of every timed repetition and the items it
+//handles per run, reported with the spread of the repetitions
+struct phaseTimes {
+	string name;
+	double items;
+	vector<double> seconds;
+};
+
+static void printPhase(FILE * out, const phaseTimes& phase, bool last) {
+	vector<double> sorted = phase.seconds;
+	sort(sorted.begin(), sorted.end());
+	double sum = 0;
+	fprintf(out, "    \"%s\": {\n      \"seconds\": [", phase.name.c_str());
+	for (size_t r = 0; r < phase.seconds.size(); r++) {
+		fprintf(out, "%s%.9g", r > 0 ? ", " : "", phase.seconds[r]);
+		sum += phase.seconds[r];
+	}
+	double median = percentile(sorted, 0.5);
+	fprintf(out, "],\n      \"min\": %.9g,\n      \"median\": %.9g,\n"
+			"      \"mean\": %.9g,\n      \"max\": %.9g,\n"
+			"      \"items_per_second\": %.9g\n    }%s\n",
+			sorted.empty() ? 0 : sorted.front(), median,
+			sorted.empty() ? 0 : sum / sorted.size(),
+			sorted.empty() ? 0 : sorted.back(),
+			median > 0 ? phase.items / median : 0, last ? "" : ",");
+}
+
+//every stage a release touches, timed apart: reading the points from csv,
+//building, writing and reading the binary and text tree files, a nearest
+//neighbor batch and single queries one by one. every phase runs --warmup
+//times untimed and --reps times timed on the same data, and the report is
+//json: per phase the seconds of each repetition with min, median, mean, max
+//and items per second at the median, and the latency percentiles of all
+//timed single queries (each query is timed alone, which adds the cost of
+//reading the clock, about 20 ns, to every latency)
+static int benchSuite(const benchConfig& cfg) {
+	string dataFile = cfg.dataFile.empty() ? "benchSuite.csv" : cfg.dataFile;
+	vector<nPoint*> pointVector;
+	vector<nPoint*> queries;
+	if (cfg.dataFile.empty()) {
+		makePoints(cfg, pointVector, cfg.points, cfg.dims, cfg.seed);
+		writeCsv(dataFile, pointVector);
+	}
+	int k = cfg.dims;
+	if (cfg.queryFile.empty()) {
+		if (!cfg.dataFile.empty()) {
+			k = countDims(cfg.dataFile);
+		}
+		makePoints(cfg, queries, cfg.queries, k, cfg.seed + 1);
+	} else {
+		k = getDataFile(cfg.queryFile, queries);
+	}
+	for (nPoint * p : pointVector) {
+		delete p;
+	}
+	int q = queries.size();
+	vector<double> rows((size_t) q * k);
+	for (int i = 0; i < q; i++) {
+		memcpy(&rows[(size_t) i * k], queries[i]->getCords(),
+				k * sizeof(double));
+		delete queries[i];
+	}
+
+	int threads = cfg.threads.empty() ? 1 : max(1, cfg.threads.front());
+	taskPool * pool = threads > 1 ? new taskPool(threads) : nullptr;
+	string binaryFile = "benchSuite.kdt";
+	string textFile = "benchSuite.txt";
+
+	pointBlock block;
+	flatTree tree;
+	vector<int> slots(q);
+	vector<double> distances(q);
+	vector<double> latencies;
+	double answerSum = 0; //keeps the searches from being skipped
+	int n = 0;
+
+	vector<phaseTimes> phases = { { "load", 0, { } }, { "build", 0, { } }, {
+			"serialize_binary", 0, { } }, { "deserialize_binary", 0, { } }, {
+			"serialize_text", 0, { } }, { "deserialize_text", 0, { } }, {
+			"query_batch", (double) q, { } }, { "query_single", (double) q, { } } };
+
+	for (int run = 0; run < cfg.warmup + cfg.reps; run++) {
+		bool timed = run >= cfg.warmup;
+		double seconds[8];
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		if (block.readFile(dataFile, pool) != k) {
+			cout << "Could not read " << dataFile << " as points of " << k
+					<< " dimensions" << endl;
+			delete pool;
+			return 1;
+		}
+		seconds[0] = secondsSince(start);
+		n = block.getSize();
+
+		start = chrono::steady_clock::now();
+		tree.makeTree(block, cfg.axisMode, cfg.leafSize, pool);
+		seconds[1] = secondsSince(start);
+
+		start = chrono::steady_clock::now();
+		tree.writeBinary(binaryFile);
+		seconds[2] = secondsSince(start);
+
+		//the mapped tree is searched below, so its pages are read in the
+		//query phases and not here
+		flatTree loaded;
+		start = chrono::steady_clock::now();
+		loaded.readTree(binaryFile, k);
+		seconds[3] = secondsSince(start);
+
+		start = chrono::steady_clock::now();
+		tree.writeOut(textFile);
+		seconds[4] = secondsSince(start);
+
+		flatTree parsed;
+		start = chrono::steady_clock::now();
+		parsed.readTree(textFile, k);
+		seconds[5] = secondsSince(start);
+
+		start = chrono::steady_clock::now();
+		loaded.findNearBatch(&rows[0], q, &slots[0], &distances[0], pool);
+		seconds[6] = secondsSince(start);
+
+		chrono::steady_clock::time_point allStart = chrono::steady_clock::now();
+		for (int i = 0; i < q; i++) {
+			int bestSlot = -1;
+			double bestDistance = DBL_MAX;
+			start = chrono::steady_clock::now();
+			loaded.findNear(&rows[(size_t) i * k], bestSlot, bestDistance);
+			double micros = chrono::duration<double, micro>(
+					chrono::steady_clock::now() - start).count();
+			if (timed) {
+				latencies.push_back(micros);
+			}
+			answerSum += bestDistance + bestSlot;
+		}
+		seconds[7] = secondsSince(allStart);
+
+		if (timed) {
+			for (int p = 0; p < 8; p++) {
+				phases[p].seconds.push_back(seconds[p]);
+			}
+		}
+	}
+	delete pool;
+	for (int p = 0; p < 6; p++) {
+		phases[p].items = n;
+	}
+
+	FILE * out = cfg.jsonFile.empty() ? stdout : fopen(cfg.jsonFile.c_str(), "w");
+	if (out == nullptr) {
+		cout << "Could not open " << cfg.jsonFile << endl;
+		return 1;
+	}
+	sort(latencies.begin(), latencies.end());
+	double latencySum = 0;
+	for (double l : latencies) {
+		latencySum += l;
+	}
+	fprintf(out, "{\n  \"benchmark\": \"suite\",\n  \"config\": {\n"
+			"    \"data\": \"%s\",\n    \"shape\": \"%s\",\n"
+			"    \"points\": %d,\n    \"queries\": %d,\n    \"dims\": %d,\n"
+			"    \"axis\": %d,\n    \"leaf\": %d,\n    \"threads\": %d,\n"
+			"    \"seed\": %u,\n    \"warmup\": %d,\n    \"reps\": %d\n  },\n"
+			"  \"phases\": {\n", cfg.dataFile.empty() ? "synthetic" : "csv",
+			cfg.dataFile.empty() ? cfg.shape.c_str() : "", n, q, k,
+			cfg.axisMode, cfg.leafSize, threads, cfg.seed, cfg.warmup, cfg.reps);
+	for (size_t p = 0; p < phases.size(); p++) {
+		printPhase(out, phases[p], p + 1 == phases.size());
+	}
+	fprintf(out, "  },\n  \"query_latency_us\": {\n    \"count\": %zu,\n"
+			"    \"mean\": %.9g,\n    \"p50\": %.9g,\n    \"p90\": %.9g,\n"
+			"    \"p99\": %.9g,\n    \"p999\": %.9g,\n    \"max\": %.9g\n  },\n"
+			"  \"answer_checksum\": %.17g\n}\n", latencies.size(),
+			latencies.empty() ? 0 : latencySum / latencies.size(),
+			percentile(latencies, 0.5), percentile(latencies, 0.9),
+			percentile(latencies, 0.99), percentile(latencies, 0.999),
+			percentile(latencies, 1), answerSum);
+	if (out != stdout) {
+		fclose(out);
+	}
+
+	remove(binaryFile.c_str());
+	remove(textFile.c_str());
+	if (cfg.dataFile.empty()) {
+		remove(dataFile.c_str());
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+
+	benchConfig cfg;
+	cfg.mode = "layout";
+	cfg.shape = "uniform";
+	cfg.points = 1000000;
+	cfg.queries = 100000;
+	cfg.dims = 3;
+	cfg.axisMode = 1;
+	cfg.leafSize = 1;
+	cfg.seed = 2016;
+	cfg.sizes.push_back(1000000);
+	cfg.sizes.push_back(10000000);
+	cfg.threads.push_back(1);
+	cfg.neighbors.push_back(1);
+	cfg.neighbors.push_back(10);
+	cfg.neighbors.push_back(100);
+	cfg.neighbors.push_back(1000);
+	cfg.warmup = 1;
+	cfg.reps = 5;
+
+	//first argument is the benchmark to run, everything else is --option value
+	int arg = 1;
+	if (argc > 1 && strncmp(argv[1], "--", 2) != 0) {
+		cfg.mode = argv[1];
+		arg = 2;
+	}
+	for (; arg + 1 < argc; arg += 2) {
+		string opt = argv[arg];
+		if (opt == "--points") {
+			cfg.points = atoi(argv[arg + 1]);
+		} else if (opt == "--queries") {
+			cfg.queries = atoi(argv[arg + 1]);
+		} else if (opt == "--dims") {
+			cfg.dims = atoi(argv[arg + 1]);
+		} else if (opt == "--axis") {
+			cfg.axisMode = atoi(argv[arg + 1]);
+		} else if (opt == "--leaf") {
+			cfg.leafSize = atoi(argv[arg + 1]);
+		} else if (opt == "--seed") {
+			cfg.seed = atoi(argv[arg + 1]);
+		} else if (opt == "--sizes") { //comma separated list of point counts
+			cfg.sizes = parseList(argv[arg + 1]);
+		} else if (opt == "--neighbors") {
+			cfg.neighbors = parseList(argv[arg + 1]);
+		} else if (opt == "--threads") {
+			cfg.threads = parseList(argv[arg + 1]);
+		} else if (opt == "--data") {
+			cfg.dataFile = argv[arg + 1];
+		} else if (opt == "--shape") { //uniform, clusters, manifold or duplicates
+			cfg.shape = argv[arg + 1];
+			if (cfg.shape != "uniform" && cfg.shape != "clusters"
+					&& cfg.shape != "manifold" && cfg.shape != "duplicates") {
+				cout << "Unknown shape " << cfg.shape
+						<< ", expected: uniform, clusters, manifold, duplicates"
+						<< endl;
+				return 1;
+			}
+		} else if (opt == "--query") {
+			cfg.queryFile = argv[arg + 1];
+		} else if (opt == "--warmup") {
+			cfg.warmup = max(0, atoi(argv[arg + 1]));
+		} else if (opt == "--reps") {
+			cfg.reps = max(1, atoi(argv[arg + 1]));
+		} else if (opt == "--json") {
+			cfg.jsonFile = argv[arg + 1];
+		} else {
+			cout << "Unknown option " << opt << endl;
+			return 1;
+		}
+	}
+
+	if (cfg.mode == "layout") {
+		benchLayout(cfg);
+	} else if (cfg.mode == "leaf") {
+		benchLeaf(cfg);
+	} else if (cfg.mode == "build") {
+		benchBuild(cfg);
+	} else if (cfg.mode == "load") {
+		benchLoad(cfg);
+	} else if (cfg.mode == "csv") {
+		benchCsv(cfg);
+	} else if (cfg.mode == "fixed") {
+		benchFixed(cfg);
+	} else if (cfg.mode == "range") {
+		benchRange(cfg);
+	} else if (cfg.mode == "boxes") {
+		benchBoxes(cfg);
+	} else if (cfg.mode == "split") {
+		benchSplit(cfg);
+	} else if (cfg.mode == "update") {
+		benchUpdate(cfg);
+	} else if (cfg.mode == "stream") {
+		benchStream(cfg);
+	} else if (cfg.mode == "arena") {
+		benchArena(cfg);
+	} else if (cfg.mode == "precision") {
+		benchPrecision(cfg);
+	} else if (cfg.mode == "curve") {
+		benchCurve(cfg);
+	} else if (cfg.mode == "packet") {
+		benchPacket(cfg);
+	} else if (cfg.mode == "suite") {
+		return benchSuite(cfg);
+	} else {
+		cout << "Unknown benchmark " << cfg.mode
+				<< ", expected: layout, leaf, build, load, csv, fixed, range, boxes, split, update, stream, arena, precision, curve, packet, suite"
+				<< endl;
+		return 1;
+	}
+	return 0;
+}
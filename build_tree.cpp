@@ -25,46 +25,160 @@
 
 #include "kdTree.h"
 
-int main(int argc, char *argv[]) {
+//axisMode for a split strategy name, -1 if unknown
+int splitMode(const string& name) {
+	const char * names[] = { "rotate", "range", "variance", "midpoint", "cost" };
+	for (int m = SPLIT_ROTATE; m <= SPLIT_COST; m++) {
+		if (name == names[m]) {
+			return m;
+		}
+	}
+	return -1;
+}
 
-	vector<nPoint*> pointVector;
+int main(int argc, char *argv[]) {
 
 	string source = "sample_data.csv";
-	string dest = "treeOut.txt";
+	string dest = "";
+	string format = "binary";
 	int axisMode = 1;
-
-	if (argc > 1) {
-		source = argv[1];
+	int leafSize = 1;
+	int threads = 1;
+	int precision = PRECISION_DOUBLE;
+	bool exact = true; //keep the doubles behind a reduced precision copy, 0 is approximate
+	int layout = CURVE_NONE;
+	bool boxes = false; //bounding boxes stored with a binary tree
+
+	//positional arguments are source, dest and axisMode, options are --name value
+	int position = 0;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg.compare(0, 2, "--") == 0) {
+			if (i + 1 >= argc) {
+				cout << "Missing value for option " << arg << endl;
+				return 1;
+			}
+			if (arg == "--leaf") {
+				leafSize = atoi(argv[++i]);
+			} else if (arg == "--format") { //binary or text
+				format = argv[++i];
+			} else if (arg == "--split") { //strategy name, overrides axisMode
+				string name = argv[++i];
+				axisMode = splitMode(name);
+				if (axisMode < 0) {
+					cout << "Unknown split strategy " << name
+							<< ", expected rotate, range, variance, midpoint or cost"
+							<< endl;
+					return 1;
+				}
+			} else if (arg == "--threads") {
+				threads = atoi(argv[++i]);
+			} else if (arg == "--layout") { //none, morton or hilbert
+				string name = argv[++i];
+				layout = curveValue(name);
+				if (layout < 0) {
+					cout << "Unknown layout " << name
+							<< ", expected none, morton or hilbert" << endl;
+					return 1;
+				}
+			} else if (arg == "--boxes") {
+				boxes = atoi(argv[++i]) != 0;
+			} else if (arg == "--precision") { //double, float or quant16
+				string name = argv[++i];
+				precision = precisionValue(name);
+				if (precision < 0) {
+					cout << "Unknown precision " << name
+							<< ", expected double, float or quant16" << endl;
+					return 1;
+				}
+			} else if (arg == "--exact") {
+				exact = atoi(argv[++i]) != 0;
+			} else {
+				cout << "Unknown option " << arg << endl;
+				return 1;
+			}
+		} else if (position == 0) {
+			source = arg;
+			position++;
+		} else if (position == 1) {
+			dest = arg;
+			position++;
+		} else if (position == 2) {
+			axisMode = atoi(arg.c_str());
+			position++;
+		}
 	}
-	if (argc > 2) {
-		dest = argv[2];
+	if (format != "binary" && format != "text") {
+		cout << "Unknown tree format " << format << ", expected binary or text"
+				<< endl;
+		return 1;
 	}
-	if (argc > 3) {
-		axisMode = atoi(argv[3]);
+	if (dest.empty()) {
+		dest = format == "binary" ? "treeOut.kdt" : "treeOut.txt";
 	}
-	if (axisMode == 0) {
+	if (axisMode == SPLIT_ROTATE) {
 		cout << "Using rotating heuristic for axis selection" << endl;
+	} else if (axisMode == SPLIT_VARIANCE) {
+		cout << "Using variance heuristic for axis selection" << endl;
+	} else if (axisMode == SPLIT_MIDPOINT) {
+		cout << "Using sliding midpoint splits" << endl;
+	} else if (axisMode == SPLIT_COST) {
+		cout << "Using cost model splits" << endl;
 	} else {
 		cout << "Using range heuristic for axis selection" << endl;
 	}
 
+	cout << "Using up to " << leafSize << " points per leaf" << endl;
+	if (layout != CURVE_NONE) {
+		cout << "Laying nodes and points out in " << curveName(layout)
+				<< " order" << endl;
+	}
+	if (boxes && format == "binary") {
+		cout << "Storing a bounding box for every node" << endl;
+	}
+	if (precision != PRECISION_DOUBLE) {
+		cout << "Storing " << precisionName(precision) << " coordinates"
+				<< (exact ?
+						", answers are settled on the doubles kept after them" :
+						" in place of the doubles, answers are approximate")
+				<< endl;
+	}
+
 	cout << "Reading in tree data from " << source << endl;
 
-	int k = getDataFile(source, pointVector); //return how many dimensions (k) data is
+	flatTree tree;
+	tree.setPrecision(precision);
+	tree.setExactCords(exact);
+	tree.setCurveLayout(layout);
+	tree.setBoundingBoxes(boxes && format == "binary");
+	taskPool * pool = nullptr;
+	if (threads > 1) {
+		cout << "Building with " << threads << " threads" << endl;
+		pool = new taskPool(threads);
+	}
 
-	treeNode * root = new treeNode;
+	pointBlock points;
+	if (points.readFile(source, pool) < 1) { //parse straight into one row-major block
+		return 1;
+	}
 
-	root->makeTree(pointVector, 0, k, axisMode); //recursively create tree
+	if (!tree.makeTree(points, axisMode, leafSize, pool)) { //create tree, points are copied into the tree
+		cout << "Tree creation failed" << endl;
+		return 1;
+	}
 
 	cout << "Tree creation complete" << endl;
+	delete pool;
 
-	root->writeOut(dest, k); //write tree to location
+	if (format == "binary") { //write tree to location
+		if (!tree.writeBinary(dest)) {
+			return 1;
+		}
+	} else {
+		tree.writeOut(dest);
+	}
 
 	cout << "Tree output to " << dest << endl;
 
-	delete root; //deletes entire tree and associated data
-
-	pointVector.clear(); //points already destroyed when tree is deleted, so simply clear vector
-
 }
 
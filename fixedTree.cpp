@@ -0,0 +1,94 @@
+/*
+ * fixedTree.cpp
+ */
+
+/*
+ This file is part of kdTree.
+
+ kdTree is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ kdTree is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with kdTree.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fixedTree.h"
+
+//flatTree behind the searchTree interface, used above MAX_FIXED_DIMS
+class dynamicTree: public searchTree {
+protected:
+	int dims;
+	flatTree tree;
+
+public:
+	dynamicTree(int dims) :
+			dims(dims) {
+	}
+
+	int getDims() const {
+		return dims;
+	}
+
+	int getSize() const {
+		return tree.getSize();
+	}
+
+	bool build(const pointBlock& block, int axisMode, int leafSize) {
+		if (block.getDims() != dims) {
+			cout << "ERROR, POINTS ARE NOT OF DIMENSION " << dims << endl;
+			return false;
+		}
+		return tree.makeTree(block, axisMode, leafSize) != nullptr;
+	}
+
+	bool readTree(const string fileName, bool verify) {
+		return tree.readTree(fileName, dims, verify) != nullptr;
+	}
+
+	bool writeBinary(const string fileName) const {
+		return tree.writeBinary(fileName);
+	}
+
+	void findNearBatch(const double * queries, int count, int * bestSlots,
+			double * bestDistances, taskPool * pool) const {
+		tree.findNearBatch(queries, count, bestSlots, bestDistances, pool);
+	}
+
+	int getIndex(int slot) const {
+		return tree.getIndex(slot);
+	}
+
+	void printPoint(int slot) const {
+		tree.printPoint(slot);
+	}
+};
+
+searchTree * makeSearchTree(int dims) {
+	switch (dims) {
+	case 1:
+		return new kdTree<1>;
+	case 2:
+		return new kdTree<2>;
+	case 3:
+		return new kdTree<3>;
+	case 4:
+		return new kdTree<4>;
+	case 5:
+		return new kdTree<5>;
+	case 6:
+		return new kdTree<6>;
+	case 7:
+		return new kdTree<7>;
+	case 8:
+		return new kdTree<8>;
+	default:
+		return new dynamicTree(dims);
+	}
+}
@@ -0,0 +1,438 @@
+/*
+ * fixedTree.h
+ */
+
+/*
+ This file is part of kdTree.
+
+ kdTree is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ kdTree is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with kdTree.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FIXEDTREE_H_
+#define FIXEDTREE_H_
+
+#include "kdTree.h"
+
+//largest dimension with a compiled kdTree, makeSearchTree uses flatTree above it
+#define MAX_FIXED_DIMS 8
+
+//common interface of the compiled trees and flatTree so callers can pick
+//the tree for a dimension known only at run time
+class searchTree {
+public:
+	virtual int getDims() const = 0;
+
+	//number of points stored in the tree
+	virtual int getSize() const = 0;
+
+	//build from a block of points, returns false on failure
+	virtual bool build(const pointBlock& block, int axisMode,
+			int leafSize = 1) = 0;
+
+	//read a text or binary tree file written by flatTree or writeBinary,
+	//returns false on failure
+	virtual bool readTree(const string fileName, bool verify = true) = 0;
+
+	//write the tree in the binary format of flatTree::writeBinary
+	virtual bool writeBinary(const string fileName) const = 0;
+
+	//nearest neighbor for count row-major queries, same contract as
+	//flatTree::findNearBatch
+	virtual void findNearBatch(const double * queries, int count,
+			int * bestSlots, double * bestDistances,
+			taskPool * pool = nullptr) const = 0;
+
+	//original index of the point stored in a slot
+	virtual int getIndex(int slot) const = 0;
+
+	//print out information about the point stored in a slot, same format as
+	//flatTree::printPoint
+	virtual void printPoint(int slot) const = 0;
+
+	virtual ~searchTree() {
+	}
+};
+
+//k-d tree with the dimension fixed at compile time, so every axis loop has a
+//constant trip count and unrolls. nodes and coordinates use the flatTree
+//layout, so with Scalar double leaves are scanned by the same leafSquares
+//kernels, a tree file is searched straight from its mapping and the splits,
+//slots and distances are exactly those of flatTree with the same options for
+//inputs smaller than the partition cutoff. only SPLIT_ROTATE and SPLIT_RANGE
+//are compiled here, any other axisMode splits by range
+template<int Dim, typename Scalar = double>
+class kdTree: public searchTree {
+public:
+	struct point {
+		Scalar cords[Dim];
+	};
+
+protected:
+	int leafSize;
+	vector<flatNode> nodes;	//same node layout as flatTree
+	vector<Scalar> cords;	//leaf order, axis d of slot s at [d * pointTotal + s]
+	vector<int> indices;	//original index of the point held in each slot
+	flatTree source;		//tree read from a file, a double tree searches its arrays
+
+	//what searches read, the owned arrays or those of source
+	const flatNode * nodeData;
+	const Scalar * cordData;
+	const int * indexData;
+	size_t nodeTotal;
+	size_t pointTotal;
+
+	void useOwned() {
+		nodeData = nodes.empty() ? nullptr : &nodes[0];
+		cordData = cords.empty() ? nullptr : &cords[0];
+		indexData = indices.empty() ? nullptr : &indices[0];
+		nodeTotal = nodes.size();
+		pointTotal = indices.size();
+	}
+
+	//axis with the largest range, -1 if every axis has zero range
+	static int largestRange(const int * first, const int * last,
+			const point * work) {
+		Scalar big[Dim];
+		Scalar small[Dim];
+		for (int d = 0; d < Dim; d++) {
+			big[d] = small[d] = work[*first].cords[d];
+		}
+		for (const int * p = first + 1; p < last; p++) {
+			const point& cur = work[*p];
+			for (int d = 0; d < Dim; d++) {
+				big[d] = cur.cords[d] > big[d] ? cur.cords[d] : big[d];
+				small[d] = cur.cords[d] < small[d] ? cur.cords[d] : small[d];
+			}
+		}
+		Scalar maxDif = 0;
+		int retVal = -1;
+		for (int d = 0; d < Dim; d++) {
+			if (big[d] - small[d] > maxDif) {
+				maxDif = big[d] - small[d];
+				retVal = d;
+			}
+		}
+		return retVal;
+	}
+
+	//partitions the order array in place, splits are chosen exactly as in
+	//flatTree::buildRecur and points are read through the order entries
+	void buildRecur(int * base, int * first, int * last, int dIndex, int node,
+			const point * work, int axisMode, int& nextNode) {
+
+		int size = last - first;
+		int curDepth;
+
+		if (size <= leafSize) { //create leaf
+			curDepth = dIndex > 0 ? dIndex - 1 : 0;
+
+			nodes[node].axis = curDepth;
+			nodes[node].val = work[*first].cords[curDepth];
+			nodes[node].child = first - base;
+			nodes[node].count = size;
+			return;
+		}
+
+		if (axisMode == 0) { //simple rotation
+			curDepth = dIndex % Dim;
+		} else { //by range
+			curDepth = largestRange(first, last, work);
+			if (curDepth < 0) { //every point identical, any axis will do
+				curDepth = dIndex % Dim;
+			}
+		}
+
+		int middle = (size == 2) ? 0 : size / 2;
+
+		nth_element(first, first + middle, last,
+				[work, curDepth](int a, int b) {
+					return work[a].cords[curDepth] < work[b].cords[curDepth];
+				}); //get median value, sort all less points to left and greater to right
+
+		int left = nextNode;
+		nextNode += 2;
+
+		nodes[node].axis = curDepth;
+		nodes[node].val = work[first[middle]].cords[curDepth];
+		nodes[node].child = left;
+		nodes[node].count = 0;
+
+		int * split = first + middle + 1;
+		buildRecur(base, first, split, curDepth + 1, left, work, axisMode,
+				nextNode);
+		buildRecur(base, split, last, curDepth + 1, left + 1, work, axisMode,
+				nextNode);
+	}
+
+	//same scan as flatTree::scanLeaf, distances for up to 64 points at once
+	//then checked in slot order
+	void scanLeaf(const point& query, const flatNode& leaf, int& bestSlot,
+			Scalar& bestSquare) const {
+
+		const int chunk = 64;
+		Scalar dist[chunk];
+
+		for (int done = 0; done < leaf.count; done += chunk) {
+			int count = min(chunk, leaf.count - done);
+			int first = leaf.child + done;
+
+			if constexpr (is_same<Scalar, double>::value) {
+				leafSquares(query.cords, cordData + first, pointTotal, count,
+						Dim, bestSquare, dist);
+			} else {
+				for (int i = 0; i < count; i++) {
+					Scalar sum = 0;
+					for (int d = 0; d < Dim; d++) {
+						Scalar dif = query.cords[d]
+								- cordData[d * pointTotal + first + i];
+						sum += dif * dif;
+					}
+					dist[i] = sum;
+				}
+			}
+
+			for (int i = 0; i < count; i++) {
+				if (dist[i] < bestSquare) {
+					bestSquare = dist[i];
+					bestSlot = first + i;
+				}
+			}
+		}
+	}
+
+	//same traversal as flatTree::nearRecur
+	void nearRecur(const point& query, int node, int& bestSlot,
+			Scalar& bestSquare) const {
+
+		const flatNode& cur = nodeData[node];
+
+		if (cur.count > 0) { //found leaf
+			scanLeaf(query, cur, bestSlot, bestSquare);
+			return;
+		}
+
+		Scalar offset = query.cords[cur.axis] - (Scalar) cur.val;
+		if (offset <= 0) { //left first
+			nearRecur(query, cur.child, bestSlot, bestSquare);
+			if (offset * offset < bestSquare) {
+				nearRecur(query, cur.child + 1, bestSlot, bestSquare);
+			}
+		} else { //right first
+			nearRecur(query, cur.child + 1, bestSlot, bestSquare);
+			if (offset * offset <= bestSquare) {
+				nearRecur(query, cur.child, bestSlot, bestSquare);
+			}
+		}
+	}
+
+	void clear() {
+		nodes.clear();
+		cords.clear();
+		indices.clear();
+		source.clear();
+		useOwned();
+	}
+
+public:
+	kdTree() :
+			leafSize(1), nodeData(nullptr), cordData(nullptr), indexData(
+					nullptr), nodeTotal(0), pointTotal(0) {
+	}
+
+	int getDims() const {
+		return Dim;
+	}
+
+	int getSize() const {
+		return pointTotal;
+	}
+
+	int getLeafSize() const {
+		return leafSize;
+	}
+
+	int getIndex(int slot) const {
+		return indexData[slot];
+	}
+
+	point getPoint(int slot) const {
+		point p;
+		for (int d = 0; d < Dim; d++) {
+			p.cords[d] = cordData[d * pointTotal + slot];
+		}
+		return p;
+	}
+
+	void printPoint(int slot) const {
+		cout << "Point " << indexData[slot] << " at ";
+		for (int d = 0; d < Dim; d++) {
+			cout << (double) cordData[d * pointTotal + slot];
+			if (d < Dim - 1)
+				cout << ",";
+		}
+	}
+
+	//build from count row-major points of Dim values, the index of a point is
+	//its row. returns false for empty input or a bad leaf size
+	bool makeTree(const double * data, int count, int axisMode,
+			int leafSize = 1) {
+
+		clear();
+
+		if (count < 1) {
+			cout << "ERROR, LIST OF POINTS TOO SMALL" << endl;
+			return false;
+		}
+		if (leafSize < 1 || leafSize > MAX_LEAF_SIZE) {
+			cout << "ERROR, LEAF SIZE MUST BE BETWEEN 1 AND " << MAX_LEAF_SIZE
+					<< endl;
+			return false;
+		}
+		this->leafSize = leafSize;
+
+		vector<point> work(count);
+		vector<int> order(count);
+		for (int i = 0; i < count; i++) {
+			for (int d = 0; d < Dim; d++) {
+				work[i].cords[d] = (Scalar) data[(size_t) i * Dim + d];
+			}
+			order[i] = i;
+		}
+
+		nodes.resize(2 * (size_t) count - 1);
+		int nextNode = 1;
+		buildRecur(&order[0], &order[0], &order[0] + count, 0, 0, &work[0],
+				axisMode, nextNode);
+		nodes.resize(nextNode);
+
+		//store points in leaf order
+		cords.resize((size_t) Dim * count);
+		indices.resize(count);
+		for (int s = 0; s < count; s++) {
+			for (int d = 0; d < Dim; d++) {
+				cords[(size_t) d * count + s] = work[order[s]].cords[d];
+			}
+			indices[s] = order[s];
+		}
+		useOwned();
+		return true;
+	}
+
+	bool build(const pointBlock& block, int axisMode, int leafSize = 1) {
+		if (block.getDims() != Dim) {
+			cout << "ERROR, POINTS ARE NOT OF DIMENSION " << Dim << endl;
+			return false;
+		}
+		return makeTree(block.getSize() ? block.getPoint(0) : nullptr,
+				block.getSize(), axisMode, leafSize);
+	}
+
+	//the file is loaded by flatTree, a double tree then searches its arrays,
+	//which for a binary file means straight from the mapping, and a float
+	//tree keeps a converted copy
+	bool readTree(const string fileName, bool verify = true) {
+
+		clear();
+		if (!source.readTree(fileName, Dim, verify)) {
+			return false;
+		}
+		leafSize = source.getLeafSize();
+		size_t n = source.getSlotCount();
+
+		//a double tree is searched where source holds it, anything else is
+		//copied, a reduced precision tree without the doubles as it decodes
+		if (is_same<Scalar, double>::value && source.getCords() != nullptr) {
+			nodeData = source.getNodeCount() ? &source.getNode(0) : nullptr;
+			cordData = (const Scalar *) source.getCords();
+			indexData = source.getIndices();
+			nodeTotal = source.getNodeCount();
+			pointTotal = n;
+			return true;
+		}
+		if (source.getNodeCount() > 0) {
+			nodes.assign(&source.getNode(0),
+					&source.getNode(0) + source.getNodeCount());
+		}
+		cords.resize(Dim * n);
+		for (int d = 0; d < Dim; d++) {
+			for (size_t s = 0; s < n; s++) {
+				cords[d * n + s] = (Scalar) source.getCord(s, d);
+			}
+		}
+		indices.assign(source.getIndices(), source.getIndices() + n);
+		source.clear();
+		useOwned();
+		return true;
+	}
+
+	//a double tree without boxes, float coordinates are written widened
+	bool writeBinary(const string fileName) const {
+		vector<double> wide;
+		const double * cords = (const double *) cordData;
+		if constexpr (!is_same<Scalar, double>::value) {
+			wide.assign(cordData, cordData + Dim * pointTotal);
+			cords = wide.empty() ? nullptr : &wide[0];
+		}
+		treeSections tree = { nodeData, nodeTotal, cords, indexData,
+				pointTotal, PRECISION_DOUBLE, nullptr, nullptr, 0, nullptr };
+		return writeTreeFile(fileName, Dim, leafSize, tree);
+	}
+
+	//nearest neighbor search, bestDistance is used as the initial bound
+	void findNear(const point& query, int& bestSlot,
+			double& bestDistance) const {
+		if (nodeTotal == 0) {
+			return;
+		}
+		int start = bestSlot;
+		Scalar bestSquare =
+				bestDistance < sqrt((double) numeric_limits<Scalar>::max()) ?
+						(Scalar) (bestDistance * bestDistance) :
+						numeric_limits<Scalar>::infinity();
+		nearRecur(query, 0, bestSlot, bestSquare);
+		if (bestSlot != start) {
+			bestDistance = sqrt((double) bestSquare);
+		}
+	}
+
+	void findNearBatch(const double * queries, int count, int * bestSlots,
+			double * bestDistances, taskPool * pool = nullptr) const {
+
+		auto search = [this, queries, bestSlots, bestDistances](size_t begin,
+				size_t end) {
+			point query;
+			for (size_t i = begin; i < end; i++) {
+				for (int d = 0; d < Dim; d++) {
+					query.cords[d] = (Scalar) queries[i * Dim + d];
+				}
+				bestSlots[i] = -1;
+				bestDistances[i] = DBL_MAX;
+				findNear(query, bestSlots[i], bestDistances[i]);
+			}
+		};
+
+		if (pool == nullptr || pool->getThreads() == 1) {
+			search(0, count);
+		} else {
+			pool->parallelFor(count, (count + QUERY_CHUNK - 1) / QUERY_CHUNK,
+					search);
+		}
+	}
+};
+
+//tree for dims, a compiled kdTree<dims, double> for 1 to MAX_FIXED_DIMS
+//dimensions and a flatTree above that. the caller deletes the tree
+searchTree * makeSearchTree(int dims);
+
+#endif /* FIXEDTREE_H_ */
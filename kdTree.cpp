@@ -26,6 +26,15 @@
  */
 
 #include "kdTree.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <charconv>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
 
 //nPoint method definitions
 
@@ -34,7 +43,7 @@ nPoint::nPoint(int i, int d, double * c) :
 }
 
 nPoint::~nPoint() {
-	delete cords;
+	delete[] cords;
 }
 
 int nPoint::getIndex() const {
@@ -70,60 +79,69 @@ double nPoint::getAbDist(const nPoint* B) const {
 		cout << "points are not of same dimension\n";
 		return -1;
 	} else {
-		double sum = 0;
-		double dif = 0;
+		return sqrt(getSqDist(B));
+	}
+}
 
-		for (int dim = 0; dim < dims; dim++) { // every dim
-			dif = this->getCords()[dim] - B->getCords()[dim];
-			sum += dif * dif;
-		}
-		return sqrt(sum);
+//get squared euclidian distance between 2 points of the same dimension
+double nPoint::getSqDist(const nPoint* B) const {
+	double sum = 0;
+	double dif = 0;
+
+	for (int dim = 0; dim < dims; dim++) { // every dim
+		dif = cords[dim] - B->cords[dim];
+		sum += dif * dif;
 	}
+	return sum;
 }
 
-//find nearest neighbor and print index and distance
+//find nearest neighbor and print index and distance. the search compares
+//squared distances and only takes the root of the final answer, which is the
+//same value getAbDist gives for that point
 void nPoint::findNear(const treeNode* tree, nPoint*& bestPoint,
-		double& bestDistance, int k) const {
+		double& bestDistance) const {
+	nPoint * start = bestPoint;
+	double bestSquare = bestDistance * bestDistance;
+	nearRecur(tree, bestPoint, bestSquare);
+	if (bestPoint != start) {
+		bestDistance = sqrt(bestSquare);
+	}
+}
+
+void nPoint::nearRecur(const treeNode* tree, nPoint*& bestPoint,
+		double& bestSquare) const {
 
-	bool lFirst;
 	if (tree->getLeft() == nullptr && tree->getRight() == nullptr) { //found leaf
-		double tempDist = this->getAbDist(tree->getPoint());
-		if (tempDist < bestDistance) {
-			bestDistance = tempDist;
+		double tempSquare = this->getSqDist(tree->getPoint());
+		if (tempSquare < bestSquare) {
+			bestSquare = tempSquare;
 			bestPoint = tree->getPoint();
 		}
-	} else { //decide whether to look left or right first
-		if (this->getAxisCord(tree->getAxis()) <= tree->getVal()) {
-			lFirst = true;
-		} else {
-			lFirst = false;
-		}
-		if (lFirst) { //left first
-			if (this->getAxisCord(tree->getAxis()) - bestDistance
-					<= tree->getVal()) {
-
-				this->findNear(tree->getLeft(), bestPoint, bestDistance, k);
-			}
-			if (this->getAxisCord(tree->getAxis()) + bestDistance
-					> tree->getVal()) {
-
-				this->findNear(tree->getRight(), bestPoint, bestDistance, k);
-			}
-		} else { //right first
-			if (this->getAxisCord(tree->getAxis()) + bestDistance
-					> tree->getVal()) {
-
-				this->findNear(tree->getRight(), bestPoint, bestDistance, k);
-			}
-			if (this->getAxisCord(tree->getAxis()) - bestDistance
-					<= tree->getVal()) {
+		return;
+	}
 
-				this->findNear(tree->getLeft(), bestPoint, bestDistance, k);
-			}
+	//offset from the splitting plane, the far side is only searched when the
+	//plane is closer than the best point so far
+	double offset = this->getAxisCord(tree->getAxis()) - tree->getVal();
+	if (offset <= 0) { //left first
+		this->nearRecur(tree->getLeft(), bestPoint, bestSquare);
+		if (offset * offset < bestSquare) {
+			this->nearRecur(tree->getRight(), bestPoint, bestSquare);
+		}
+	} else { //right first
+		this->nearRecur(tree->getRight(), bestPoint, bestSquare);
+		if (offset * offset <= bestSquare) {
+			this->nearRecur(tree->getLeft(), bestPoint, bestSquare);
 		}
 	}
 }
 
+//find nearest neighbor in a flat tree
+void nPoint::findNear(const flatTree* tree, int& bestSlot,
+		double& bestDistance) const {
+	tree->findNear(cords, bestSlot, bestDistance);
+}
+
 //treeNode method defnitions
 
 treeNode::treeNode(int a, double v, treeNode* l, treeNode* r, nPoint * p) :
@@ -234,88 +252,63 @@ void treeNode::writeOut(const string fileName, const int totalDim) const {
 
 }
 
-//recursively creates a k-d tree with points sorted less than eqaul on left, greater to right
+//creates a k-d tree with points sorted less than eqaul on left, greater to right
+//points is the one copy the whole build partitions in place
 treeNode * treeNode::makeTree(vector<nPoint*> points, int dIndex,
 		int const totalDepth, int axisMode) {
-	int curDepth;
-	static int leafCount = 0;
-	static int totalCount = 0;
-	totalCount++;
 
 	if (points.size() < 1) {
 		cout << "ERROR, LIST OF POINTS TOO SMALL" << endl;
 		return nullptr;
 	}
-	if (points.size() == 1) { //create leaf
+	return makeTree(points.begin(), points.end(), dIndex, totalDepth, axisMode);
+}
+
+//recursively creates a k-d tree over [first, last), no heap allocation per level
+treeNode * treeNode::makeTree(vector<nPoint*>::iterator first,
+		vector<nPoint*>::iterator last, int dIndex, int const totalDepth,
+		int axisMode, nodeArena * arena) {
+	int curDepth;
+	int size = last - first;
+
+	if (size < 1) {
+		cout << "ERROR, LIST OF POINTS TOO SMALL" << endl;
+		return nullptr;
+	}
+	if (size == 1) { //create leaf
 
 		curDepth = dIndex - 1;
 
-		double pos = points.at(0)->getAxisCord(curDepth);
+		double pos = (*first)->getAxisCord(curDepth);
 
 		this->axis = curDepth;
 		this->val = pos;
 		this->left = nullptr;
 		this->right = nullptr;
-		this->point = points.at(0);
-
-		leafCount++;
-
-		return this;
-	}
-	if (points.size() == 2) {
-
-		if (axisMode == 0) { //simple rotation
-			curDepth = dIndex % totalDepth;
-		} else { //largest range
-			curDepth = findLargestRange(points, totalDepth);
-		}
-
-		int middle = 0;
-
-		nth_element(points.begin(), points.begin() + middle, points.end(),
-				Sort<nPoint *>(curDepth)); //get median value, sort all less points to left and greater to right
-
-		double median = points.at(0)->getAxisCord(curDepth);
-
-		vector<nPoint *> lessOrEqual(points.begin(), points.begin() + 1);
-		vector<nPoint *> greater(points.begin() + 1, points.end());
-
-		treeNode * left = new treeNode;
-		left->makeTree(lessOrEqual, curDepth + 1, totalDepth, axisMode);
-
-		treeNode * right = new treeNode;
-		right->makeTree(greater, curDepth + 1, totalDepth, axisMode);
-
-		this->axis = curDepth;
-		this->val = median;
-		this->left = left;
-		this->right = right;
-		this->point = nullptr;
+		this->point = *first;
 
 		return this;
 	}
 
-	//for size greater than 2
 	if (axisMode == 0) { //simple rotation
 		curDepth = dIndex % totalDepth;
 	} else { //by range
-		curDepth = findLargestRange(points, totalDepth);
+		curDepth = findLargestRange(first, last, totalDepth);
 	}
 
-	int middle = (points.size() / 2);
+	//two points split after the first one, otherwise split after the median
+	int middle = (size == 2) ? 0 : size / 2;
 
-	nth_element(points.begin(), points.begin() + middle, points.end(),
-			Sort<nPoint *>(curDepth));
+	nth_element(first, first + middle, last, Sort<nPoint *>(curDepth)); //get median value, sort all less points to left and greater to right
 
-	double median = points.at(middle)->getAxisCord(curDepth);
+	double median = first[middle]->getAxisCord(curDepth);
 
-	vector<nPoint *> lessOrEqual(points.begin(), points.begin() + middle + 1);
-	vector<nPoint *> greater(points.begin() + middle + 1, points.end());
-
-	treeNode * left = new treeNode;
-	left->makeTree(lessOrEqual, curDepth + 1, totalDepth, axisMode);
-	treeNode * right = new treeNode;
-	right->makeTree(greater, curDepth + 1, totalDepth, axisMode);
+	treeNode * left = arena ? arena->make<treeNode>() : new treeNode;
+	left->makeTree(first, first + middle + 1, curDepth + 1, totalDepth,
+			axisMode, arena);
+	treeNode * right = arena ? arena->make<treeNode>() : new treeNode;
+	right->makeTree(first + middle + 1, last, curDepth + 1, totalDepth,
+			axisMode, arena);
 
 	this->axis = curDepth;
 	this->val = median;
@@ -328,7 +321,7 @@ treeNode * treeNode::makeTree(vector<nPoint*> points, int dIndex,
 
 //recursive function to read in input from file to reconstruct tree
 treeNode * treeNode::recurIn(stringstream& stream, int totalNodes,
-		const int totalDim) {
+		const int totalDim, nodeArena * arena) {
 	string cell;
 
 	totalNodes++;
@@ -364,14 +357,16 @@ treeNode * treeNode::recurIn(stringstream& stream, int totalNodes,
 		getline(stream, cell, ','); //dims
 
 		dims = stoi(cell);
-		cords = new double[totalDim];
+		cords = arena ? arena->makeCords(totalDim) : new double[totalDim];
 		for (int i = 0; i < totalDim; i++) {
 			getline(stream, cell, ','); //val
 			ch = cell.c_str();
 			cords[i] = atof(ch);
 		}
 
-		point = new nPoint(index, dims, cords);
+		point = arena ?
+				arena->make<nPoint>(index, dims, cords) :
+				new nPoint(index, dims, cords);
 		left = nullptr;
 		right = nullptr;
 		getline(stream, cell, ','); //left null
@@ -379,10 +374,10 @@ treeNode * treeNode::recurIn(stringstream& stream, int totalNodes,
 
 	} else {
 		point = nullptr;
-		left = new treeNode;
-		right = new treeNode;
-		left->recurIn(stream, totalNodes, totalDim);
-		right->recurIn(stream, totalNodes, totalDim);
+		left = arena ? arena->make<treeNode>() : new treeNode;
+		right = arena ? arena->make<treeNode>() : new treeNode;
+		left->recurIn(stream, totalNodes, totalDim, arena);
+		right->recurIn(stream, totalNodes, totalDim, arena);
 	}
 	this->axis = axis;
 	this->val = val;
@@ -416,123 +411,3592 @@ treeNode* treeNode::readTree(const string fileName, const int k) {
 	}
 }
 
-//helper functions
+//nodeArena method definitions
 
-//returns the number of dimensions by determining how many commas are in csv
-int countDims(string const fileName) {
-	ifstream myfile(fileName);
-	string line;
-	if (myfile.is_open()) {
-		if (getline(myfile, line)) { //get every point
-			size_t n = std::count(line.begin(), line.end(), ',');
-			return n + 1; //last point will have comma afterwards
-		}
-		cout << "Could not count commas, file was empty";
-		return -1;
-	} else {
-		cout << "Could not count commas, file failed to open\n";
+nodeArena::nodeArena(size_t blockSize) :
+		blockSize(blockSize < 64 ? 64 : blockSize), used(0), last(0), total(0) {
+}
+
+void nodeArena::reserve(size_t bytes) {
+	if (last - used >= bytes) {
+		return;
 	}
-	return -1;
+	size_t size = bytes > blockSize ? bytes : blockSize;
+	blocks.push_back(static_cast<char*>(::operator new(size)));
+	used = 0;
+	last = size;
+	total += size;
 }
 
-//compares contents of two files and returns if they are identical
-//based on the code published at http://stackoverflow.com/questions/6163611/compare-two-files
-//by username Christoph
-bool compareFile(FILE* file_compared, FILE* file_checked) {
-	bool diff = 0;
-	int N = 65536;
-	char* b1 = (char*) calloc(1, N + 1);
-	char* b2 = (char*) calloc(1, N + 1);
-	size_t s1, s2;
+void * nodeArena::take(size_t bytes, size_t align) {
+	size_t start = (used + align - 1) & ~(align - 1);
+	if (blocks.empty() || start + bytes > last) { //new block, operator new
+		reserve(bytes + align);						//aligns to max_align_t
+		start = 0;
+	}
+	used = start + bytes;
+	return blocks.back() + start;
+}
 
-	do {
-		s1 = fread(b1, 1, N, file_compared);
-		s2 = fread(b2, 1, N, file_checked);
+double * nodeArena::makeCords(int k) {
+	return static_cast<double*>(take(k * sizeof(double), alignof(double)));
+}
 
-		if (s1 != s2 || memcmp(b1, b2, s1)) {
-			diff = 1;
-			break;
-		}
-	} while (!feof(file_compared) || !feof(file_checked));
+size_t nodeArena::getBytes() const {
+	return total;
+}
 
-	free(b1);
-	free(b2);
+void nodeArena::clear() {
+	for (char * block : blocks) {
+		::operator delete(block);
+	}
+	blocks.clear();
+	used = last = total = 0;
+}
 
-	if (diff)
-		return false;
-	else
-		return true;
+nodeArena::~nodeArena() {
+	clear();
 }
 
-//read in data from csv and create vector of points of n dimensions
-//returns number of dimensions normally, or -1 if unsucessful
-int getDataFile(string const fileName, vector<nPoint*>& pointVector) {
-	std::string line;
-	double * pCords;
+//arenaTree method definitions
 
-	int k = 0;
-	int rows = 0;
+arenaTree::arenaTree() :
+		root(nullptr), dims(0) {
+}
+
+treeNode * arenaTree::makeTree(const vector<nPoint*>& points,
+		int const totalDepth, int axisMode) {
+	clear();
+	if (points.size() < 1) {
+		cout << "ERROR, LIST OF POINTS TOO SMALL" << endl;
+		return nullptr;
+	}
+
+	//one block for the 2n - 1 nodes, the points and their coordinates
+	size_t n = points.size();
+	arena.reserve(
+			(2 * n - 1) * sizeof(treeNode)
+					+ n * (sizeof(nPoint) + totalDepth * sizeof(double)) + 64);
+
+	vector<nPoint*> copies(n);
+	for (size_t i = 0; i < n; i++) {
+		double * cords = arena.makeCords(totalDepth);
+		memcpy(cords, points[i]->getCords(), totalDepth * sizeof(double));
+		copies[i] = arena.make<nPoint>(points[i]->getIndex(), totalDepth,
+				cords);
+	}
+
+	root = arena.make<treeNode>();
+	root->makeTree(copies.begin(), copies.end(), 0, totalDepth, axisMode,
+			&arena);
+	dims = totalDepth;
+	return root;
+}
+
+treeNode * arenaTree::readTree(const string fileName, const int k) {
+	clear();
 
 	ifstream myfile(fileName);
-	if (myfile.is_open()) {
-		string cell;
-		const char* ch;
-		double val;
+	if (!myfile.is_open()) {
+		cout << "Unable to open tree data file to rebuild tree from disk\n";
+		return nullptr;
+	}
 
-		while (getline(myfile, line)) { //get every point
+	std::string line;
+	while (getline(myfile, line)) { //should be just one line
+		stringstream lineStream(line);
+		root = arena.make<treeNode>();
+		root->recurIn(lineStream, 0, k, &arena);
+	}
+	myfile.close();
 
-			if (k == 0) { // first time determine width, initializes sums
-				k = countDims(fileName);
-			}
-			pCords = new double[k];
+	dims = k;
+	return root;
+}
 
-			stringstream lineStream(line);
+treeNode * arenaTree::getRoot() const {
+	return root;
+}
 
-			for (int i = 0; i < k; i++) {
-				if (i < k - 1)	//get every value except last, stop at comma
-					getline(lineStream, cell, ',');
-				else
-					getline(lineStream, cell);
+int arenaTree::getDims() const {
+	return dims;
+}
 
-				ch = cell.c_str();
-				val = atof(ch);
-				pCords[i] = val;
+size_t arenaTree::getBytes() const {
+	return arena.getBytes();
+}
+
+void arenaTree::clear() {
+	arena.clear();
+	root = nullptr;
+	dims = 0;
+}
+
+//nearHeap method definitions
+
+nearHeap::nearHeap(int capacity) :
+		capacity(0), size(0), ceiling(INFINITY) {
+	reset(capacity);
+}
+
+void nearHeap::reset(int capacity, double ceiling) {
+	this->capacity = capacity < 1 ? 1 : capacity;
+	this->ceiling = ceiling;
+	size = 0;
+	if ((int) distances.size() < this->capacity) {
+		distances.resize(this->capacity);
+		slots.resize(this->capacity);
+	}
+}
+
+int nearHeap::getSize() const {
+	return size;
+}
+
+int nearHeap::getCapacity() const {
+	return capacity;
+}
+
+double nearHeap::bound() const {
+	return size < capacity ? min(ceiling, DBL_MAX) : distances[0];
+}
+
+void nearHeap::offer(double distance, int slot) {
+	if (size < capacity) { //still filling, sift the new candidate up
+		if (distance > ceiling) {
+			return;
+		}
+		int i = size++;
+		while (i > 0) {
+			int parent = (i - 1) / 2;
+			if (distances[parent] >= distance) {
+				break;
 			}
+			distances[i] = distances[parent];
+			slots[i] = slots[parent];
+			i = parent;
+		}
+		distances[i] = distance;
+		slots[i] = slot;
+	} else if (distance < distances[0]) { //replace the worst candidate
+		distances[0] = distance;
+		slots[0] = slot;
+		siftDown(0);
+	}
+}
 
-			pointVector.push_back(new nPoint(rows, k, pCords));
-			rows++;
+void nearHeap::siftDown(int i) {
+	double distance = distances[i];
+	int slot = slots[i];
+	while (true) {
+		int child = 2 * i + 1;
+		if (child >= size) {
+			break;
+		}
+		if (child + 1 < size && distances[child + 1] > distances[child]) {
+			child++;
+		}
+		if (distances[child] <= distance) {
+			break;
 		}
+		distances[i] = distances[child];
+		slots[i] = slots[child];
+		i = child;
+	}
+	distances[i] = distance;
+	slots[i] = slot;
+}
 
-		myfile.close();
-		return k; //return number of dimensions
+//heap sort in place, repeatedly moving the worst candidate to the back
+void nearHeap::sortResults() {
+	int full = size;
+	while (size > 1) {
+		size--;
+		swap(distances[0], distances[size]);
+		swap(slots[0], slots[size]);
+		siftDown(0);
+	}
+	size = full;
+}
 
-	} else {
-		cout << "Unable to open points file\n";
-		return -1;
+void nearHeap::takeRoots() {
+	for (int i = 0; i < size; i++) {
+		distances[i] = sqrt(distances[i]);
 	}
 }
 
-//used to determine the dimension with largest range, used for tree building
-//returns int corresponding to dimension with largest range
-int findLargestRange(vector<nPoint*> const points, int const totalDepth) {
+int nearHeap::getSlot(int i) const {
+	return slots[i];
+}
 
-	double maxDif = 0;
-	double curDif = 0;
-	nPoint * big;
-	nPoint * small;
-	int retVal = -1;
+double nearHeap::getDistance(int i) const {
+	return distances[i];
+}
 
-	for (int i = 0; i < totalDepth; i++) {
+//flatTree method definitions
+
+flatTree::flatTree() :
+		dims(0), leafSize(1), taskCutoff(TASK_CUTOFF), partitionCutoff(
+				PARTITION_CUTOFF), boxesOn(false), axisMode(SPLIT_RANGE), precisionMode(
+				PRECISION_DOUBLE), precision(PRECISION_DOUBLE), exactMode(true), exact(false), copyError(
+				0), queryCurve(CURVE_NONE), packetSize(1), layoutCurve(
+				CURVE_NONE), updated(false), liveTotal(
+				0), usedSlots(0), nodeData(nullptr), cordData(nullptr), indexData(
+				nullptr), floatData(nullptr), quantData(nullptr), codeData(nullptr), boxData(
+				nullptr), nodeTotal(
+				0), pointTotal(0), mapping(nullptr), mappingSize(0) {
+}
 
-		big = *max_element(points.begin(), points.end(), Sort<nPoint *>(i));
-		small = *min_element(points.begin(), points.end(), Sort<nPoint *>(i));
-		curDif = (big->getAxisCord(i)) - (small->getAxisCord(i));
+flatTree::~flatTree() {
+	clear();
+}
 
-		if (curDif > maxDif) {
-			maxDif = curDif;
-			retVal = i;
+bool flatTree::isMapped() const {
+	return mapping != nullptr;
+}
+
+void flatTree::useOwned() {
+	nodeData = nodes.empty() ? nullptr : &nodes[0];
+	cordData = cords.empty() ? nullptr : &cords[0];
+	indexData = indices.empty() ? nullptr : &indices[0];
+	floatData = floatCords.empty() ? nullptr : &floatCords[0];
+	quantData = quantCords.empty() ? nullptr : &quantCords[0];
+	codeData = codes.empty() ? nullptr : &codes[0];
+	boxData = boxes.empty() ? nullptr : &boxes[0];
+	nodeTotal = nodes.size();
+	pointTotal = indices.size();
+}
+
+int flatTree::getDims() const {
+	return dims;
+}
+
+int flatTree::getLeafSize() const {
+	return leafSize;
+}
+
+int flatTree::getSize() const {
+	return updated ? liveTotal : pointTotal;
+}
+
+int flatTree::getNodeCount() const {
+	return nodeTotal;
+}
+
+const flatNode& flatTree::getNode(int n) const {
+	return nodeData[n];
+}
+
+int flatTree::getIndex(int slot) const {
+	return indexData[slot];
+}
+
+const double * flatTree::axisCords(int dim) const {
+	return cordData + (size_t) dim * pointTotal;
+}
+
+const double flatTree::getCord(int slot, int dim) const {
+	return cordData != nullptr ? axisCords(dim)[slot] : compactCord(dim, slot);
+}
+
+const double * flatTree::getCords() const {
+	return cordData;
+}
+
+const int * flatTree::getIndices() const {
+	return indexData;
+}
+
+//print out info about the point in a slot, same format as nPoint::print
+void flatTree::printPoint(int slot) const {
+	cout << "Point " << indexData[slot] << " at ";
+	for (int i = 0; i < dims; i++) {
+		cout << getCord(slot, i);
+		if (i < dims - 1)
+			cout << ",";
+	}
+}
+
+//get euclidian distance between a query and a stored point
+double flatTree::getAbDist(const double * query, int slot) const {
+	double sum = 0;
+	double dif = 0;
+
+	for (int dim = 0; dim < dims; dim++) { // every dim
+		dif = query[dim] - getCord(slot, dim);
+		sum += dif * dif;
+	}
+	return sqrt(sum);
+}
+
+void flatTree::setBoundingBoxes(bool on) {
+	boxesOn = on;
+}
+
+bool flatTree::hasBoxes() const {
+	return boxData != nullptr;
+}
+
+void flatTree::setPrecision(int precision) {
+	precisionMode = precision == PRECISION_FLOAT
+			|| precision == PRECISION_QUANT16 ? precision : PRECISION_DOUBLE;
+}
+
+int flatTree::getPrecision() const {
+	return precision;
+}
+
+void flatTree::setExactCords(bool on) {
+	exactMode = on;
+}
+
+size_t flatTree::getBytes() const {
+	size_t bytes = nodeTotal * sizeof(flatNode) + pointTotal * sizeof(int);
+	if (cordData != nullptr) {
+		bytes += pointTotal * dims * sizeof(double);
+	}
+	if (codeData != nullptr) {
+		bytes += 3 * dims * sizeof(double) + compactBytes();
+	}
+	if (boxData != nullptr) {
+		bytes += nodeTotal * 2 * dims * sizeof(float);
+	}
+	return bytes;
+}
+
+void flatTree::setQueryOrder(int curve) {
+	queryCurve = curve == CURVE_MORTON || curve == CURVE_HILBERT ?
+			curve : CURVE_NONE;
+}
+
+void flatTree::setPacketSize(int lanes) {
+	packetSize = max(1, min(lanes, PACKET_LANES));
+}
+
+void flatTree::setCurveLayout(int curve) {
+	layoutCurve = curve == CURVE_MORTON || curve == CURVE_HILBERT ?
+			curve : CURVE_NONE;
+}
+
+//boxes are stored as floats rounded away from the points so they still
+//contain every point, distances to them never overestimate
+//nearest float at or below v
+static float floatBelow(double v) {
+	float f = (float) v;
+	return f > v ? nextafterf(f, -INFINITY) : f;
+}
+
+//nearest float at or above v
+static float floatAbove(double v) {
+	float f = (float) v;
+	return f < v ? nextafterf(f, INFINITY) : f;
+}
+
+void flatTree::makeBoxes() {
+	boxes.resize(nodeTotal * 2 * (size_t) dims);
+	for (size_t node = nodeTotal; node-- > 0;) {
+		boxNode(node);
+	}
+	useOwned();
+}
+
+void flatTree::boxNode(int node) {
+	size_t width = 2 * (size_t) dims;
+	const flatNode& cur = nodeData[node];
+	float * lo = &boxes[node * width];
+	float * hi = lo + dims;
+	if (cur.count > 0) { //leaf, bound its points as searches measure them
+		for (int d = 0; d < dims; d++) {
+			double small = getCord(cur.child, d);
+			double big = small;
+			for (int i = 1; i < cur.count; i++) {
+				small = min(small, getCord(cur.child + i, d));
+				big = max(big, getCord(cur.child + i, d));
+			}
+			lo[d] = floatBelow(small);
+			hi[d] = floatAbove(big);
+		}
+	} else { //union of the children
+		const float * left = &boxes[cur.child * width];
+		const float * right = left + width;
+		for (int d = 0; d < dims; d++) {
+			lo[d] = min(left[d], right[d]);
+			hi[d] = max(left[dims + d], right[dims + d]);
 		}
 	}
-	return retVal;
 }
 
+double flatTree::boxSquare(const double * query, int node) const {
+	const float * lo = boxData + (size_t) node * 2 * dims;
+	const float * hi = lo + dims;
+	double sum = 0;
+	for (int d = 0; d < dims; d++) {
+		double dif = lo[d] - query[d];
+		if (dif <= 0) {
+			dif = query[d] - hi[d];
+			if (dif < 0) {
+				dif = 0;
+			}
+		}
+		sum += dif * dif;
+	}
+	return sum;
+}
+
+//the copy is checked against the doubles it was made from, every axis keeps
+//the largest error of any point so bounds from the copy are never too small
+void flatTree::makeCompact() {
+	vector<float>().swap(floatCords);
+	vector<uint16_t>().swap(quantCords);
+	vector<double>().swap(codes);
+	copyError = 0;
+	useOwned();
+	if (precision == PRECISION_DOUBLE || pointTotal == 0) {
+		return;
+	}
+
+	size_t n = pointTotal;
+	codes.assign(3 * (size_t) dims, 0);
+	double * scale = &codes[0];
+	double * offset = scale + dims;
+	double * error = offset + dims;
+	if (precision == PRECISION_FLOAT) {
+		floatCords.resize(n * dims);
+	} else {
+		quantCords.resize(n * dims);
+	}
+
+	for (int d = 0; d < dims; d++) {
+		const double * axis = axisCords(d);
+		if (precision == PRECISION_FLOAT) {
+			scale[d] = 1;
+		} else { //65536 steps across the range of the axis
+			double small = axis[0];
+			double big = axis[0];
+			for (size_t s = 1; s < n; s++) {
+				small = min(small, axis[s]);
+				big = max(big, axis[s]);
+			}
+			scale[d] = big / 65535 - small / 65535;
+			if (!(scale[d] > 0) || !isfinite(scale[d])) {
+				scale[d] = 1;
+			}
+			offset[d] = small;
+		}
+		double worst = 0;
+		for (size_t s = 0; s < n; s++) {
+			size_t at = (size_t) d * n + s;
+			if (precision == PRECISION_FLOAT) {
+				floatCords[at] = compactValue(d, axis[s]);
+			} else {
+				double step = nearbyint((axis[s] - offset[d]) / scale[d]);
+				quantCords[at] = step > 0 ? (step < 65535 ? step : 65535) : 0;
+			}
+			worst = max(worst, fabs(axis[s] - compactValue(d, axis[s])));
+		}
+		error[d] = worst * (1 + PRECISION_SLACK);
+		copyError += error[d] * error[d];
+	}
+	copyError = sqrt(copyError) * (1 + PRECISION_SLACK);
+
+	//rounding is monotone, so split values rounded like the points still
+	//have every point of the left child at or below them and every point of
+	//the right child at or above
+	if (!exact) {
+		for (flatNode& node : nodes) {
+			node.val = compactValue(node.axis, node.val);
+		}
+		vector<double>().swap(cords);
+	}
+	useOwned();
+}
+
+double flatTree::compactValue(int dim, double value) const {
+	if (precision == PRECISION_FLOAT) {
+		return (float) max(-(double) FLT_MAX, min((double) FLT_MAX, value));
+	}
+	const double * code = codes.empty() ? codeData : &codes[0];
+	double step = nearbyint((value - code[dims + dim]) / code[dim]);
+	step = step > 0 ? (step < 65535 ? step : 65535) : 0;
+	return code[dims + dim] + (uint16_t) step * code[dim];
+}
+
+double flatTree::compactCord(int dim, int slot) const {
+	size_t at = (size_t) dim * pointTotal + slot;
+	return floatData != nullptr ?
+			floatData[at] : codeData[dims + dim] + quantData[at] * codeData[dim];
+}
+
+size_t flatTree::compactBytes() const {
+	if (precision == PRECISION_FLOAT) {
+		return pointTotal * dims * sizeof(float);
+	}
+	if (precision == PRECISION_QUANT16) {
+		return pointTotal * dims * sizeof(uint16_t);
+	}
+	return 0;
+}
+
+void flatTree::compactSquares(const double * query, int first, int count,
+		double * out) const {
+	for (int i = 0; i < count; i++) {
+		out[i] = 0;
+	}
+	for (int d = 0; d < dims; d++) {
+		size_t at = (size_t) d * pointTotal + first;
+		double q = query[d];
+		if (floatData != nullptr) {
+			const float * axis = floatData + at;
+			for (int i = 0; i < count; i++) {
+				double dif = q - axis[i];
+				out[i] += dif * dif;
+			}
+		} else {
+			const uint16_t * axis = quantData + at;
+			double scale = codeData[d];
+			double offset = codeData[dims + d];
+			for (int i = 0; i < count; i++) {
+				double dif = q - (offset + axis[i] * scale);
+				out[i] += dif * dif;
+			}
+		}
+	}
+}
+
+//a point the copy puts at distance c is truly within c + copyError, and
+//PRECISION_SLACK covers the rounding of both sums
+double flatTree::settleSquare(double square) const {
+	double reach = (sqrt(square) + copyError) * (1 + PRECISION_SLACK);
+	return reach * reach;
+}
+
+void flatTree::clear() {
+	dims = 0;
+	leafSize = 1;
+	vector<flatNode>().swap(nodes);
+	vector<double>().swap(cords);
+	vector<int>().swap(indices);
+	vector<float>().swap(boxes);
+	vector<float>().swap(floatCords);
+	vector<uint16_t>().swap(quantCords);
+	vector<double>().swap(codes);
+	precision = PRECISION_DOUBLE;
+	exact = false;
+	copyError = 0;
+	vector<int>().swap(parents);
+	vector<int>().swap(weights);
+	vector<int>().swap(deadWeights);
+	vector<int>().swap(slotLeaf);
+	unordered_map<int, int>().swap(slotOf);
+	axisMode = SPLIT_RANGE;
+	updated = false;
+	liveTotal = 0;
+	usedSlots = 0;
+	if (mapping != nullptr) {
+		munmap(mapping, mappingSize);
+		mapping = nullptr;
+		mappingSize = 0;
+	}
+	useOwned();
+}
+
+//builds the tree from nPoints, coordinates are gathered into one row-major
+//block first so the build never chases pointers
+flatTree * flatTree::makeTree(vector<nPoint*> const & points,
+		int const totalDepth, int axisMode, int leafSize, taskPool * pool) {
+
+	int n = points.size();
+	vector<double> work((size_t) n * totalDepth);
+	vector<int> ids(n);
+	for (int i = 0; i < n; i++) {
+		memcpy(&work[(size_t) i * totalDepth], points[i]->getCords(),
+				totalDepth * sizeof(double));
+		ids[i] = points[i]->getIndex();
+	}
+	return build(n ? &work[0] : nullptr, n ? &ids[0] : nullptr, n, totalDepth,
+			axisMode, leafSize, pool);
+}
+
+//builds the tree straight from the block without copying the coordinates
+flatTree * flatTree::makeTree(const pointBlock& block, int axisMode,
+		int leafSize, taskPool * pool) {
+	return build(block.getSize() ? block.getPoint(0) : nullptr, nullptr,
+			block.getSize(), block.getDims(), axisMode, leafSize, pool);
+}
+
+flatTree * flatTree::makeTree(const double * rows, const int * ids,
+		int count, int k, int axisMode, int leafSize, taskPool * pool) {
+	return build(rows, ids, count, k, axisMode, leafSize, pool);
+}
+
+//builds the tree by partitioning one shared order array in place, below the
+//partition cutoff splits are chosen exactly as in treeNode::makeTree so both
+//layouts give the same tree
+flatTree * flatTree::build(const double * work, const int * ids, int n,
+		int const totalDepth, int axisMode, int leafSize, taskPool * pool) {
+
+	clear();
+
+	if (n < 1) {
+		cout << "ERROR, LIST OF POINTS TOO SMALL" << endl;
+		return nullptr;
+	}
+	if (leafSize < 1 || leafSize > MAX_LEAF_SIZE) {
+		cout << "ERROR, LEAF SIZE MUST BE BETWEEN 1 AND " << MAX_LEAF_SIZE
+				<< endl;
+		return nullptr;
+	}
+
+	dims = totalDepth;
+	this->leafSize = leafSize;
+
+	vector<int> order(n);
+	for (int i = 0; i < n; i++) {
+		order[i] = i;
+	}
+	vector<int> scratch(n >= partitionCutoff ? n : 0);
+
+	nodes.resize(2 * (size_t) n - 1); //at most n leaves, so at most 2n - 1 nodes
+
+	buildState state;
+	state.base = &order[0];
+	state.scratch = scratch.empty() ? nullptr : &scratch[0];
+	state.work = work;
+	state.totalDepth = totalDepth;
+	//values without a strategy of their own keep the old meaning of range
+	this->axisMode = axisMode >= SPLIT_ROTATE && axisMode <= SPLIT_COST ?
+			axisMode : SPLIT_RANGE;
+	state.axisMode = this->axisMode;
+	state.pool = pool;
+	state.group = nullptr;
+	state.nextNode = 1;
+
+	if (pool == nullptr) {
+		buildRecur(&order[0], &order[0] + n, 0, 0, 0, state);
+	} else {
+		taskGroup group;
+		state.group = &group;
+		buildRecur(&order[0], &order[0] + n, 0, 0, 0, state);
+		pool->wait(group);
+	}
+	nodes.resize(state.nextNode);
+	if (pool != nullptr) { //tasks allocate nodes in whatever order they run
+		renumber();
+	}
+
+	//lay coordinates out in leaf order, one array per axis
+	cords.resize((size_t) n * dims);
+	indices.resize(n);
+	for (int s = 0; s < n; s++) {
+		for (int d = 0; d < dims; d++) {
+			cords[(size_t) d * n + s] = work[(size_t) order[s] * dims + d];
+		}
+		indices[s] = ids ? ids[order[s]] : order[s];
+	}
+	useOwned();
+	if (layoutCurve != CURVE_NONE) {
+		curveLayout();
+	}
+	precision = precisionMode;
+	exact = exactMode;
+	makeCompact();
+	if (boxesOn) {
+		makeBoxes();
+	}
+
+	return this;
+}
+
+void flatTree::setBuildCutoffs(int taskCut, int partitionCut) {
+	taskCutoff = taskCut < 2 ? 2 : taskCut;
+	partitionCutoff = partitionCut < 2 ? 2 : partitionCut;
+}
+
+//recursively partitions [first, last) and fills in node, no heap allocation
+//per level below the partition cutoff. in parallel builds the right half of
+//every range above the task cutoff becomes a task of its own
+void flatTree::buildRecur(int * first, int * last, int dIndex, int level,
+		int node, buildState& state) {
+
+	int size = last - first;
+	int curDepth;
+	const double * work = state.work;
+
+	if (size <= leafSize) { //create leaf
+		curDepth = dIndex > 0 ? dIndex - 1 : 0;
+
+		nodes[node].axis = curDepth;
+		nodes[node].val = work[(size_t) *first * dims + curDepth];
+		nodes[node].child = first - state.base;
+		nodes[node].count = size;
+		return;
+	}
+
+	int middle = (size == 2) ? 0 : size / 2;
+	int leftCount;
+
+	if (state.axisMode == SPLIT_ROTATE) { //simple rotation
+		curDepth = dIndex % state.totalDepth;
+	} else if (state.axisMode == SPLIT_RANGE || level >= SPLIT_LEVELS) { //by range
+		curDepth = rangeAxis(first, last, state);
+		if (curDepth < 0) { //every point identical, any axis will do
+			curDepth = dIndex % state.totalDepth;
+		}
+	} else if (chooseSplit(first, last, state.axisMode, state, curDepth,
+			leftCount)) {
+		middle = leftCount - 1; //left holds the leftCount smallest values
+	} else { //every point identical, any axis will do
+		curDepth = dIndex % state.totalDepth;
+	}
+
+	if (size >= partitionCutoff) {
+		splitRange(first, last, middle, curDepth, state);
+	} else {
+		nth_element(first, first + middle, last,
+				[work, this, curDepth](int a, int b) {
+					return work[(size_t) a * dims + curDepth] < work[(size_t) b * dims + curDepth];
+				}); //get median value, sort all less points to left and greater to right
+	}
+
+	int left = state.nextNode.fetch_add(2);
+
+	nodes[node].axis = curDepth;
+	nodes[node].val = work[(size_t) first[middle] * dims + curDepth];
+	nodes[node].child = left;
+	nodes[node].count = 0;
+
+	int * split = first + middle + 1;
+	if (state.pool != nullptr && size >= taskCutoff) {
+		state.pool->spawn(*state.group, [this, split, last, curDepth, level, left, &state] {
+			buildRecur(split, last, curDepth + 1, level + 1, left + 1, state);
+		});
+		buildRecur(first, split, curDepth + 1, level + 1, left, state);
+	} else {
+		buildRecur(first, split, curDepth + 1, level + 1, left, state);
+		buildRecur(split, last, curDepth + 1, level + 1, left + 1, state);
+	}
+}
+
+//min, max and variance of every axis in one pass over the range, then the
+//strategy picks the axis and where the plane goes. the left side always gets
+//the leftCount smallest values, so searches still see left <= val <= right
+bool flatTree::chooseSplit(const int * first, const int * last, int axisMode,
+		buildState& state, int& axis, int& leftCount) const {
+
+	int size = last - first;
+	int k = state.totalDepth;
+	const double * work = state.work;
+
+	//low, high, mean and spread of every axis, on the stack for the usual
+	//dimensions since this runs once per internal node
+	double stackBounds[4 * BOUNDS_STACK_DIMS];
+	vector<double> heapBounds;
+	double * low = stackBounds;
+	if (k > BOUNDS_STACK_DIMS) {
+		heapBounds.resize(4 * (size_t) k);
+		low = &heapBounds[0];
+	}
+	double * high = low + k;
+
+	if (axisMode == SPLIT_VARIANCE) { //min, max and variance in one pass
+		double * mean = high + k;
+		double * spread = mean + k; //sum of squared differences from the mean
+		for (int d = 0; d < k; d++) {
+			low[d] = high[d] = work[(size_t) *first * k + d];
+			mean[d] = 0;
+			spread[d] = 0;
+		}
+		int seen = 0;
+		for (const int * p = first; p < last; p++) {
+			const double * cord = work + (size_t) *p * k;
+			seen++;
+			for (int d = 0; d < k; d++) {
+				low[d] = cord[d] < low[d] ? cord[d] : low[d];
+				high[d] = cord[d] > high[d] ? cord[d] : high[d];
+				double delta = cord[d] - mean[d]; //Welford update
+				mean[d] += delta / seen;
+				spread[d] += delta * (cord[d] - mean[d]);
+			}
+		}
+		axis = -1;
+		double best = 0;
+		for (int d = 0; d < k; d++) {
+			if (spread[d] > best) {
+				best = spread[d];
+				axis = d;
+			}
+		}
+		leftCount = (size == 2 ? 0 : size / 2) + 1;
+		return axis >= 0;
+	}
+
+	axisBounds(first, last, work, k, low, high);
+	axis = widestAxis(low, high, k);
+	if (axis < 0) {
+		return false;
+	}
+
+	if (axisMode == SPLIT_MIDPOINT) {
+		double mid = low[axis] + (high[axis] - low[axis]) / 2;
+		leftCount = 0;
+		for (const int * p = first; p < last; p++) {
+			leftCount += work[(size_t) *p * k + axis] < mid;
+		}
+		leftCount = max(1, min(size - 1, leftCount)); //slide onto a point
+		return true;
+	}
+
+	//cost model: a query reaches a child about in proportion to its extent
+	//widened by the typical gap between points, and then pays for its points.
+	//only the split axis changes the children's extent, so the cost of a plane
+	//is (left * (leftExtent + gap) + right * (rightExtent + gap)) / (extent + gap)
+	double gap = 0;
+	for (int d = 0; d < k; d++) {
+		gap += high[d] - low[d];
+	}
+	gap /= k * pow((double) size, 1.0 / k);
+
+	double bestCost = DBL_MAX;
+	int counts[SPLIT_BINS];
+	double binLow[SPLIT_BINS];
+	double binHigh[SPLIT_BINS];
+	for (int d = 0; d < k; d++) {
+		double extent = high[d] - low[d];
+		if (extent <= 0) {
+			continue;
+		}
+		for (int b = 0; b < SPLIT_BINS; b++) {
+			counts[b] = 0;
+			binLow[b] = DBL_MAX;
+			binHigh[b] = -DBL_MAX;
+		}
+		double scale = SPLIT_BINS / extent;
+		for (const int * p = first; p < last; p++) {
+			double v = work[(size_t) *p * k + d];
+			int b = min(SPLIT_BINS - 1, (int) ((v - low[d]) * scale));
+			counts[b]++;
+			binLow[b] = min(binLow[b], v);
+			binHigh[b] = max(binHigh[b], v);
+		}
+
+		//planes between bins, the left side is everything in bins 0 to b
+		int left = 0;
+		double leftHigh = low[d];
+		for (int b = 0; b < SPLIT_BINS - 1; b++) {
+			left += counts[b];
+			if (counts[b] > 0) {
+				leftHigh = binHigh[b];
+			}
+			if (left == 0 || left == size) {
+				continue;
+			}
+			double rightLow = high[d];
+			for (int r = b + 1; r < SPLIT_BINS; r++) {
+				if (counts[r] > 0) {
+					rightLow = binLow[r];
+					break;
+				}
+			}
+			double cost = (left * (leftHigh - low[d] + gap)
+					+ (size - left) * (high[d] - rightLow + gap)) / (extent + gap);
+			if (cost < bestCost) {
+				bestCost = cost;
+				axis = d;
+				leftCount = left;
+			}
+		}
+	}
+	return bestCost < DBL_MAX;
+}
+
+//run body for chunks 0 to count - 1, across the pool if there is one
+static void forChunks(taskPool * pool, int count, function<void(int)> body) {
+	if (pool == nullptr || count == 1) {
+		for (int c = 0; c < count; c++) {
+			body(c);
+		}
+	} else {
+		pool->parallelFor(count, count, [&body](size_t begin, size_t end) {
+			for (size_t c = begin; c < end; c++) {
+				body(c);
+			}
+		});
+	}
+}
+
+//number of chunks to split a large range into
+static int chunkCount(taskPool * pool, size_t size) {
+	if (pool == nullptr) {
+		return 1;
+	}
+	return (int) min((size_t) pool->getThreads() * 4, size / 4096 + 1);
+}
+
+int flatTree::rangeAxis(int * first, int * last, buildState& state) const {
+	size_t size = last - first;
+	if (state.pool == nullptr || (int) size < partitionCutoff) {
+		return findLargestRange(first, last, state.work, state.totalDepth);
+	}
+
+	//min and max per chunk, then combined, both are exact so the result is
+	//the same as the sequential scan
+	int chunks = chunkCount(state.pool, size);
+	int k = state.totalDepth;
+	vector<double> lows((size_t) chunks * k);
+	vector<double> highs((size_t) chunks * k);
+	const double * work = state.work;
+	forChunks(state.pool, chunks, [&](int c) {
+		axisBounds(first + size * c / chunks, first + size * (c + 1) / chunks,
+				work, k, &lows[(size_t) c * k], &highs[(size_t) c * k]);
+	});
+
+	for (int c = 1; c < chunks; c++) { //fold into the first chunk
+		for (int d = 0; d < k; d++) {
+			lows[d] = min(lows[d], lows[(size_t) c * k + d]);
+			highs[d] = max(highs[d], highs[(size_t) c * k + d]);
+		}
+	}
+	return widestAxis(&lows[0], &highs[0], k);
+}
+
+//partitions [first, last) into values below, equal to and above the middle-th
+//value while keeping the relative order inside each group, so the outcome does
+//not depend on how many chunks or threads did the work
+void flatTree::splitRange(int * first, int * last, int middle, int axis,
+		buildState& state) const {
+
+	size_t size = last - first;
+	const double * work = state.work;
+	int k = dims;
+	int chunks = chunkCount(state.pool, size);
+
+	//find the middle-th value on a copy of the keys
+	vector<double> keys(size);
+	forChunks(state.pool, chunks, [&](int c) {
+		for (size_t i = size * c / chunks; i < size * (c + 1) / chunks; i++) {
+			keys[i] = work[(size_t) first[i] * k + axis];
+		}
+	});
+	nth_element(keys.begin(), keys.begin() + middle, keys.end());
+	double pivot = keys[middle];
+
+	//count each group per chunk
+	vector<size_t> less(chunks, 0);
+	vector<size_t> equal(chunks, 0);
+	forChunks(state.pool, chunks, [&](int c) {
+		for (size_t i = size * c / chunks; i < size * (c + 1) / chunks; i++) {
+			double v = work[(size_t) first[i] * k + axis];
+			if (v < pivot)
+				less[c]++;
+			else if (v == pivot)
+				equal[c]++;
+		}
+	});
+
+	//where every chunk starts writing each group
+	vector<size_t> lessAt(chunks);
+	vector<size_t> equalAt(chunks);
+	vector<size_t> greaterAt(chunks);
+	size_t totalLess = 0;
+	size_t totalEqual = 0;
+	for (int c = 0; c < chunks; c++) {
+		totalLess += less[c];
+		totalEqual += equal[c];
+	}
+	size_t l = 0;
+	size_t e = totalLess;
+	size_t g = totalLess + totalEqual;
+	for (int c = 0; c < chunks; c++) {
+		size_t chunkSize = size * (c + 1) / chunks - size * c / chunks;
+		lessAt[c] = l;
+		equalAt[c] = e;
+		greaterAt[c] = g;
+		l += less[c];
+		e += equal[c];
+		g += chunkSize - less[c] - equal[c];
+	}
+
+	int * out = state.scratch + (first - state.base);
+	forChunks(state.pool, chunks, [&](int c) {
+		size_t lAt = lessAt[c];
+		size_t eAt = equalAt[c];
+		size_t gAt = greaterAt[c];
+		for (size_t i = size * c / chunks; i < size * (c + 1) / chunks; i++) {
+			double v = work[(size_t) first[i] * k + axis];
+			if (v < pivot)
+				out[lAt++] = first[i];
+			else if (v == pivot)
+				out[eAt++] = first[i];
+			else
+				out[gAt++] = first[i];
+		}
+	});
+	forChunks(state.pool, chunks, [&](int c) {
+		size_t begin = size * c / chunks;
+		size_t end = size * (c + 1) / chunks;
+		memcpy(first + begin, out + begin, (end - begin) * sizeof(int));
+	});
+}
+
+//depth first pass that gives every pair of children the position the
+//sequential build would have given it
+void flatTree::renumber() {
+	vector<flatNode> sorted(nodes.size());
+	vector<pair<int, int> > stack; //old position, new position
+	stack.push_back(make_pair(0, 0));
+	int next = 1;
+
+	while (!stack.empty()) {
+		int from = stack.back().first;
+		int to = stack.back().second;
+		stack.pop_back();
+
+		sorted[to] = nodes[from];
+		if (nodes[from].count == 0) {
+			sorted[to].child = next;
+			stack.push_back(make_pair(nodes[from].child + 1, next + 1));
+			stack.push_back(make_pair(nodes[from].child, next));
+			next += 2;
+		}
+	}
+	nodes.swap(sorted);
+}
+
+//every leaf gets the curve key of the middle of its points, every internal
+//node the smallest key below it
+void flatTree::curveLayout() {
+	size_t n = pointTotal;
+	vector<double> low(dims);
+	vector<double> high(dims);
+	for (int d = 0; d < dims; d++) {
+		const double * axis = axisCords(d);
+		low[d] = high[d] = axis[0];
+		for (size_t s = 1; s < n; s++) {
+			low[d] = min(low[d], axis[s]);
+			high[d] = max(high[d], axis[s]);
+		}
+	}
+
+	vector<uint64_t> keys(nodes.size());
+	vector<double> middle(dims);
+	for (size_t node = nodes.size(); node-- > 0;) { //children follow their parent
+		const flatNode& cur = nodes[node];
+		if (cur.count > 0) {
+			for (int d = 0; d < dims; d++) {
+				const double * axis = axisCords(d) + cur.child;
+				double sum = 0;
+				for (int i = 0; i < cur.count; i++) {
+					sum += axis[i];
+				}
+				middle[d] = sum / cur.count;
+			}
+			keys[node] = curveKey(&middle[0], &low[0], &high[0], dims,
+					layoutCurve);
+		} else {
+			keys[node] = min(keys[cur.child], keys[cur.child + 1]);
+		}
+	}
+
+	vector<flatNode> sorted(nodes.size());
+	vector<double> moved(cords.size());
+	vector<int> movedIndices(n);
+	vector<pair<int, int> > stack; //old position, new position
+	stack.push_back(make_pair(0, 0));
+	int next = 1;
+	int nextSlot = 0;
+
+	while (!stack.empty()) {
+		int from = stack.back().first;
+		int to = stack.back().second;
+		stack.pop_back();
+
+		sorted[to] = nodes[from];
+		const flatNode& cur = nodes[from];
+		if (cur.count == 0) {
+			sorted[to].child = next;
+			bool leftFirst = keys[cur.child] <= keys[cur.child + 1];
+			if (leftFirst) {
+				stack.push_back(make_pair(cur.child + 1, next + 1));
+				stack.push_back(make_pair(cur.child, next));
+			} else {
+				stack.push_back(make_pair(cur.child, next));
+				stack.push_back(make_pair(cur.child + 1, next + 1));
+			}
+			next += 2;
+		} else {
+			sorted[to].child = nextSlot;
+			for (int i = 0; i < cur.count; i++) {
+				for (int d = 0; d < dims; d++) {
+					moved[(size_t) d * n + nextSlot + i] = getCord(cur.child + i, d);
+				}
+				movedIndices[nextSlot + i] = indices[cur.child + i];
+			}
+			nextSlot += cur.count;
+		}
+	}
+	nodes.swap(sorted);
+	cords.swap(moved);
+	indices.swap(movedIndices);
+	useOwned();
+}
+
+//find nearest neighbor, visiting nodes in the same order as nPoint::findNear
+void flatTree::findNear(const double * query, int& bestSlot,
+		double& bestDistance, double eps, int maxLeaves) const {
+	if (nodeTotal > 0) {
+		int start = bestSlot;
+		double bestSquare = bestDistance * bestDistance;
+		nearSearch(query, bestSlot, bestSquare, (1 + eps) * (1 + eps),
+				maxLeaves > 0 ? maxLeaves : INT_MAX, nullptr);
+		if (bestSlot != start) {
+			bestDistance = sqrt(bestSquare);
+		}
+	}
+}
+
+void flatTree::findNear(const double * query, int& bestSlot,
+		double& bestDistance, searchStats& stats, double eps,
+		int maxLeaves) const {
+	if (nodeTotal > 0) {
+		int start = bestSlot;
+		double bestSquare = bestDistance * bestDistance;
+		nearSearch(query, bestSlot, bestSquare, (1 + eps) * (1 + eps),
+				maxLeaves > 0 ? maxLeaves : INT_MAX, &stats);
+		if (bestSlot != start) {
+			bestDistance = sqrt(bestSquare);
+		}
+	}
+}
+
+void flatTree::findNearSquared(const double * query, int& bestSlot,
+		double& bestSquare) const {
+	if (nodeTotal > 0) {
+		nearSearch(query, bestSlot, bestSquare, 1, INT_MAX, nullptr);
+	}
+}
+
+void flatTree::nearSearch(const double * query, int& bestSlot,
+		double& bestSquare, double scale, int maxLeaves,
+		searchStats * stats) const {
+	if (codeData == nullptr || cordData == nullptr) { //one walk is exact
+		nearIter(query, bestSlot, bestSquare, scale, maxLeaves, stats, false);
+		return;
+	}
+
+	int slot = -1;
+	double square = settleSquare(bestSquare);
+	nearIter(query, slot, square, scale, maxLeaves, stats, false);
+	if (slot < 0) { //nothing the copy puts near enough
+		return;
+	}
+	if (scale > 1 || maxLeaves < INT_MAX) {
+		leafSquares(query, cordData + slot, pointTotal, 1, dims, bestSquare,
+				&square);
+		if (square < bestSquare) {
+			bestSquare = square;
+			bestSlot = slot;
+		}
+		return;
+	}
+
+	//the point found is truly within settleSquare, so the nearest is too
+	double cap = min(bestSquare, nextafter(settleSquare(square), DBL_MAX));
+	slot = -1;
+	nearIter(query, slot, cap, 1, INT_MAX, stats, true);
+	if (slot >= 0) {
+		bestSquare = cap;
+		bestSlot = slot;
+	}
+}
+
+void flatTree::findNearRecursive(const double * query, int& bestSlot,
+		double& bestDistance) const {
+	if (nodeTotal > 0) {
+		int start = bestSlot;
+		double bestSquare = bestDistance * bestDistance;
+		if (codeData == nullptr || cordData == nullptr) {
+			nearRecur(query, 0, bestSlot, bestSquare, false);
+		} else { //the two walks of nearSearch
+			int slot = -1;
+			double square = settleSquare(bestSquare);
+			nearRecur(query, 0, slot, square, false);
+			if (slot >= 0) {
+				double cap = min(bestSquare,
+						nextafter(settleSquare(square), DBL_MAX));
+				slot = -1;
+				nearRecur(query, 0, slot, cap, true);
+				if (slot >= 0) {
+					bestSquare = cap;
+					bestSlot = slot;
+				}
+			}
+		}
+		if (bestSlot != start) {
+			bestDistance = sqrt(bestSquare);
+		}
+	}
+}
+
+//k nearest neighbors, same traversal as findNear with the heap bound as the
+//current best squared distance. with the doubles kept the copy caps the
+//distance of the k-th as in nearSearch, points at exactly the same distance
+//as the k-th may then be another of them than a double tree returns
+void flatTree::findKNear(const double * query, nearHeap& heap) const {
+	heap.reset(heap.getCapacity());
+	if (nodeTotal > 0) {
+		kNearIter(query, heap, false);
+		if (codeData != nullptr && cordData != nullptr) {
+			heap.reset(heap.getCapacity(),
+					heap.getSize() < heap.getCapacity() ?
+							INFINITY :
+							nextafter(settleSquare(heap.bound()), DBL_MAX));
+			kNearIter(query, heap, true);
+		}
+	}
+	heap.sortResults();
+	heap.takeRoots();
+}
+
+void flatTree::findKNearRecursive(const double * query, nearHeap& heap) const {
+	heap.reset(heap.getCapacity());
+	if (nodeTotal > 0) {
+		kNearRecur(query, 0, heap, false);
+		if (codeData != nullptr && cordData != nullptr) {
+			heap.reset(heap.getCapacity(),
+					heap.getSize() < heap.getCapacity() ?
+							INFINITY :
+							nextafter(settleSquare(heap.bound()), DBL_MAX));
+			kNearRecur(query, 0, heap, true);
+		}
+	}
+	heap.sortResults();
+	heap.takeRoots();
+}
+
+void flatTree::kNearRecur(const double * query, int node, nearHeap& heap,
+		bool settle) const {
+
+	const flatNode& cur = nodeData[node];
+
+	if (cur.count > 0) { //found leaf
+		scanLeaf(query, cur, heap, settle);
+		return;
+	}
+
+	double offset = query[cur.axis] - cur.val;
+	if (offset <= 0) { //left first
+		kNearRecur(query, cur.child, heap, settle);
+		if (offset * offset < heap.bound()) {
+			kNearRecur(query, cur.child + 1, heap, settle);
+		}
+	} else { //right first
+		kNearRecur(query, cur.child + 1, heap, settle);
+		if (offset * offset <= heap.bound()) {
+			kNearRecur(query, cur.child, heap, settle);
+		}
+	}
+}
+
+//batch k nearest neighbors, every chunk reuses one heap for all of its queries
+void flatTree::findKNearBatch(const double * queries, int count, int kNear,
+		int * bestSlots, double * bestDistances, taskPool * pool) const {
+
+	vector<int> order;
+	if (queryCurve != CURVE_NONE && count > 1) {
+		curveOrder(queries, count, dims, queryCurve, order);
+	}
+	const int * at = order.empty() ? nullptr : &order[0];
+
+	auto search = [this, queries, kNear, bestSlots, bestDistances, at](
+			size_t begin, size_t end) {
+		nearHeap heap(kNear);
+		for (size_t next = begin; next < end; next++) {
+			size_t i = at ? at[next] : next;
+			findKNear(queries + i * dims, heap);
+			for (int j = 0; j < kNear; j++) {
+				bool found = j < heap.getSize();
+				bestSlots[i * kNear + j] = found ? heap.getSlot(j) : -1;
+				bestDistances[i * kNear + j] =
+						found ? heap.getDistance(j) : DBL_MAX;
+			}
+		}
+	};
+
+	if (pool == nullptr || pool->getThreads() == 1) {
+		search(0, count);
+	} else {
+		pool->parallelFor(count, (count + QUERY_CHUNK - 1) / QUERY_CHUNK, search);
+	}
+}
+
+//batch search, chunks are small enough to balance uneven query costs
+void flatTree::findNearBatch(const double * queries, int count,
+		int * bestSlots, double * bestDistances, taskPool * pool, double eps,
+		int maxLeaves) const {
+
+	vector<int> order;
+	if (queryCurve != CURVE_NONE && count > 1) {
+		curveOrder(queries, count, dims, queryCurve, order);
+	}
+	const int * at = order.empty() ? nullptr : &order[0];
+
+	auto search = [this, queries, bestSlots, bestDistances, eps, maxLeaves, at](
+			size_t begin, size_t end) {
+		for (size_t next = begin; next < end; next++) {
+			size_t i = at ? at[next] : next;
+			bestSlots[i] = -1;
+			bestDistances[i] = DBL_MAX;
+			findNear(queries + i * dims, bestSlots[i], bestDistances[i], eps,
+					maxLeaves);
+		}
+	};
+
+	//packets take the queries in the order they are searched, so
+	//neighbors in the batch or on the curve walk together
+	auto packets = [this, queries, bestSlots, bestDistances, at](
+			size_t begin, size_t end) {
+		vector<double> cords((size_t) dims * PACKET_LANES);
+		const double * lanes[PACKET_LANES];
+		int slots[PACKET_LANES];
+		double squares[PACKET_LANES];
+		for (size_t first = begin; first < end; first += packetSize) {
+			int count = (int) min((size_t) packetSize, end - first);
+			for (int l = 0; l < PACKET_LANES; l++) {
+				//unused lanes repeat the first query and are never read
+				size_t i = at ? at[first + (l < count ? l : 0)] :
+						first + (l < count ? l : 0);
+				lanes[l] = queries + i * dims;
+				for (int d = 0; d < dims; d++) {
+					cords[(size_t) d * PACKET_LANES + l] = lanes[l][d];
+				}
+				slots[l] = -1;
+				squares[l] = DBL_MAX * DBL_MAX;
+			}
+			uint32_t ties = 0;
+			nearPacket(lanes, &cords[0], count, slots, squares, ties);
+			for (int l = 0; l < count; l++) {
+				size_t i = at ? at[first + l] : first + l;
+				bestSlots[i] = -1;
+				bestDistances[i] = DBL_MAX;
+				if (ties & (1u << l)) {
+					findNear(lanes[l], bestSlots[i], bestDistances[i]);
+				} else if (slots[l] >= 0) {
+					bestSlots[i] = slots[l];
+					bestDistances[i] = sqrt(squares[l]);
+				}
+			}
+		}
+	};
+	if (packetSize > 1 && eps == 0 && maxLeaves <= 0 && nodeTotal > 0
+			&& codeData == nullptr) {
+		if (pool == nullptr || pool->getThreads() == 1) {
+			packets(0, count);
+		} else {
+			//chunks hold whole packets
+			size_t chunk = (QUERY_CHUNK + packetSize - 1) / packetSize
+					* packetSize;
+			pool->parallelFor(count, (count + chunk - 1) / chunk, packets);
+		}
+		return;
+	}
+
+	if (pool == nullptr || pool->getThreads() == 1) {
+		search(0, count);
+	} else {
+		pool->parallelFor(count, (count + QUERY_CHUNK - 1) / QUERY_CHUNK, search);
+	}
+}
+
+//distances for a whole leaf are computed at once, then checked in slot order.
+//settling measures on the doubles only the points the copy puts within
+//settleSquare of the best, one by one
+void flatTree::scanLeaf(const double * query, const flatNode& leaf,
+		int& bestSlot, double& bestSquare, bool settle) const {
+
+	const int chunk = 64;
+	double dist[chunk];
+	size_t stride = pointTotal;
+
+	for (int done = 0; done < leaf.count; done += chunk) {
+		int count = min(chunk, leaf.count - done);
+		int first = leaf.child + done;
+
+		if (codeData == nullptr) {
+			leafSquares(query, cordData + first, stride, count, dims,
+					bestSquare, dist);
+		} else {
+			compactSquares(query, first, count, dist);
+		}
+
+		for (int i = 0; i < count; i++) {
+			if (settle) {
+				if (dist[i] > settleSquare(bestSquare)) {
+					continue;
+				}
+				leafSquares(query, cordData + first + i, stride, 1, dims,
+						bestSquare, dist + i);
+			}
+			if (dist[i] < bestSquare && indexData[first + i] != TOMBSTONE) {
+				bestSquare = dist[i];
+				bestSlot = first + i;
+			}
+		}
+	}
+}
+
+//same as above with the heap bound as the current best
+void flatTree::scanLeaf(const double * query, const flatNode& leaf,
+		nearHeap& heap, bool settle) const {
+
+	const int chunk = 64;
+	double dist[chunk];
+	size_t stride = pointTotal;
+
+	for (int done = 0; done < leaf.count; done += chunk) {
+		int count = min(chunk, leaf.count - done);
+		int first = leaf.child + done;
+
+		if (codeData == nullptr) {
+			leafSquares(query, cordData + first, stride, count, dims,
+					heap.bound(), dist);
+		} else {
+			compactSquares(query, first, count, dist);
+		}
+		for (int i = 0; i < count; i++) {
+			if (indexData[first + i] == TOMBSTONE) {
+				continue;
+			}
+			if (settle) {
+				if (dist[i] > settleSquare(heap.bound())) {
+					continue;
+				}
+				leafSquares(query, cordData + first + i, stride, 1, dims,
+						heap.bound(), dist + i);
+			}
+			heap.offer(dist[i], first + i);
+		}
+	}
+}
+
+void flatTree::nearRecur(const double * query, int node, int& bestSlot,
+		double& bestSquare, bool settle) const {
+
+	const flatNode& cur = nodeData[node];
+
+	if (cur.count > 0) { //found leaf
+		scanLeaf(query, cur, bestSlot, bestSquare, settle);
+		return;
+	}
+
+	double offset = query[cur.axis] - cur.val;
+	if (offset <= 0) { //left first
+		nearRecur(query, cur.child, bestSlot, bestSquare, settle);
+		if (offset * offset < bestSquare) {
+			nearRecur(query, cur.child + 1, bestSlot, bestSquare, settle);
+		}
+	} else { //right first
+		nearRecur(query, cur.child + 1, bestSlot, bestSquare, settle);
+		if (offset * offset <= bestSquare) {
+			nearRecur(query, cur.child, bestSlot, bestSquare, settle);
+		}
+	}
+}
+
+//distance from a query to the cell of a node, kept up to date on the way
+//down: the near child has the parent's distance and the far child swaps the
+//split axis term of the parent for the plane distance, so no node costs more
+//than one axis. the sum is shrunk by the rounding it can pick up over a
+//stack deep path so it never exceeds the distance of a point in the cell
+flatTree::cellDistance::cellDistance(int dims) :
+		dims(dims), logged(0), square(0) {
+	offsets = stackOffsets;
+	if (dims > BOUNDS_STACK_DIMS) {
+		heapOffsets.resize(dims);
+		offsets = &heapOffsets[0];
+	}
+	for (int d = 0; d < dims; d++) {
+		offsets[d] = 0;
+	}
+	shrink = 1 - 4 * (SEARCH_STACK + dims + 2) * DBL_EPSILON;
+}
+
+double flatTree::cellDistance::farSquare(int axis, double offset) const {
+	return square - offsets[axis] * offsets[axis] + offset * offset;
+}
+
+int flatTree::cellDistance::mark() const {
+	return logged;
+}
+
+void flatTree::cellDistance::enter(int undone, int axis, double offset,
+		double farSquare) {
+	while (logged > undone) { //leave the far children entered since
+		logged--;
+		offsets[logAxis[logged]] = logOffset[logged];
+	}
+	logAxis[logged] = axis;
+	logOffset[logged] = offsets[axis];
+	logged++;
+	offsets[axis] = offset;
+	square = farSquare;
+}
+
+//go down the near side of every split and put the far side on the stack,
+//after a leaf resume with the deepest far side its cell distance does not
+//rule out. trees deeper than the stack, which only a hand made tree file can
+//give, finish the remaining subtree with nearRecur
+void flatTree::nearIter(const double * query, int& bestSlot,
+		double& bestSquare, double scale, int maxLeaves, searchStats * stats,
+		bool settle) const {
+
+	deferredNode stack[SEARCH_STACK];
+	cellDistance cell(dims);
+	int top = 0;
+	int node = 0;
+	int leaves = 0;
+	bool useBoxes = boxData != nullptr;
+	scale *= cell.shrink;
+
+	while (node >= 0) {
+		const flatNode& cur = nodeData[node];
+		if (stats != nullptr) {
+			stats->nodes++;
+		}
+
+		if (cur.count == 0 && top < SEARCH_STACK) {
+			double offset = query[cur.axis] - cur.val;
+			int near = offset <= 0 ? cur.child : cur.child + 1;
+			int far = offset <= 0 ? cur.child + 1 : cur.child;
+			stack[top++] = deferredNode { cell.farSquare(cur.axis, offset), far,
+					offset > 0, cur.axis, offset, cell.mark() };
+			node = near;
+			continue;
+		} else {
+			if (cur.count > 0) { //found leaf
+				scanLeaf(query, cur, bestSlot, bestSquare, settle);
+			} else {
+				nearRecur(query, node, bestSlot, bestSquare, settle);
+			}
+			if (stats != nullptr) {
+				stats->leaves++;
+			}
+			if (++leaves >= maxLeaves) {
+				return;
+			}
+		}
+
+		node = -1;
+		while (top > 0 && node < 0) {
+			const deferredNode& far = stack[--top];
+			double bound = far.square * scale;
+			if (bound < bestSquare || (far.inclusive && bound == bestSquare)) {
+				//the box is only measured once the cell cannot rule it out,
+				//and not for leaves where it costs as much as the scan
+				if (!useBoxes || nodeData[far.node].count > 0
+						|| boxSquare(query, far.node) * scale < bestSquare) {
+					node = far.node;
+					cell.enter(far.undone, far.axis, far.offset, far.square);
+				}
+			}
+		}
+	}
+}
+
+//the packet goes first to the side most of its lanes are near and takes
+//along the other lanes whose plane distance allows. the other side goes on
+//the stack with the lanes that may need it, those that are near it always
+//do and the rest are checked again by plane and box once it comes off.
+//pruning keeps subtrees at exactly a lane's best so every point at that
+//distance is seen and a tie is always noticed. every lane loop runs over
+//all PACKET_LANES so it vectorizes, unused lanes hold no bits in the masks.
+//a tree deeper than the stack is finished lane by lane and those lanes
+//count as ties, so the caller repeats them with findNear
+void flatTree::nearPacket(const double * const * queries,
+		const double * cords, int lanes, int * bestSlots,
+		double * bestSquares, uint32_t& ties) const {
+
+	packetNode stack[SEARCH_STACK];
+	double limit[PACKET_LANES];
+	double dist[PACKET_LANES];
+	int found[PACKET_LANES];
+	int tied[PACKET_LANES];
+	int top = 0;
+	int node = 0;
+	uint32_t mask = (1u << lanes) - 1;
+	bool useBoxes = boxData != nullptr;
+	size_t stride = pointTotal;
+	ties = 0;
+
+	while (node >= 0) {
+		const flatNode& cur = nodeData[node];
+
+		if (cur.count == 0 && top < SEARCH_STACK) {
+			const double * axis = cords + (size_t) cur.axis * PACKET_LANES;
+			uint32_t left = 0;
+			uint32_t close = 0;
+			for (int l = 0; l < PACKET_LANES; l++) {
+				double offset = axis[l] - cur.val;
+				left |= (uint32_t) (offset <= 0) << l;
+				close |= (uint32_t) (offset * offset <= bestSquares[l]) << l;
+			}
+			left &= mask;
+			uint32_t right = mask & ~left;
+			bool leftFirst = __builtin_popcount(left)
+					>= __builtin_popcount(right);
+			uint32_t nearFirst = leftFirst ? left : right;
+			uint32_t nearSecond = leftFirst ? right : left;
+			uint32_t second = nearSecond | (nearFirst & close);
+			if (second != 0) {
+				stack[top++] = packetNode { leftFirst ? cur.child + 1 :
+						cur.child, node, second, nearSecond };
+			}
+			uint32_t first = nearFirst | (nearSecond & close);
+			if (first != 0) {
+				node = leftFirst ? cur.child : cur.child + 1;
+				mask = first;
+				continue;
+			}
+		} else if (cur.count > 0) { //found leaf, every lane of a point at once
+			for (int l = 0; l < PACKET_LANES; l++) {
+				limit[l] = (mask >> l & 1) ? bestSquares[l] : -1;
+				found[l] = bestSlots[l];
+				tied[l] = ties >> l & 1;
+			}
+			for (int slot = cur.child; slot < cur.child + cur.count; slot++) {
+				if (indexData[slot] == TOMBSTONE) {
+					continue;
+				}
+				for (int l = 0; l < PACKET_LANES; l++) {
+					dist[l] = 0;
+				}
+				for (int d = 0; d < dims; d++) {
+					double c = cordData[(size_t) d * stride + slot];
+					const double * axis = cords + (size_t) d * PACKET_LANES;
+					for (int l = 0; l < PACKET_LANES; l++) {
+						double dif = axis[l] - c;
+						dist[l] += dif * dif;
+					}
+				}
+				for (int l = 0; l < PACKET_LANES; l++) {
+					bool better = dist[l] < limit[l];
+					tied[l] = better ? 0 : (dist[l] == limit[l] ? 1 : tied[l]);
+					limit[l] = better ? dist[l] : limit[l];
+					found[l] = better ? slot : found[l];
+				}
+			}
+			for (int l = 0; l < lanes; l++) {
+				if (mask >> l & 1) {
+					bestSquares[l] = limit[l];
+					bestSlots[l] = found[l];
+					ties = (ties & ~(1u << l)) | (uint32_t) tied[l] << l;
+				}
+			}
+		} else { //out of stack
+			for (int l = 0; l < lanes; l++) {
+				if (mask >> l & 1) {
+					nearRecur(queries[l], node, bestSlots[l], bestSquares[l],
+							false);
+				}
+			}
+			ties |= mask;
+		}
+
+		node = -1;
+		while (top > 0 && node < 0) {
+			const packetNode& far = stack[--top];
+			uint32_t check = far.mask & ~far.near;
+			if (check != 0) {
+				const flatNode& parent = nodeData[far.parent];
+				const double * axis = cords
+						+ (size_t) parent.axis * PACKET_LANES;
+				uint32_t close = 0;
+				for (int l = 0; l < PACKET_LANES; l++) {
+					double offset = axis[l] - parent.val;
+					close |= (uint32_t) (offset * offset <= bestSquares[l]) << l;
+				}
+				check &= close;
+			}
+			if (check != 0 && useBoxes && nodeData[far.node].count == 0) {
+				//box distance of every lane, as boxSquare sums it
+				const float * lo = boxData + (size_t) far.node * 2 * dims;
+				const float * hi = lo + dims;
+				for (int l = 0; l < PACKET_LANES; l++) {
+					dist[l] = 0;
+				}
+				for (int d = 0; d < dims; d++) {
+					const double * axis = cords + (size_t) d * PACKET_LANES;
+					for (int l = 0; l < PACKET_LANES; l++) {
+						double below = lo[d] - axis[l];
+						double above = axis[l] - hi[d];
+						double dif = below > 0 ? below : (above > 0 ? above : 0);
+						dist[l] += dif * dif;
+					}
+				}
+				uint32_t inside = 0;
+				for (int l = 0; l < PACKET_LANES; l++) {
+					inside |= (uint32_t) (dist[l] <= bestSquares[l]) << l;
+				}
+				check &= inside;
+			}
+			uint32_t keep = far.near | check;
+			if (keep != 0) {
+				node = far.node;
+				mask = keep;
+			}
+		}
+	}
+}
+
+//same walk as nearIter with the heap bound as the current best
+void flatTree::kNearIter(const double * query, nearHeap& heap,
+		bool settle) const {
+
+	deferredNode stack[SEARCH_STACK];
+	cellDistance cell(dims);
+	int top = 0;
+	int node = 0;
+	bool useBoxes = boxData != nullptr;
+
+	while (node >= 0) {
+		const flatNode& cur = nodeData[node];
+
+		if (cur.count == 0 && top < SEARCH_STACK) {
+			double offset = query[cur.axis] - cur.val;
+			int near = offset <= 0 ? cur.child : cur.child + 1;
+			int far = offset <= 0 ? cur.child + 1 : cur.child;
+			stack[top++] = deferredNode { cell.farSquare(cur.axis, offset), far,
+					offset > 0, cur.axis, offset, cell.mark() };
+			node = near;
+			continue;
+		} else if (cur.count > 0) { //found leaf
+			scanLeaf(query, cur, heap, settle);
+		} else {
+			kNearRecur(query, node, heap, settle);
+		}
+
+		node = -1;
+		while (top > 0 && node < 0) {
+			const deferredNode& far = stack[--top];
+			double bound = far.square * cell.shrink;
+			if (bound < heap.bound()
+					|| (far.inclusive && bound == heap.bound())) {
+				if (!useBoxes || nodeData[far.node].count > 0
+						|| boxSquare(query, far.node) < heap.bound()) {
+					node = far.node;
+					cell.enter(far.undone, far.axis, far.offset, far.square);
+				}
+			}
+		}
+	}
+}
+
+int flatTree::findRange(const double * query, double radius,
+		vector<int>& found) const {
+	found.clear();
+	if (nodeTotal == 0 || radius < 0) {
+		return 0;
+	}
+	int total = rangeSearch(query, 0, radius * radius, &found);
+	//curve layouts may put a right subtree before its left one
+	if (!is_sorted(found.begin(), found.end())) {
+		sort(found.begin(), found.end());
+	}
+	return total;
+}
+
+int flatTree::countRange(const double * query, double radius) const {
+	if (nodeTotal == 0 || radius < 0) {
+		return 0;
+	}
+	return rangeSearch(query, 0, radius * radius, nullptr);
+}
+
+void flatTree::findRangeBatch(const double * queries, int count,
+		double radius, int * counts, vector<int> * found,
+		taskPool * pool) const {
+
+	vector<int> order;
+	if (queryCurve != CURVE_NONE && count > 1) {
+		curveOrder(queries, count, dims, queryCurve, order);
+	}
+	const int * at = order.empty() ? nullptr : &order[0];
+
+	auto search = [this, queries, radius, counts, found, at](size_t begin,
+			size_t end) {
+		vector<int> buffer; //reused by every query of the chunk
+		for (size_t next = begin; next < end; next++) {
+			size_t i = at ? at[next] : next;
+			if (found == nullptr) {
+				counts[i] = countRange(queries + i * dims, radius);
+			} else {
+				counts[i] = findRange(queries + i * dims, radius, buffer);
+				found[i].assign(buffer.begin(), buffer.end());
+			}
+		}
+	};
+
+	if (pool == nullptr || pool->getThreads() == 1) {
+		search(0, count);
+	} else {
+		pool->parallelFor(count, (count + QUERY_CHUNK - 1) / QUERY_CHUNK, search);
+	}
+}
+
+//the radius is fixed, so a far child is either needed or not when its split
+//is reached. needed ones wait on the stack, subtrees deeper than the stack
+//are finished with a recursive call. with the doubles kept behind a compact
+//copy only points the copy puts near the radius are measured on them
+int flatTree::rangeSearch(const double * query, int node, double radiusSquare,
+		vector<int> * found) const {
+
+	int stack[SEARCH_STACK];
+	int top = 0;
+	int total = 0;
+
+	const int chunk = 64;
+	double dist[chunk];
+	size_t stride = pointTotal;
+	bool settle = codeData != nullptr && cordData != nullptr;
+	double outer = settle ? settleSquare(radiusSquare) : radiusSquare;
+	double inner = -1; //the copy alone decides points within it
+	if (settle && sqrt(radiusSquare) > copyError) {
+		inner = (sqrt(radiusSquare) - copyError) * (1 - PRECISION_SLACK);
+		inner *= inner;
+	}
+
+	while (node >= 0) {
+		const flatNode& cur = nodeData[node];
+
+		if (cur.count > 0) { //found leaf
+			for (int done = 0; done < cur.count; done += chunk) {
+				int count = min(chunk, cur.count - done);
+				int first = cur.child + done;
+
+				if (codeData == nullptr) {
+					leafSquares(query, cordData + first, stride, count, dims,
+							radiusSquare, dist);
+				} else {
+					compactSquares(query, first, count, dist);
+				}
+				for (int i = 0; i < count; i++) {
+					if (settle && dist[i] > inner && dist[i] <= outer) {
+						leafSquares(query, cordData + first + i, stride, 1, dims,
+								radiusSquare, dist + i);
+					}
+					if (dist[i] <= radiusSquare
+							&& indexData[first + i] != TOMBSTONE) {
+						total++;
+						if (found != nullptr) {
+							found->push_back(first + i);
+						}
+					}
+				}
+			}
+			node = top > 0 ? stack[--top] : -1;
+			continue;
+		}
+
+		//points equal to the split value can sit on either side
+		double offset = query[cur.axis] - cur.val;
+		bool reach = offset * offset <= radiusSquare;
+		bool left = offset <= 0 || reach;
+		bool right = offset >= 0 || reach;
+		if (boxData != nullptr) { //boxes can rule out either side
+			left = left && boxSquare(query, cur.child) <= radiusSquare;
+			right = right && boxSquare(query, cur.child + 1) <= radiusSquare;
+		}
+		if (!left && !right) {
+			node = top > 0 ? stack[--top] : -1;
+			continue;
+		}
+		if (left && right) {
+			if (top < SEARCH_STACK) {
+				stack[top++] = cur.child + 1;
+			} else {
+				total += rangeSearch(query, cur.child + 1, radiusSquare, found);
+			}
+		}
+		node = left ? cur.child : cur.child + 1;
+	}
+	return total;
+}
+
+//recursive write function, single point leaves are written exactly as in
+//treeNode::wRecur, larger leaves as LEAF,count followed by each point
+int flatTree::getSlotCount() const {
+	return pointTotal;
+}
+
+int flatTree::findSlot(int index) const {
+	if (updated) {
+		auto it = slotOf.find(index);
+		return it == slotOf.end() ? -1 : it->second;
+	}
+	for (size_t slot = 0; slot < pointTotal; slot++) {
+		if (indexData[slot] == index) {
+			return slot;
+		}
+	}
+	return -1;
+}
+
+bool flatTree::startUpdates() {
+	if (updated) {
+		return true;
+	}
+	if (cordData == nullptr) { //the compact copy becomes the coordinates
+		cords.resize(pointTotal * dims);
+		for (int d = 0; d < dims; d++) {
+			for (size_t slot = 0; slot < pointTotal; slot++) {
+				cords[d * pointTotal + slot] = compactCord(d, slot);
+			}
+		}
+	}
+	if (mapping != nullptr) { //updates need the tree in vectors of its own
+		nodes.assign(nodeData, nodeData + nodeTotal);
+		if (cordData != nullptr) {
+			cords.assign(cordData, cordData + pointTotal * dims);
+		}
+		indices.assign(indexData, indexData + pointTotal);
+		if (boxData != nullptr) {
+			boxes.assign(boxData, boxData + nodeTotal * 2 * (size_t) dims);
+		}
+		munmap(mapping, mappingSize);
+		mapping = nullptr;
+		mappingSize = 0;
+		useOwned();
+	}
+	if (precision != PRECISION_DOUBLE) { //encoded again by compact()
+		vector<float>().swap(floatCords);
+		vector<uint16_t>().swap(quantCords);
+		vector<double>().swap(codes);
+		useOwned();
+	}
+
+	slotOf.clear();
+	slotOf.reserve(pointTotal);
+	for (size_t slot = 0; slot < pointTotal; slot++) {
+		if (!slotOf.emplace(indices[slot], slot).second) {
+			cout << "ERROR, TREE HOLDS INDEX " << indices[slot] << " TWICE"
+					<< endl;
+			slotOf.clear();
+			return false;
+		}
+	}
+
+	parents.assign(nodeTotal, -1);
+	weights.assign(nodeTotal, 0);
+	deadWeights.assign(nodeTotal, 0);
+	slotLeaf.assign(pointTotal, -1);
+	for (size_t node = nodeTotal; node-- > 0;) { //children follow their parent
+		const flatNode& cur = nodes[node];
+		if (cur.count > 0) {
+			weights[node] = cur.count;
+			for (int s = cur.child; s < cur.child + cur.count; s++) {
+				slotLeaf[s] = node;
+			}
+		} else {
+			weights[node] = weights[cur.child] + weights[cur.child + 1];
+			parents[cur.child] = parents[cur.child + 1] = node;
+		}
+	}
+	liveTotal = pointTotal;
+	usedSlots = pointTotal;
+	updated = true;
+	return true;
+}
+
+int flatTree::takeSlots(int count) {
+	size_t capacity = indices.size();
+	if (usedSlots + (size_t) count > capacity) { //double, moving every axis
+		size_t grown = max(2 * capacity, usedSlots + (size_t) count);
+		vector<double> moved(grown * dims);
+		for (int d = 0; d < dims; d++) {
+			copy(cords.begin() + d * capacity,
+					cords.begin() + d * capacity + usedSlots,
+					moved.begin() + d * grown);
+		}
+		cords.swap(moved);
+		indices.resize(grown, TOMBSTONE);
+		slotLeaf.resize(grown, -1);
+		useOwned();
+	}
+	int first = usedSlots;
+	usedSlots += count;
+	return first;
+}
+
+void flatTree::gatherLive(int node, vector<double>& rows,
+		vector<int>& ids) const {
+	vector<int> stack(1, node);
+	while (!stack.empty()) {
+		const flatNode& cur = nodeData[stack.back()];
+		stack.pop_back();
+		if (cur.count == 0) {
+			stack.push_back(cur.child + 1);
+			stack.push_back(cur.child);
+			continue;
+		}
+		for (int s = cur.child; s < cur.child + cur.count; s++) {
+			if (indexData[s] != TOMBSTONE) {
+				for (int d = 0; d < dims; d++) {
+					rows.push_back(getCord(s, d));
+				}
+				ids.push_back(indexData[s]);
+			}
+		}
+	}
+}
+
+void flatTree::rebuildSubtree(int node, const double * rows, const int * ids,
+		int count) {
+
+	int oldWeight = weights[node];
+	int oldDead = deadWeights[node];
+	int parent = parents[node];
+
+	//the old slots hold nothing from now on and the old nodes below node are
+	//left behind for compact()
+	vector<int> stack(1, node);
+	while (!stack.empty()) {
+		const flatNode& cur = nodes[stack.back()];
+		stack.pop_back();
+		if (cur.count == 0) {
+			stack.push_back(cur.child + 1);
+			stack.push_back(cur.child);
+			continue;
+		}
+		for (int s = cur.child; s < cur.child + cur.count; s++) {
+			if (indices[s] != TOMBSTONE) {
+				slotOf.erase(indices[s]);
+			}
+			indices[s] = TOMBSTONE;
+			slotLeaf[s] = -1;
+		}
+	}
+
+	if (count == 0 && parent < 0) { //nothing left at all
+		nodes.clear();
+		parents.clear();
+		weights.clear();
+		deadWeights.clear();
+		boxes.clear();
+		useOwned();
+		return;
+	}
+
+	if (count == 0) { //the sibling takes the parent's place
+		int sibling = nodes[parent].child == node ? node + 1 : node - 1;
+		nodes[parent] = nodes[sibling];
+		weights[parent] = weights[sibling];
+		deadWeights[parent] = deadWeights[sibling];
+		const flatNode& moved = nodes[parent];
+		if (moved.count > 0) {
+			for (int s = moved.child; s < moved.child + moved.count; s++) {
+				slotLeaf[s] = parent;
+			}
+		} else {
+			parents[moved.child] = parents[moved.child + 1] = parent;
+		}
+		if (!boxes.empty()) {
+			size_t width = 2 * (size_t) dims;
+			copy(boxes.begin() + sibling * width,
+					boxes.begin() + (sibling + 1) * width,
+					boxes.begin() + parent * width);
+		}
+		for (int up = parents[parent]; up >= 0; up = parents[up]) {
+			weights[up] -= oldWeight;
+			deadWeights[up] -= oldDead;
+		}
+		useOwned();
+		return;
+	}
+
+	int firstSlot = takeSlots(count);
+	int firstNode = nodes.size();
+
+	vector<int> order(count);
+	for (int i = 0; i < count; i++) {
+		order[i] = i;
+	}
+	vector<int> scratch(count >= partitionCutoff ? count : 0);
+	nodes.resize(firstNode + 2 * (size_t) count);
+
+	//a leaf continues the rotation of its parent, an internal node keeps its axis
+	int dIndex = nodes[node].axis + (nodes[node].count > 0 ? 1 : 0);
+
+	buildState state;
+	state.base = &order[0];
+	state.scratch = scratch.empty() ? nullptr : &scratch[0];
+	state.work = rows;
+	state.totalDepth = dims;
+	state.axisMode = axisMode;
+	state.pool = nullptr;
+	state.group = nullptr;
+	state.nextNode = firstNode;
+	buildRecur(&order[0], &order[0] + count, dIndex, 0, node, state);
+	nodes.resize(state.nextNode);
+	parents.resize(nodes.size(), -1);
+	weights.resize(nodes.size(), 0);
+	deadWeights.resize(nodes.size(), 0);
+
+	//points into their new slots
+	size_t stride = indices.size();
+	for (int i = 0; i < count; i++) {
+		int slot = firstSlot + i;
+		for (int d = 0; d < dims; d++) {
+			cords[d * stride + slot] = rows[(size_t) order[i] * dims + d];
+		}
+		indices[slot] = ids[order[i]];
+		slotOf[indices[slot]] = slot;
+	}
+	if (!boxes.empty()) {
+		boxes.resize(nodes.size() * 2 * (size_t) dims);
+	}
+	useOwned();
+
+	//leaves get their slots, then counts and boxes from the bottom up
+	auto finish = [this, firstSlot](int n) {
+		flatNode& cur = nodes[n];
+		deadWeights[n] = 0;
+		if (cur.count > 0) {
+			cur.child += firstSlot;
+			weights[n] = cur.count;
+			for (int s = cur.child; s < cur.child + cur.count; s++) {
+				slotLeaf[s] = n;
+			}
+		} else {
+			weights[n] = weights[cur.child] + weights[cur.child + 1];
+			parents[cur.child] = parents[cur.child + 1] = n;
+		}
+		if (!boxes.empty()) {
+			boxNode(n);
+		}
+	};
+	for (int n = nodes.size() - 1; n >= firstNode; n--) {
+		finish(n);
+	}
+	finish(node);
+
+	for (int up = parent; up >= 0; up = parents[up]) {
+		weights[up] += count - oldWeight;
+		deadWeights[up] -= oldDead;
+	}
+}
+
+void flatTree::collectGarbage() {
+	if ((size_t) usedSlots > 2 * (size_t) liveTotal + 64
+			|| nodes.size() > 4 * (size_t) liveTotal + 64) {
+		compact();
+	}
+}
+
+bool flatTree::insert(const double * point, int index) {
+	if (dims == 0) {
+		cout << "ERROR, BUILD OR READ A TREE BEFORE INSERTING" << endl;
+		return false;
+	}
+	if (!startUpdates()) {
+		return false;
+	}
+	if (index == TOMBSTONE || slotOf.count(index)) {
+		cout << "ERROR, TREE ALREADY HOLDS INDEX " << index << endl;
+		return false;
+	}
+
+	if (nodes.empty()) { //first point of an emptied tree
+		int slot = takeSlots(1);
+		flatNode leaf;
+		leaf.val = point[0];
+		leaf.child = slot;
+		leaf.axis = 0;
+		leaf.count = 1;
+		nodes.assign(1, leaf);
+		parents.assign(1, -1);
+		weights.assign(1, 1);
+		deadWeights.assign(1, 0);
+		for (int d = 0; d < dims; d++) {
+			cords[d * indices.size() + slot] = point[d];
+		}
+		indices[slot] = index;
+		slotLeaf[slot] = 0;
+		slotOf[index] = slot;
+		liveTotal++;
+		if (boxesOn) {
+			boxes.resize(2 * (size_t) dims);
+		}
+		useOwned();
+		if (boxesOn) {
+			boxNode(0);
+		}
+		return true;
+	}
+
+	//down to the leaf by the split planes, widening boxes on the way
+	size_t width = 2 * (size_t) dims;
+	vector<int> path;
+	int node = 0;
+	while (nodes[node].count == 0) {
+		path.push_back(node);
+		if (!boxes.empty()) {
+			float * lo = &boxes[node * width];
+			float * hi = lo + dims;
+			for (int d = 0; d < dims; d++) {
+				lo[d] = min(lo[d], floatBelow(point[d]));
+				hi[d] = max(hi[d], floatAbove(point[d]));
+			}
+		}
+		const flatNode& cur = nodes[node];
+		node = point[cur.axis] <= cur.val ? cur.child : cur.child + 1;
+	}
+
+	//rebuild the leaf with the new point, it splits once it is over leafSize
+	vector<double> rows;
+	vector<int> ids;
+	gatherLive(node, rows, ids);
+	rows.insert(rows.end(), point, point + dims);
+	ids.push_back(index);
+	rebuildSubtree(node, &rows[0], &ids[0], ids.size());
+	liveTotal++;
+
+	//scapegoat: the highest node on the path with a child holding too much
+	for (int n : path) {
+		int heavy = max(weights[nodes[n].child], weights[nodes[n].child + 1]);
+		if (weights[n] > 2 * leafSize && heavy > REBUILD_BALANCE * weights[n]) {
+			rows.clear();
+			ids.clear();
+			gatherLive(n, rows, ids);
+			rebuildSubtree(n, &rows[0], &ids[0], ids.size());
+			break;
+		}
+	}
+
+	collectGarbage();
+	return true;
+}
+
+bool flatTree::remove(int index) {
+	if (dims == 0 || !startUpdates()) {
+		return false;
+	}
+	auto it = slotOf.find(index);
+	if (it == slotOf.end()) {
+		cout << "ERROR, TREE DOES NOT HOLD INDEX " << index << endl;
+		return false;
+	}
+	int slot = it->second;
+	slotOf.erase(it);
+	indices[slot] = TOMBSTONE;
+	liveTotal--;
+
+	//the highest node that is now mostly tombstones is rebuilt without them
+	int target = -1;
+	for (int n = slotLeaf[slot]; n >= 0; n = parents[n]) {
+		deadWeights[n]++;
+		if (deadWeights[n] > REBUILD_DEAD * weights[n]) {
+			target = n;
+		}
+	}
+	if (target >= 0) {
+		vector<double> rows;
+		vector<int> ids;
+		gatherLive(target, rows, ids);
+		rebuildSubtree(target, rows.empty() ? nullptr : &rows[0],
+				ids.empty() ? nullptr : &ids[0], ids.size());
+	}
+
+	collectGarbage();
+	return true;
+}
+
+//copies the reachable part of the tree in the order a sequential build would
+//allocate it, skipping tombstones, and nodes whose other side lost every point
+void flatTree::compact() {
+	if (!updated) {
+		return;
+	}
+
+	vector<flatNode> packedNodes;
+	vector<double> packedCords((size_t) liveTotal * dims);
+	vector<int> packedIndices(liveTotal);
+
+	if (liveTotal > 0) {
+		vector<pair<int, int> > stack; //old position, new position
+		stack.push_back(make_pair(0, 0));
+		packedNodes.resize(1);
+		int next = 0;
+		auto live = [this](int n) {
+			return weights[n] - deadWeights[n];
+		};
+
+		while (!stack.empty()) {
+			int from = stack.back().first;
+			int to = stack.back().second;
+			stack.pop_back();
+
+			while (nodes[from].count == 0) { //pass over one-sided nodes
+				if (live(nodes[from].child) == 0) {
+					from = nodes[from].child + 1;
+				} else if (live(nodes[from].child + 1) == 0) {
+					from = nodes[from].child;
+				} else {
+					break;
+				}
+			}
+
+			flatNode cur = nodes[from];
+			if (cur.count > 0) {
+				cur.child = next;
+				for (int s = nodes[from].child;
+						s < nodes[from].child + nodes[from].count; s++) {
+					if (indices[s] == TOMBSTONE) {
+						continue;
+					}
+					for (int d = 0; d < dims; d++) {
+						packedCords[(size_t) d * liveTotal + next] = getCord(s, d);
+					}
+					packedIndices[next++] = indices[s];
+				}
+				cur.count = next - cur.child;
+				cur.val = packedCords[(size_t) cur.axis * liveTotal + cur.child];
+			} else {
+				cur.child = packedNodes.size();
+				packedNodes.resize(packedNodes.size() + 2);
+				stack.push_back(make_pair(nodes[from].child + 1, cur.child + 1));
+				stack.push_back(make_pair(nodes[from].child, cur.child));
+			}
+			packedNodes[to] = cur;
+		}
+	}
+
+	nodes.swap(packedNodes);
+	cords.swap(packedCords);
+	indices.swap(packedIndices);
+	vector<int>().swap(parents);
+	vector<int>().swap(weights);
+	vector<int>().swap(deadWeights);
+	vector<int>().swap(slotLeaf);
+	unordered_map<int, int>().swap(slotOf);
+	updated = false;
+	makeCompact();
+	if (boxesOn && nodeTotal > 0) {
+		makeBoxes();
+	} else {
+		boxes.clear();
+		useOwned();
+	}
+}
+
+void flatTree::wRecur(ofstream& stream, int node) const {
+
+	const flatNode& cur = nodeData[node];
+
+	stream << cur.axis << "," << cur.val << ",";
+	if (cur.count > 0) {
+		if (cur.count > 1) {
+			stream << "LEAF," << cur.count << ",";
+		}
+		for (int slot = cur.child; slot < cur.child + cur.count; slot++) {
+			stream << indexData[slot] << "," << dims << ",";
+			for (int i = 0; i < dims; i++) {
+				stream << getCord(slot, i) << ",";
+			}
+		}
+		stream << "NULL,NULL,";
+	} else {
+		stream << "NOT_LEAF,";
+		wRecur(stream, cur.child);
+		wRecur(stream, cur.child + 1);
+	}
+}
+
+//base function to write tree to file, calls helper recursively
+void flatTree::writeOut(const string fileName) const {
+
+	if (updated) {
+		cout << "ERROR, COMPACT AN UPDATED TREE BEFORE WRITING IT" << endl;
+		return;
+	}
+
+	ofstream myfile(fileName);
+	if (myfile.is_open()) {
+
+		myfile.precision(dbl::max_digits10); //max precision for writing to file
+		if (precision != PRECISION_DOUBLE) { //double trees keep the treeNode format
+			myfile << "PRECISION," << precisionName(precision) << ",";
+			if (cordData != nullptr) { //the points are written as doubles
+				myfile << "EXACT,";
+			}
+		}
+		if (nodeTotal > 0) {
+			wRecur(myfile, 0);
+		}
+
+		myfile.close();
+	} else {
+		cout << "Could not open file to write out tree contents.\n";
+	}
+}
+
+//read one comma terminated token, returns false at end of input
+static bool nextCell(const char *& cursor, const char * end, const char *& cell,
+		size_t& len) {
+	if (cursor >= end) {
+		return false;
+	}
+	const char * comma = (const char *) memchr(cursor, ',', end - cursor);
+	if (comma == nullptr) {
+		comma = end;
+	}
+	cell = cursor;
+	len = comma - cursor;
+	cursor = comma < end ? comma + 1 : end;
+	return true;
+}
+
+//recursive function to parse a node and its children straight from the file
+//buffer, coordinates are collected row by row and rearranged once at the end
+bool flatTree::recurIn(const char *& cursor, const char * end, int node,
+		vector<double>& rows) {
+
+	const char * cell;
+	size_t len;
+	int axis;
+	double val;
+	int count = 1;
+
+	if (!nextCell(cursor, end, cell, len)) { //axis
+		return false;
+	}
+	axis = atoi(cell);
+	if (!nextCell(cursor, end, cell, len)) { //val
+		return false;
+	}
+	val = atof(cell);
+	if (!nextCell(cursor, end, cell, len)) { //index, LEAF or NOT_LEAF
+		return false;
+	}
+
+	nodes[node].axis = axis;
+	nodes[node].val = val;
+
+	if (len == 8 && strncmp(cell, "NOT_LEAF", 8) == 0) {
+		int left = nodes.size();
+		nodes.push_back(flatNode());
+		nodes.push_back(flatNode());
+		nodes[node].child = left;
+		nodes[node].count = 0;
+
+		return recurIn(cursor, end, left, rows)
+				&& recurIn(cursor, end, left + 1, rows);
+	}
+
+	if (len == 4 && strncmp(cell, "LEAF", 4) == 0) {
+		if (!nextCell(cursor, end, cell, len)) { //count
+			return false;
+		}
+		count = atoi(cell);
+		if (count < 1 || count > MAX_LEAF_SIZE
+				|| !nextCell(cursor, end, cell, len)) {
+			return false;
+		}
+		leafSize = max(leafSize, count);
+	}
+
+	nodes[node].child = indices.size();
+	nodes[node].count = count;
+
+	for (int p = 0; p < count; p++) {
+		if (p > 0 && !nextCell(cursor, end, cell, len)) { //index
+			return false;
+		}
+		indices.push_back(atoi(cell));
+		if (!nextCell(cursor, end, cell, len)) { //dims
+			return false;
+		}
+		for (int i = 0; i < dims; i++) {
+			if (!nextCell(cursor, end, cell, len)) {
+				return false;
+			}
+			rows.push_back(atof(cell));
+		}
+	}
+	nextCell(cursor, end, cell, len); //left null
+	nextCell(cursor, end, cell, len); //right null
+
+	return true;
+}
+
+//base function to read file, binary files are mapped, text files are read in
+//one block and parsed in place
+flatTree * flatTree::readTree(const string fileName, const int k, bool verify) {
+
+	if (isBinaryTree(fileName)) {
+		return mapTree(fileName, k, verify) ? this : nullptr;
+	}
+
+	ifstream myfile(fileName, ios::binary);
+	if (myfile.is_open()) {
+		stringstream buffer;
+		buffer << myfile.rdbuf();
+		myfile.close();
+		string contents = buffer.str();
+
+		clear();
+		dims = k;
+		nodes.push_back(flatNode());
+
+		vector<double> rows;
+		const char * cursor = contents.c_str();
+		const char * end = cursor + contents.size();
+		precision = precisionMode;
+		exact = exactMode;
+		if (contents.compare(0, 10, "PRECISION,") == 0) { //written at reduced precision
+			const char * cell;
+			size_t len;
+			nextCell(cursor, end, cell, len);
+			nextCell(cursor, end, cell, len);
+			precision = precisionValue(string(cell, len));
+			exact = false;
+			const char * after = cursor;
+			if (nextCell(after, end, cell, len)
+					&& string(cell, len) == "EXACT") { //the doubles were kept
+				exact = true;
+				cursor = after;
+			}
+		}
+		if (precision < 0 || !recurIn(cursor, end, 0, rows)) {
+			cout << "Tree data file is malformed, could not rebuild tree\n";
+			clear();
+			return nullptr;
+		}
+
+		size_t n = indices.size();
+		cords.resize(n * dims);
+		for (size_t s = 0; s < n; s++) {
+			for (int d = 0; d < dims; d++) {
+				cords[d * n + s] = rows[s * dims + d];
+			}
+		}
+		useOwned();
+		if (layoutCurve != CURVE_NONE && n > 0) {
+			curveLayout();
+		}
+		makeCompact();
+		if (boxesOn) {
+			makeBoxes();
+		}
+
+		return this;
+
+	} else {
+		cout << "Unable to open tree data file to rebuild tree from disk\n";
+		return nullptr;
+	}
+}
+
+//round a file offset up to the next section boundary of a binary tree file
+static uint64_t sectionAlign(uint64_t offset) {
+	return (offset + 63) / 64 * 64;
+}
+
+bool flatTree::writeBinary(const string fileName) const {
+
+	if (updated) {
+		cout << "ERROR, COMPACT AN UPDATED TREE BEFORE WRITING IT" << endl;
+		return false;
+	}
+
+	treeSections tree = { nodeData, nodeTotal, cordData, indexData,
+			pointTotal, precision, codeData,
+			floatData != nullptr ?
+					(const void *) floatData : (const void *) quantData,
+			codeData != nullptr ? compactBytes() : 0, boxData };
+	return writeTreeFile(fileName, dims, leafSize, tree);
+}
+
+//a reduced precision tree puts the doubles it kept last, where a search
+//that never settles on them never reads them
+bool writeTreeFile(const string fileName, int dims, int leafSize,
+		const treeSections& tree) {
+
+	treeFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TREE_FILE_MAGIC, sizeof(TREE_FILE_MAGIC));
+	header.version = TREE_FILE_VERSION;
+	header.dims = dims;
+	header.nodeCount = tree.nodeCount;
+	header.pointCount = tree.pointCount;
+	header.leafSize = leafSize;
+
+	bool compact = tree.codes != nullptr;
+	size_t nodeBytes = tree.nodeCount * sizeof(flatNode);
+	size_t cordBytes = tree.cords != nullptr ?
+			tree.pointCount * dims * sizeof(double) : 0;
+	size_t indexBytes = tree.pointCount * sizeof(int);
+	size_t codeBytes = compact ? 3 * dims * sizeof(double) : 0;
+	size_t copyBytes = compact ? tree.copyBytes : 0;
+	size_t boxBytes = tree.boxes != nullptr ?
+			tree.nodeCount * 2 * dims * sizeof(float) : 0;
+
+	//offsets in file order, end follows the last section placed
+	header.nodeOffset = sectionAlign(sizeof(header));
+	uint64_t end = header.nodeOffset + nodeBytes;
+	if (!compact) {
+		header.cordOffset = sectionAlign(end);
+		end = header.cordOffset + cordBytes;
+	}
+	header.indexOffset = sectionAlign(end);
+	end = header.indexOffset + indexBytes;
+	if (compact) {
+		header.precision = tree.precision;
+		header.compactOffset = sectionAlign(end);
+		end = header.compactOffset + codeBytes + copyBytes;
+	}
+	if (tree.boxes != nullptr) {
+		header.boxOffset = sectionAlign(end);
+		end = header.boxOffset + boxBytes;
+	}
+	if (compact && tree.cords != nullptr) {
+		header.cordOffset = sectionAlign(end);
+	}
+
+	header.checksum = checksum64(tree.nodes, nodeBytes);
+	if (!compact) {
+		header.checksum = checksum64(tree.cords, cordBytes, header.checksum);
+	}
+	header.checksum = checksum64(tree.indices, indexBytes, header.checksum);
+	if (compact) {
+		header.checksum = checksum64(tree.codes, codeBytes, header.checksum);
+		header.checksum = checksum64(tree.copy, copyBytes, header.checksum);
+	}
+	if (tree.boxes != nullptr) {
+		header.checksum = checksum64(tree.boxes, boxBytes, header.checksum);
+	}
+	if (compact && tree.cords != nullptr) {
+		header.checksum = checksum64(tree.cords, cordBytes, header.checksum);
+	}
+
+	ofstream myfile(fileName, ios::binary);
+	if (!myfile.is_open()) {
+		cout << "Could not open file to write out tree contents.\n";
+		return false;
+	}
+
+	const char zeros[64] = { 0 };
+	uint64_t at = sizeof(header);
+	auto section = [&](uint64_t offset, const void * data, size_t bytes) {
+		myfile.write(zeros, offset - at);
+		myfile.write((const char *) data, bytes);
+		at = offset + bytes;
+	};
+	myfile.write((const char *) &header, sizeof(header));
+	section(header.nodeOffset, tree.nodes, nodeBytes);
+	if (!compact) {
+		section(header.cordOffset, tree.cords, cordBytes);
+	}
+	section(header.indexOffset, tree.indices, indexBytes);
+	if (compact) {
+		section(header.compactOffset, tree.codes, codeBytes);
+		section(at, tree.copy, copyBytes);
+	}
+	if (tree.boxes != nullptr) {
+		section(header.boxOffset, tree.boxes, boxBytes);
+	}
+	if (compact && tree.cords != nullptr) {
+		section(header.cordOffset, tree.cords, cordBytes);
+	}
+	myfile.close();
+
+	if (!myfile) {
+		cout << "Error writing binary tree to " << fileName << endl;
+		return false;
+	}
+	return true;
+}
+
+//bytes of count entries of width bytes, false when that does not fit
+static bool sectionBytes(uint64_t count, uint64_t width, size_t& bytes) {
+	if (width != 0 && count > SIZE_MAX / width) {
+		return false;
+	}
+	bytes = count * width;
+	return true;
+}
+
+//a section of bytes at offset lies inside a file of size bytes
+static bool sectionFits(uint64_t offset, size_t bytes, size_t size) {
+	return offset % 64 == 0 && bytes <= size && offset <= size - bytes;
+}
+
+//every child and leaf range a search can follow stays inside the tree, and
+//children follow their parent so no walk can loop. O(nodes), so it is run
+//even when the checksum is skipped
+static bool linksValid(const flatNode * nodes, size_t nodeCount,
+		size_t pointCount, int dims) {
+	if (nodeCount == 0) {
+		return pointCount == 0;
+	}
+	for (size_t n = 0; n < nodeCount; n++) {
+		const flatNode& cur = nodes[n];
+		if (cur.child < 0) {
+			return false;
+		}
+		size_t child = cur.child;
+		if (cur.count > 0 ? child + cur.count > pointCount :
+				child <= n || child + 1 >= nodeCount || cur.axis < 0
+						|| cur.axis >= dims) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//map a binary tree and point the views straight into the mapping
+bool flatTree::mapTree(const string fileName, const int k, bool verify) {
+
+	clear();
+
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if (fd < 0) {
+		cout << "Unable to open tree data file to rebuild tree from disk\n";
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(treeFileHeader)) {
+		cout << "Binary tree file is too small to hold a tree\n";
+		close(fd);
+		return false;
+	}
+	size_t size = info.st_size;
+	void * map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); //the mapping stays valid after the descriptor is closed
+	if (map == MAP_FAILED) {
+		cout << "Unable to map binary tree file\n";
+		return false;
+	}
+	mapping = map;
+	mappingSize = size;
+
+	const treeFileHeader * header = (const treeFileHeader *) map;
+	const char * base = (const char *) map;
+
+	//sizes come from the file, so every product is checked before it is used
+	size_t nodeBytes = 0;
+	size_t cordBytes = 0;
+	size_t indexBytes = 0;
+	size_t codeBytes = 0;
+	size_t copyBytes = 0;
+	//a reduced precision file may leave the doubles out
+	bool hasCords = header->cordOffset != 0
+			|| header->precision == PRECISION_DOUBLE;
+	bool sized = header->nodeCount <= INT_MAX && header->pointCount <= INT_MAX
+			&& sectionBytes(header->nodeCount, sizeof(flatNode), nodeBytes)
+			&& (!hasCords
+					|| sectionBytes(header->pointCount,
+							(uint64_t) header->dims * sizeof(double), cordBytes))
+			&& sectionBytes(header->pointCount, sizeof(int), indexBytes);
+	if (sized && header->precision != PRECISION_DOUBLE) {
+		codeBytes = 3 * (size_t) header->dims * sizeof(double);
+		sized = sectionBytes(header->pointCount,
+				(uint64_t) header->dims
+						* (header->precision == PRECISION_FLOAT ?
+								sizeof(float) : sizeof(uint16_t)), copyBytes)
+				&& copyBytes <= SIZE_MAX - codeBytes;
+	}
+	size_t boxBytes = 0;
+	if (sized && header->boxOffset != 0) {
+		sized = sectionBytes(header->nodeCount,
+				2 * (uint64_t) header->dims * sizeof(float), boxBytes);
+	}
+
+	const char * problem = nullptr;
+	if (memcmp(header->magic, TREE_FILE_MAGIC, sizeof(TREE_FILE_MAGIC)) != 0) {
+		problem = "is not a binary tree file";
+	} else if (header->version != TREE_FILE_VERSION) {
+		problem = "was written by an unsupported version";
+	} else if ((int) header->dims != k) {
+		problem = "does not match the dimensions of the queries";
+	} else if (header->precision != PRECISION_DOUBLE
+			&& header->precision != PRECISION_FLOAT
+			&& header->precision != PRECISION_QUANT16) {
+		problem = "holds an unknown precision";
+	} else if (header->precision == PRECISION_DOUBLE
+			&& header->cordOffset == 0) {
+		problem = "holds no coordinates";
+	} else if (!sized || !sectionFits(header->nodeOffset, nodeBytes, size)
+			|| !sectionFits(header->cordOffset, cordBytes, size)
+			|| !sectionFits(header->indexOffset, indexBytes, size)
+			|| !sectionFits(header->compactOffset, codeBytes + copyBytes,
+					size) || !sectionFits(header->boxOffset, boxBytes, size)) {
+		problem = "is truncated";
+	} else if (!linksValid((const flatNode *) (base + header->nodeOffset),
+			header->nodeCount, header->pointCount, header->dims)) {
+		problem = "holds nodes that point outside the tree";
+	} else if (verify) {
+		//in the order writeBinary placed the sections
+		uint64_t sum = checksum64(base + header->nodeOffset, nodeBytes);
+		if (codeBytes == 0) {
+			sum = checksum64(base + header->cordOffset, cordBytes, sum);
+		}
+		sum = checksum64(base + header->indexOffset, indexBytes, sum);
+		if (codeBytes > 0) {
+			sum = checksum64(base + header->compactOffset, codeBytes, sum);
+			sum = checksum64(base + header->compactOffset + codeBytes,
+					copyBytes, sum);
+		}
+		if (boxBytes > 0) {
+			sum = checksum64(base + header->boxOffset, boxBytes, sum);
+		}
+		if (codeBytes > 0 && hasCords) {
+			sum = checksum64(base + header->cordOffset, cordBytes, sum);
+		}
+		if (sum != header->checksum) {
+			problem = "failed its checksum";
+		}
+	}
+	if (problem != nullptr) {
+		cout << "Binary tree file " << fileName << " " << problem << endl;
+		clear();
+		return false;
+	}
+
+	dims = header->dims;
+	leafSize = header->leafSize;
+	nodeData = (const flatNode *) (base + header->nodeOffset);
+	cordData = hasCords ? (const double *) (base + header->cordOffset) : nullptr;
+	indexData = (const int *) (base + header->indexOffset);
+	nodeTotal = header->nodeCount;
+	pointTotal = header->pointCount;
+	if (codeBytes > 0) {
+		precision = header->precision;
+		codeData = (const double *) (base + header->compactOffset);
+		const char * copy = base + header->compactOffset + codeBytes;
+		if (precision == PRECISION_FLOAT) {
+			floatData = (const float *) copy;
+		} else {
+			quantData = (const uint16_t *) copy;
+		}
+		exact = hasCords;
+		for (int d = 0; d < dims; d++) {
+			copyError += codeData[2 * dims + d] * codeData[2 * dims + d];
+		}
+		copyError = sqrt(copyError) * (1 + PRECISION_SLACK);
+		//searches read the doubles only at scattered candidates, reading
+		//ahead around them would pull in the whole section
+		uintptr_t page = sysconf(_SC_PAGESIZE);
+		uintptr_t first = ((uintptr_t) cordData + page - 1) / page * page;
+		uintptr_t last = ((uintptr_t) cordData + cordBytes) / page * page;
+		if (hasCords && last > first) {
+			madvise((void *) first, last - first, MADV_RANDOM);
+		}
+	}
+	//boxes are used only when the file carries them, building them here
+	//would read every point before the first query
+	if (boxesOn && boxBytes > 0) {
+		boxData = (const float *) (base + header->boxOffset);
+	}
+
+	return true;
+}
+
+//distance kernels, one lane per point so every lane sums the axes in the same
+//order as the scalar loop and the results are bit for bit identical. K is the
+//dimension when known at compile time so the axis loop unrolls, 0 reads dims
+template<int K>
+static void leafKernel(const double * query, const double * cords,
+		size_t stride, int count, int dims, double bound, double * out) {
+	const int D = K > 0 ? K : dims;
+	int i = 0;
+
+	//partial sums are checked against bound after every EARLY_EXIT_DIMS axes,
+	//which folds away for short fixed sums
+	auto checkAfter = [D](int d) {
+		return d % EARLY_EXIT_DIMS == EARLY_EXIT_DIMS - 1 && d + 1 < D;
+	};
+
+#if defined(__AVX512F__)
+	for (; i + 8 <= count; i += 8) {
+		__m512d sum = _mm512_setzero_pd();
+		for (int d = 0; d < D; d++) {
+			__m512d dif = _mm512_sub_pd(_mm512_set1_pd(query[d]),
+					_mm512_loadu_pd(cords + d * stride + i));
+			sum = _mm512_add_pd(sum, _mm512_mul_pd(dif, dif));
+			if (checkAfter(d) && _mm512_cmp_pd_mask(sum, _mm512_set1_pd(bound),
+					_CMP_LE_OQ) == 0) {
+				break; //every lane is already out
+			}
+		}
+		_mm512_storeu_pd(out + i, sum);
+	}
+#endif
+#if defined(__AVX2__)
+	for (; i + 4 <= count; i += 4) {
+		__m256d sum = _mm256_setzero_pd();
+		for (int d = 0; d < D; d++) {
+			__m256d dif = _mm256_sub_pd(_mm256_set1_pd(query[d]),
+					_mm256_loadu_pd(cords + d * stride + i));
+			sum = _mm256_add_pd(sum, _mm256_mul_pd(dif, dif));
+			if (checkAfter(d) && _mm256_movemask_pd(_mm256_cmp_pd(sum,
+					_mm256_set1_pd(bound), _CMP_LE_OQ)) == 0) {
+				break; //every lane is already out
+			}
+		}
+		_mm256_storeu_pd(out + i, sum);
+	}
+#endif
+
+	//scalar fallback and remainder
+	for (; i < count; i++) {
+		double sum = 0;
+		double dif = 0;
+		for (int d = 0; d < D; d++) {
+			dif = query[d] - cords[d * stride + i];
+			sum += dif * dif;
+			if (checkAfter(d) && sum > bound) {
+				break;
+			}
+		}
+		out[i] = sum;
+	}
+}
+
+void leafSquares(const double * query, const double * cords, size_t stride,
+		int count, int dims, double bound, double * out) {
+	switch (dims) {
+	case 1:
+		leafKernel<1>(query, cords, stride, count, dims, bound, out);
+		break;
+	case 2:
+		leafKernel<2>(query, cords, stride, count, dims, bound, out);
+		break;
+	case 3:
+		leafKernel<3>(query, cords, stride, count, dims, bound, out);
+		break;
+	case 4:
+		leafKernel<4>(query, cords, stride, count, dims, bound, out);
+		break;
+	case 5:
+		leafKernel<5>(query, cords, stride, count, dims, bound, out);
+		break;
+	case 6:
+		leafKernel<6>(query, cords, stride, count, dims, bound, out);
+		break;
+	case 7:
+		leafKernel<7>(query, cords, stride, count, dims, bound, out);
+		break;
+	case 8:
+		leafKernel<8>(query, cords, stride, count, dims, bound, out);
+		break;
+	default:
+		leafKernel<0>(query, cords, stride, count, dims, bound, out);
+	}
+}
+
+//pointBlock method definitions
+
+pointBlock::pointBlock() :
+		dims(0) {
+}
+
+int pointBlock::getDims() const {
+	return dims;
+}
+
+int pointBlock::getSize() const {
+	return dims > 0 ? cords.size() / dims : 0;
+}
+
+const double * pointBlock::getPoint(int i) const {
+	return &cords[(size_t) i * dims];
+}
+
+void pointBlock::assign(const double * data, int count, int k) {
+	dims = k;
+	cords.assign(data, data + (size_t) count * k);
+}
+
+//parses every line in [begin, end) into consecutive rows starting at firstRow,
+//cells are split exactly like getDataFile: the first dims - 1 cells end at a
+//comma, the last one runs to the end of the line
+void pointBlock::parseLines(const char * begin, const char * end,
+		size_t firstRow) {
+	double * row = &cords[firstRow * dims];
+	const char * line = begin;
+	while (line < end) {
+		const char * lineEnd = (const char *) memchr(line, '\n', end - line);
+		if (lineEnd == nullptr) {
+			lineEnd = end;
+		}
+		const char * cell = line;
+		for (int i = 0; i < dims; i++) {
+			const char * cellEnd = lineEnd;
+			if (i < dims - 1) {
+				const char * comma = (const char *) memchr(cell, ',',
+						lineEnd - cell);
+				if (comma != nullptr) {
+					cellEnd = comma;
+				}
+			}
+			row[i] = parseCell(cell, cellEnd);
+			cell = cellEnd < lineEnd ? cellEnd + 1 : lineEnd;
+		}
+		row += dims;
+		line = lineEnd + 1;
+	}
+}
+
+//count the lines in [begin, end), a last line without a newline still counts
+static size_t countLines(const char * begin, const char * end) {
+	size_t lines = 0;
+	const char * p = begin;
+	while (p < end) {
+		const char * next = (const char *) memchr(p, '\n', end - p);
+		lines++;
+		if (next == nullptr) {
+			break;
+		}
+		p = next + 1;
+	}
+	return lines;
+}
+
+//map the file, split it into chunks on line boundaries, count each chunk's
+//lines to find where its rows go and then parse every chunk in place
+int pointBlock::readFile(string const fileName, taskPool * pool) {
+
+	dims = 0;
+	vector<double>().swap(cords);
+
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if (fd < 0) {
+		cout << "Unable to open points file\n";
+		return -1;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		close(fd);
+		cout << "Could not count commas, file was empty";
+		return -1;
+	}
+	size_t size = info.st_size;
+	void * map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		cout << "Unable to open points file\n";
+		return -1;
+	}
+	madvise(map, size, MADV_SEQUENTIAL);
+	const char * data = (const char *) map;
+	const char * end = data + size;
+
+	//width comes from the commas in the first line
+	const char * firstEnd = (const char *) memchr(data, '\n', size);
+	if (firstEnd == nullptr) {
+		firstEnd = end;
+	}
+	dims = count(data, firstEnd, ',') + 1;
+
+	//chunk boundaries moved forward to the start of the next line
+	int chunks = pool == nullptr ? 1 : pool->getThreads() * 4;
+	vector<const char *> starts(chunks + 1);
+	starts[0] = data;
+	starts[chunks] = end;
+	for (int c = 1; c < chunks; c++) {
+		const char * guess = max(starts[c - 1], data + size * c / chunks);
+		const char * newline = (const char *) memchr(guess, '\n', end - guess);
+		starts[c] = newline ? newline + 1 : end;
+	}
+
+	vector<size_t> rows(chunks + 1, 0);
+	auto eachChunk = [pool, chunks](function<void(int)> body) {
+		if (pool == nullptr || chunks == 1) {
+			for (int c = 0; c < chunks; c++) {
+				body(c);
+			}
+		} else {
+			pool->parallelFor(chunks, chunks, [&body](size_t b, size_t e) {
+				for (size_t c = b; c < e; c++) {
+					body(c);
+				}
+			});
+		}
+	};
+
+	eachChunk([&](int c) {
+		rows[c + 1] = countLines(starts[c], starts[c + 1]);
+	});
+	for (int c = 0; c < chunks; c++) {
+		rows[c + 1] += rows[c];
+	}
+
+	cords.resize(rows[chunks] * dims);
+	eachChunk([&](int c) {
+		parseLines(starts[c], starts[c + 1], rows[c]);
+	});
+
+	munmap(map, size);
+	return dims;
+}
+
+//from_chars and atof both round correctly, so they agree whenever from_chars
+//takes the whole cell. anything else (signs, spaces, hex, out of range, text
+//after the number) goes to atof itself
+double parseCell(const char * begin, const char * end) {
+	const char * last = end;
+	if (last > begin && last[-1] == '\r') { //windows line endings
+		last--;
+	}
+	double val = 0;
+	from_chars_result result = from_chars(begin, last, val);
+	if (result.ec == errc() && result.ptr == last) {
+		return val;
+	}
+	string cell(begin, end);
+	return atof(cell.c_str());
+}
+
+//resultWriter method definitions
+
+resultWriter::resultWriter() :
+		file(nullptr), closing(false), failed(false) {
+}
+
+bool resultWriter::open(const string fileName) {
+	close();
+	file = fopen(fileName.c_str(), "wb");
+	if (file == nullptr) {
+		return false;
+	}
+	closing = false;
+	failed = false;
+	worker = thread(&resultWriter::writeLoop, this);
+	return true;
+}
+
+void resultWriter::writeLoop() {
+	unique_lock<mutex> hold(lock);
+	while (true) {
+		changed.wait(hold, [this]() {
+			return closing || !blocks.empty();
+		});
+		if (blocks.empty()) {
+			return;
+		}
+		//the block stays queued while it is written so write() counts it
+		string& text = blocks.front();
+		hold.unlock();
+		bool written = failed
+				|| fwrite(text.data(), 1, text.size(), file) == text.size();
+		hold.lock();
+		failed = !written;
+		blocks.pop_front();
+		changed.notify_all();
+	}
+}
+
+void resultWriter::write(string&& text) {
+	unique_lock<mutex> hold(lock);
+	changed.wait(hold, [this]() {
+		return blocks.size() < RESULT_QUEUE;
+	});
+	blocks.push_back(move(text));
+	changed.notify_all();
+}
+
+bool resultWriter::close() {
+	if (file == nullptr) {
+		return false;
+	}
+	{
+		lock_guard<mutex> hold(lock);
+		closing = true;
+		changed.notify_all();
+	}
+	worker.join();
+	bool ok = !failed && fclose(file) == 0;
+	file = nullptr;
+	return ok;
+}
+
+resultWriter::~resultWriter() {
+	close();
+}
+
+//helper functions
+
+//to_chars with a precision formats exactly like printf %.*g, which is what
+//ostream uses for its default float format
+void appendDouble(string& out, double value) {
+	char text[32];
+	to_chars_result result = to_chars(text, text + sizeof(text), value,
+			chars_format::general, dbl::max_digits10);
+	out.append(text, result.ptr);
+}
+
+void appendInt(string& out, int value) {
+	char text[16];
+	to_chars_result result = to_chars(text, text + sizeof(text), value);
+	out.append(text, result.ptr);
+}
+
+//returns the number of dimensions by determining how many commas are in csv
+int countDims(string const fileName) {
+	ifstream myfile(fileName);
+	string line;
+	if (myfile.is_open()) {
+		if (getline(myfile, line)) { //get every point
+			size_t n = std::count(line.begin(), line.end(), ',');
+			return n + 1; //last point will have comma afterwards
+		}
+		cout << "Could not count commas, file was empty";
+		return -1;
+	} else {
+		cout << "Could not count commas, file failed to open\n";
+	}
+	return -1;
+}
+
+//FNV-1a over 64 bit words, any tail shorter than a word is hashed byte by byte
+uint64_t checksum64(const void * data, size_t bytes, uint64_t seed) {
+	const uint64_t prime = 1099511628211ULL;
+	const unsigned char * p = (const unsigned char *) data;
+	uint64_t hash = seed;
+	size_t i = 0;
+	for (; i + 8 <= bytes; i += 8) {
+		uint64_t word;
+		memcpy(&word, p + i, 8);
+		hash = (hash ^ word) * prime;
+	}
+	for (; i < bytes; i++) {
+		hash = (hash ^ p[i]) * prime;
+	}
+	return hash;
+}
+
+//checks the first bytes of a file for the binary tree magic
+bool isBinaryTree(const string fileName) {
+	char magic[8] = { 0 };
+	ifstream myfile(fileName, ios::binary);
+	if (!myfile.is_open() || !myfile.read(magic, sizeof(magic))) {
+		return false;
+	}
+	return memcmp(magic, TREE_FILE_MAGIC, sizeof(TREE_FILE_MAGIC)) == 0;
+}
+
+//hilbert keys use the transpose form of J. Skilling, "Programming the Hilbert
+//curve" (2004): the axis values are turned in place so interleaving their
+//bits afterwards gives the hilbert index, morton keys interleave them as is
+uint64_t curveKey(const double * point, const double * low,
+		const double * high, int dims, int curve) {
+	int axes = min(dims, 64);
+	int bits = min(CURVE_BITS, 64 / axes);
+	uint32_t top = (1u << bits) - 1;
+	uint32_t cells[64];
+	for (int d = 0; d < axes; d++) {
+		double range = high[d] - low[d];
+		double step = range > 0 ? (point[d] - low[d]) / range * top : 0;
+		cells[d] = step > 0 ? (step < top ? (uint32_t) step : top) : 0;
+	}
+
+	if (curve == CURVE_HILBERT && bits > 1) {
+		//the first axis is changed by every step, so it is kept out of the array
+		uint32_t first = cells[0];
+		for (int b = bits - 1; b > 0; b--) { //inverse undo
+			uint32_t q = 1u << b;
+			uint32_t p = q - 1;
+			first ^= p & (0 - ((first >> b) & 1));
+			for (int d = 1; d < axes; d++) { //invert if the bit is set, else exchange
+				uint32_t cur = cells[d];
+				uint32_t set = 0 - ((cur >> b) & 1);
+				uint32_t t = (first ^ cur) & p & ~set;
+				first ^= (p & set) ^ t;
+				cells[d] = cur ^ t;
+			}
+		}
+		cells[0] = first;
+		for (int d = 1; d < axes; d++) { //gray encode
+			cells[d] ^= cells[d - 1];
+		}
+		uint32_t t = 0;
+		for (int b = bits - 1; b > 0; b--) {
+			t ^= ((cells[axes - 1] >> b) & 1) ? (1u << b) - 1 : 0;
+		}
+		for (int d = 0; d < axes; d++) {
+			cells[d] ^= t;
+		}
+	}
+
+	uint64_t key = 0;
+	for (int b = bits - 1; b >= 0; b--) {
+		for (int d = 0; d < axes; d++) {
+			key = (key << 1) | ((cells[d] >> b) & 1);
+		}
+	}
+	return key;
+}
+
+void curveOrder(const double * rows, int count, int dims, int curve,
+		vector<int>& order) {
+	order.resize(count);
+	if (count < 1) {
+		return;
+	}
+	vector<double> low(rows, rows + dims);
+	vector<double> high(rows, rows + dims);
+	for (int i = 1; i < count; i++) {
+		for (int d = 0; d < dims; d++) {
+			low[d] = min(low[d], rows[(size_t) i * dims + d]);
+			high[d] = max(high[d], rows[(size_t) i * dims + d]);
+		}
+	}
+	vector<pair<uint64_t, int> > keyed(count);
+	for (int i = 0; i < count; i++) {
+		keyed[i] = make_pair(
+				curveKey(rows + (size_t) i * dims, &low[0], &high[0], dims, curve),
+				i);
+	}
+	sort(keyed.begin(), keyed.end());
+	for (int i = 0; i < count; i++) {
+		order[i] = keyed[i].second;
+	}
+}
+
+string curveName(int curve) {
+	if (curve == CURVE_MORTON) {
+		return "morton";
+	}
+	if (curve == CURVE_HILBERT) {
+		return "hilbert";
+	}
+	return "none";
+}
+
+int curveValue(const string name) {
+	if (name == "none") {
+		return CURVE_NONE;
+	}
+	if (name == "morton") {
+		return CURVE_MORTON;
+	}
+	if (name == "hilbert") {
+		return CURVE_HILBERT;
+	}
+	return -1;
+}
+
+string precisionName(int precision) {
+	if (precision == PRECISION_FLOAT) {
+		return "float";
+	}
+	if (precision == PRECISION_QUANT16) {
+		return "quant16";
+	}
+	return "double";
+}
+
+int precisionValue(const string name) {
+	if (name == "double") {
+		return PRECISION_DOUBLE;
+	}
+	if (name == "float") {
+		return PRECISION_FLOAT;
+	}
+	if (name == "quant16") {
+		return PRECISION_QUANT16;
+	}
+	return -1;
+}
+
+//compares contents of two files and returns if they are identical
+//based on the code published at http://stackoverflow.com/questions/6163611/compare-two-files
+//by username Christoph
+bool compareFile(FILE* file_compared, FILE* file_checked) {
+	bool diff = 0;
+	int N = 65536;
+	char* b1 = (char*) calloc(1, N + 1);
+	char* b2 = (char*) calloc(1, N + 1);
+	size_t s1, s2;
+
+	do {
+		s1 = fread(b1, 1, N, file_compared);
+		s2 = fread(b2, 1, N, file_checked);
+
+		if (s1 != s2 || memcmp(b1, b2, s1)) {
+			diff = 1;
+			break;
+		}
+	} while (!feof(file_compared) || !feof(file_checked));
+
+	free(b1);
+	free(b2);
+
+	if (diff)
+		return false;
+	else
+		return true;
+}
+
+//read in data from csv and create vector of points of n dimensions
+//returns number of dimensions normally, or -1 if unsucessful
+int getDataFile(string const fileName, vector<nPoint*>& pointVector) {
+	std::string line;
+	double * pCords;
+
+	int k = 0;
+	int rows = 0;
+
+	ifstream myfile(fileName);
+	if (myfile.is_open()) {
+		string cell;
+		const char* ch;
+		double val;
+
+		while (getline(myfile, line)) { //get every point
+
+			if (k == 0) { // first time determine width, initializes sums
+				k = countDims(fileName);
+			}
+			pCords = new double[k];
+
+			stringstream lineStream(line);
+
+			for (int i = 0; i < k; i++) {
+				if (i < k - 1)	//get every value except last, stop at comma
+					getline(lineStream, cell, ',');
+				else
+					getline(lineStream, cell);
+
+				ch = cell.c_str();
+				val = atof(ch);
+				pCords[i] = val;
+			}
+
+			pointVector.push_back(new nPoint(rows, k, pCords));
+			rows++;
+		}
+
+		myfile.close();
+		return k; //return number of dimensions
+
+	} else {
+		cout << "Unable to open points file\n";
+		return -1;
+	}
+}
+
+//used to determine the dimension with largest range, used for tree building
+//returns int corresponding to dimension with largest range
+int findLargestRange(vector<nPoint*> const & points, int const totalDepth) {
+	return findLargestRange(points.begin(), points.end(), totalDepth);
+}
+
+int findLargestRange(vector<nPoint*>::const_iterator first,
+		vector<nPoint*>::const_iterator last, int const totalDepth) {
+
+	//min and max of every axis in one pass over the points
+	double stackBounds[2 * BOUNDS_STACK_DIMS];
+	vector<double> heapBounds;
+	double * low = stackBounds;
+	if (totalDepth > BOUNDS_STACK_DIMS) {
+		heapBounds.resize(2 * (size_t) totalDepth);
+		low = &heapBounds[0];
+	}
+	double * high = low + totalDepth;
+
+	const double * cord = (*first)->getCords();
+	for (int i = 0; i < totalDepth; i++) {
+		low[i] = high[i] = cord[i];
+	}
+	for (auto p = first + 1; p < last; p++) {
+		cord = (*p)->getCords();
+		for (int i = 0; i < totalDepth; i++) {
+			low[i] = cord[i] < low[i] ? cord[i] : low[i];
+			high[i] = cord[i] > high[i] ? cord[i] : high[i];
+		}
+	}
+	return widestAxis(low, high, totalDepth);
+}
+
+//axis with the largest high - low, -1 if every axis has zero range
+int widestAxis(const double * low, const double * high, int dims) {
+	double maxDif = 0;
+	int retVal = -1;
+	for (int i = 0; i < dims; i++) {
+		if (high[i] - low[i] > maxDif) {
+			maxDif = high[i] - low[i];
+			retVal = i;
+		}
+	}
+	return retVal;
+}
+
+//min and max with the dimension known at compile time, 0 reads it from dims.
+//points are rows of the block, so with a fixed D each row is a few vector
+//min/max instructions
+template<int D>
+static void boundsKernel(const int * first, const int * last,
+		const double * work, int dims, double * low, double * high) {
+	const int k = D > 0 ? D : dims;
+	const double * cord = work + (size_t) *first * k;
+	for (int d = 0; d < k; d++) {
+		low[d] = high[d] = cord[d];
+	}
+	for (const int * p = first + 1; p < last; p++) {
+		cord = work + (size_t) *p * k;
+		for (int d = 0; d < k; d++) {
+			low[d] = cord[d] < low[d] ? cord[d] : low[d];
+			high[d] = cord[d] > high[d] ? cord[d] : high[d];
+		}
+	}
+}
+
+void axisBounds(const int * first, const int * last, const double * work,
+		int dims, double * low, double * high) {
+	switch (dims) {
+	case 1:
+		boundsKernel<1>(first, last, work, dims, low, high);
+		break;
+	case 2:
+		boundsKernel<2>(first, last, work, dims, low, high);
+		break;
+	case 3:
+		boundsKernel<3>(first, last, work, dims, low, high);
+		break;
+	case 4:
+		boundsKernel<4>(first, last, work, dims, low, high);
+		break;
+	case 5:
+		boundsKernel<5>(first, last, work, dims, low, high);
+		break;
+	case 6:
+		boundsKernel<6>(first, last, work, dims, low, high);
+		break;
+	case 7:
+		boundsKernel<7>(first, last, work, dims, low, high);
+		break;
+	case 8:
+		boundsKernel<8>(first, last, work, dims, low, high);
+		break;
+	default:
+		boundsKernel<0>(first, last, work, dims, low, high);
+	}
+}
+
+//used to determine the dimension with largest range for the flat tree build
+//returns int corresponding to dimension with largest range
+int findLargestRange(const int * first, const int * last,
+		const double * work, int const totalDepth) {
+
+	double stackBounds[2 * BOUNDS_STACK_DIMS];
+	vector<double> heapBounds;
+	double * low = stackBounds;
+	if (totalDepth > BOUNDS_STACK_DIMS) {
+		heapBounds.resize(2 * (size_t) totalDepth);
+		low = &heapBounds[0];
+	}
+	double * high = low + totalDepth;
+
+	axisBounds(first, last, work, totalDepth, low, high);
+	return widestAxis(low, high, totalDepth);
+}
@@ -34,6 +34,7 @@
 #include <vector>
 #include <algorithm>
 #include <cfloat>
+#include <climits>
 #include <list>
 #include <stdio.h>
 #include <math.h>
@@ -42,20 +43,70 @@
 #include <limits>
 #include <cstdio>
 #include <cstring>
+#include <atomic>
+#include <unordered_map>
+#include <stdint.h>
+#include <new>
+#include "taskPool.h"
 
 //constants
 #define AXIS_METHOD 0
 #define MEDIAN_METHOD 0
 #define BRUTE 0
+#define TASK_CUTOFF 32768			//smallest range handed to another task in parallel builds
+#define PARTITION_CUTOFF 1048576	//smallest range split with the stable parallel partition
+#define QUERY_CHUNK 1024			//queries per task in batch searches
+#define BOUNDS_STACK_DIMS 16		//axis bounds for up to this many dimensions live on the stack
+#define SEARCH_STACK 64				//deferred subtrees held by the iterative search
+#define EARLY_EXIT_DIMS 4			//axes summed between checks against the best distance
+#define PACKET_LANES 16				//most queries walked together by packet searches
+#define ARENA_BLOCK 1048576			//default bytes in each nodeArena block
+#define RESULT_QUEUE 4				//blocks a resultWriter holds before write waits
+
+//split strategies, passed as axisMode
+#define SPLIT_ROTATE 0		//rotate through the axes, split at the median
+#define SPLIT_RANGE 1		//axis with the largest range, split at the median
+#define SPLIT_VARIANCE 2	//axis with the largest variance, split at the median
+#define SPLIT_MIDPOINT 3	//middle of the largest range, slid onto the nearest point
+							//when one side would be empty
+#define SPLIT_COST 4		//split with the lowest estimated query cost
+#define SPLIT_BINS 16		//candidate planes per axis tried by SPLIT_COST
+#define SPLIT_LEVELS 32		//below this level every strategy splits at the median,
+							//which keeps trees under SEARCH_STACK levels
+
+//dynamic updates
+#define TOMBSTONE INT_MIN		//index of a slot that holds no point
+#define REBUILD_BALANCE 0.7		//rebuild a subtree once one child holds more than
+								//this share of its points
+#define REBUILD_DEAD 0.5		//rebuild a subtree once this share of its points
+								//are deleted
+
+//precision the coordinates are stored at, passed to setPrecision. a reduced
+//precision copy is searched first and the doubles settle the answers, unless
+//setExactCords(false) drops them for approximate searches
+#define PRECISION_DOUBLE 0	//double coordinates
+#define PRECISION_FLOAT 1	//float coordinates
+#define PRECISION_QUANT16 2	//16 bit coordinates, scaled and offset per axis
+#define PRECISION_SLACK 1e-9	//share added to compact distance bounds so
+								//rounding never takes them past the true distance
+
+//space filling curves, passed to setQueryOrder and setCurveLayout
+#define CURVE_NONE 0		//input order
+#define CURVE_MORTON 1		//z-order, the bits of every axis interleaved
+#define CURVE_HILBERT 2		//hilbert order, consecutive cells always share a face
+#define CURVE_BITS 21		//most bits per axis in a curve key
 
 class treeNode;
+class flatTree;
+class pointBlock;
+class nodeArena;
 using namespace std;
 
 typedef std::numeric_limits<double> dbl;
 
 //used to compare points by a specified dimension in sorting algorithims
 template<typename T>
-struct Sort: std::binary_function<T, T, bool> {
+struct Sort {
 	Sort(int dim) :
 			d(dim) {
 	}
@@ -72,6 +123,10 @@ protected:
 	int dims;
 	double* cords;
 
+	//recursive search called by findNear, works in squared distance
+	void nearRecur(const treeNode* tree, nPoint*& bestPoint,
+			double& bestSquare) const;
+
 public:
 	//constructor to initialize class nPoint
 	nPoint(int i = 0, int d = 0, double * c = nullptr);
@@ -91,9 +146,16 @@ public:
 	//get absolute distance between two points
 	double getAbDist(const nPoint* B) const;
 
+	//squared distance, dimensions are not checked
+	double getSqDist(const nPoint* B) const;
+
 	//nearest neighbor algorithm
 	void findNear(const treeNode* tree, nPoint*& bestPoint,
-			double& bestDistance, const int k) const;
+			double& bestDistance) const;
+
+	//nearest neighbor algorithm for the flat tree layout, returns the point slot
+	void findNear(const flatTree* tree, int& bestSlot,
+			double& bestDistance) const;
 
 	~nPoint();
 };
@@ -122,10 +184,16 @@ public:
 
 	treeNode* getRight() const;
 
-	//recursively build tree
+	//build tree, points is copied once and partitioned in place
 	treeNode * makeTree(vector<nPoint*> points, int dIndex,
 			int const totalDepth, int axisMode);
 
+	//recursively build tree over a range of the shared points array, children
+	//come from arena when one is given
+	treeNode * makeTree(vector<nPoint*>::iterator first,
+			vector<nPoint*>::iterator last, int dIndex, int const totalDepth,
+			int axisMode, nodeArena * arena = nullptr);
+
 	//recursive function called by writeOut
 	void wRecur(const string fileName, const int totalDim, ofstream& stream,
 			int totalNodes) const;
@@ -135,7 +203,7 @@ public:
 
 	//recursive function called by readTree
 	treeNode * recurIn(stringstream& stream, int totalNodes,
-			const int totalDim);
+			const int totalDim, nodeArena * arena = nullptr);
 
 	//read in and build tree from external file
 	treeNode* readTree(const string fileName, const int k);
@@ -143,6 +211,723 @@ public:
 	~treeNode();
 };
 
+//bump allocator handing out memory from a few large blocks, everything it
+//handed out is released at once by clear or the destructor. destructors of
+//objects made in the arena are never run
+class nodeArena {
+protected:
+	vector<char*> blocks;
+	size_t blockSize;	//bytes in each new block
+	size_t used;		//bytes taken from the last block
+	size_t last;		//size of the last block
+	size_t total;		//bytes held in all blocks
+
+public:
+	nodeArena(size_t blockSize = ARENA_BLOCK);
+
+	//start a block of at least bytes so the next bytes worth of requests
+	//come from one allocation
+	void reserve(size_t bytes);
+
+	//raw memory of bytes aligned to align, a power of two
+	void * take(size_t bytes, size_t align);
+
+	//construct an object in the arena
+	template<typename T, typename ... Args>
+	T * make(Args&&... args) {
+		return new (take(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	}
+
+	//uninitialized array of k coordinates
+	double * makeCords(int k);
+
+	//bytes held in blocks
+	size_t getBytes() const;
+
+	//free every block
+	void clear();
+
+	nodeArena(const nodeArena&) = delete;
+	nodeArena& operator=(const nodeArena&) = delete;
+
+	~nodeArena();
+};
+
+//treeNode tree whose nodes, points and coordinates all live in one nodeArena,
+//so it is built without an allocation per node and freed in O(blocks). the
+//nodes are ordinary treeNodes and work with every treeNode search
+class arenaTree {
+protected:
+	nodeArena arena;
+	treeNode * root;
+	int dims;
+
+public:
+	arenaTree();
+
+	//build from points, which are copied into the arena and stay owned by
+	//the caller. returns the root or nullptr on failure
+	treeNode * makeTree(const vector<nPoint*>& points, int const totalDepth,
+			int axisMode);
+
+	//read a tree written by treeNode::writeOut
+	treeNode * readTree(const string fileName, const int k);
+
+	treeNode * getRoot() const;
+
+	int getDims() const;
+
+	//bytes held by the arena
+	size_t getBytes() const;
+
+	//release the whole tree
+	void clear();
+};
+
+//node for the flat k-d tree, split axis and value packed into 16 bytes
+struct flatNode {
+	double val;		//split value, leaves keep the coordinate written to file
+	int child;		//internal: index of left child, right child is child + 1
+					//leaf: slot of the first point in the leaf
+	short axis;		//split axis
+	unsigned short count;	//number of points in a leaf, 0 for internal nodes
+};
+
+//fixed size max-heap of the closest candidates found so far, the storage is
+//kept between queries so a search never allocates
+class nearHeap {
+protected:
+	int capacity;
+	int size;
+	double ceiling;		//bound until the heap is full, farther candidates are dropped
+	vector<double> distances;
+	vector<int> slots;
+
+	void siftDown(int i);
+
+public:
+	nearHeap(int capacity = 1);
+
+	//empty the heap and set how many candidates it keeps, only grows storage.
+	//candidates farther than ceiling are never kept
+	void reset(int capacity, double ceiling = INFINITY);
+
+	int getSize() const;
+
+	int getCapacity() const;
+
+	//distance a candidate has to beat to get in, the ceiling or DBL_MAX
+	//until the heap is full
+	double bound() const;
+
+	//keep a candidate if it is closer than the worst one held
+	void offer(double distance, int slot);
+
+	//order the candidates closest first, the heap is no longer valid afterwards
+	void sortResults();
+
+	//replace every held distance by its square root, searches fill the heap
+	//with squared distances and call this once at the end
+	void takeRoots();
+
+	//slot and distance of the i-th candidate
+	int getSlot(int i) const;
+
+	double getDistance(int i) const;
+};
+
+//largest number of points a leaf can hold
+#define MAX_LEAF_SIZE 65535
+
+//binary tree file: this header, then the node, coordinate and index sections
+//and for reduced precision the compact section, each starting on a multiple
+//of 64 bytes. sections hold the exact bytes of
+//the flatTree arrays (native byte order) so the file can be mapped and
+//searched in place. a reduced precision file keeps its doubles only when
+//they were kept in the tree, as the last section so searches that never
+//read them never touch their pages
+#define TREE_FILE_MAGIC "KDTREEB"
+#define TREE_FILE_VERSION 1
+
+struct treeFileHeader {
+	char magic[8];			//TREE_FILE_MAGIC
+	uint32_t version;		//TREE_FILE_VERSION
+	uint32_t dims;
+	uint64_t nodeCount;
+	uint64_t pointCount;
+	uint32_t leafSize;
+	uint32_t precision;		//PRECISION_ of the compact section, 0 when absent
+	uint64_t checksum;		//checksum64 of every section in file order
+	uint64_t nodeOffset;	//byte offsets of the sections from the start of the file
+	uint64_t cordOffset;	//0 for reduced precision without the doubles
+	uint64_t indexOffset;
+	uint64_t compactOffset;	//scale, offset and error per axis as doubles, then
+							//the compact coordinates, 0 for PRECISION_DOUBLE
+	uint64_t boxOffset;		//float bounding box of every node, 0 when absent
+	uint64_t reserved[5];	//pads the header to 128 bytes
+};
+
+static_assert(sizeof(flatNode) == 16, "flatNode is written to file byte for byte");
+static_assert(sizeof(treeFileHeader) == 128, "treeFileHeader must stay 128 bytes");
+
+//work done by one search
+struct searchStats {
+	long nodes;		//nodes entered, leaves included
+	long leaves;	//leaves scanned
+
+	searchStats() :
+			nodes(0), leaves(0) {
+	}
+};
+
+//k-d tree stored as one contiguous node array and one contiguous coordinate
+//block, children are linked by index instead of by pointer
+class flatTree {
+protected:
+	int dims;
+	int leafSize;
+	vector<flatNode> nodes;	//root at 0, sibling pairs stored next to each other
+	vector<double> cords;	//leaf coordinates in leaf order, structure of arrays:
+							//all values for axis 0, then all values for axis 1...
+	vector<int> indices;	//original index of the point held in each slot
+	int taskCutoff;
+	int partitionCutoff;
+	bool boxesOn;			//record bounding boxes in builds and text reads, use
+							//those a binary tree file carries
+	vector<float> boxes;	//per node: dims lower bounds then dims upper bounds,
+							//rounded outward to float, empty when not recorded
+
+	int axisMode;			//split strategy of the last build, reused by updates
+
+	//reduced precision copy of the coordinates, same layout as cords. it is
+	//what searches measure, and unless the doubles are kept it replaces them:
+	//cords is emptied and the split values are rounded like the coordinates,
+	//which keeps every point on its side of the split
+	int precisionMode;		//precision of later builds and text reads
+	int precision;			//precision of the current tree
+	bool exactMode;			//keep the doubles in later builds and double text reads
+	bool exact;				//the current tree keeps its doubles
+	vector<float> floatCords;	//PRECISION_FLOAT copy
+	vector<uint16_t> quantCords;	//PRECISION_QUANT16 copy
+	vector<double> codes;	//per axis: scale, then offset, then largest error
+	double copyError;		//largest distance between a point and its copy
+
+	int queryCurve;			//CURVE_ order batch searches run their queries in
+	int packetSize;			//queries walked together by batch searches
+	int layoutCurve;		//CURVE_ order of nodes and leaves in later builds
+
+	//bookkeeping for insert and remove, empty until the first update. slots
+	//between pointTotal and the end of indices are spare capacity, and
+	//rebuilt subtrees leave their old nodes and slots behind until compact()
+	vector<int> parents;	//parent of every node, -1 for the root
+	vector<int> weights;	//slots under every node, deleted ones included
+	vector<int> deadWeights;	//deleted slots under every node
+	vector<int> slotLeaf;	//leaf holding every slot, -1 for unused slots
+	unordered_map<int, int> slotOf;	//slot of every stored index
+	bool updated;			//insert or remove ran since the last build, read or compact
+	int liveTotal;			//points stored
+	int usedSlots;			//slots handed out so far, the rest are spare
+
+	//what searches read: either the vectors above or a mapped tree file
+	const flatNode * nodeData;
+	const double * cordData;
+	const int * indexData;
+	const float * floatData;	//compact views, nullptr when not in use
+	const uint16_t * quantData;
+	const double * codeData;
+	const float * boxData;		//bounding boxes, nullptr when not in use
+	size_t nodeTotal;
+	size_t pointTotal;
+	void * mapping;			//mapped tree file, nullptr when the vectors are used
+	size_t mappingSize;
+
+	//point the views at the vectors after building or reading
+	void useOwned();
+
+	//map a binary tree file, returns false if it is not a valid tree file
+	bool mapTree(const string fileName, const int k, bool verify);
+
+	//state shared by every task of one build
+	struct buildState {
+		int * base;			//shared order array
+		int * scratch;		//buffer for the stable partition, same size as order
+		const double * work;	//row-major coordinates indexed by order entries
+		int totalDepth;
+		int axisMode;
+		taskPool * pool;	//nullptr for sequential builds
+		taskGroup * group;
+		atomic<int> nextNode;	//next free node, children are allocated in pairs
+	};
+
+	//pointer to the values of one axis for every slot
+	const double * axisCords(int dim) const;
+
+	//build from row-major coordinates, ids gives the index of every row or is
+	//nullptr when the row number is the index
+	flatTree * build(const double * work, const int * ids, int n,
+			int const totalDepth, int axisMode, int leafSize, taskPool * pool);
+
+	//recursive build over a range of the shared order array, level counts
+	//the splits above the range
+	void buildRecur(int * first, int * last, int dIndex, int level, int node,
+			buildState& state);
+
+	//axis and number of points going left for the variance, midpoint and cost
+	//strategies, returns false if every point of the range is identical
+	bool chooseSplit(const int * first, const int * last, int axisMode,
+			buildState& state, int& axis, int& leftCount) const;
+
+	//axis with the largest range, split across the pool for large ranges
+	int rangeAxis(int * first, int * last, buildState& state) const;
+
+	//deterministic replacement for nth_element on large ranges: stable three
+	//way partition around the middle-th value, chunks run in parallel
+	void splitRange(int * first, int * last, int middle, int axis,
+			buildState& state) const;
+
+	//put nodes in the order a sequential build allocates them
+	void renumber();
+
+	//put nodes and leaf points in layoutCurve order: sibling pairs and slots
+	//are handed out depth first, entering the child whose leaves come first
+	//on the curve first. searches give the same answers in any layout
+	void curveLayout();
+
+	//far child put aside by the iterative searches, with the squared distance
+	//from the query to its cell: the distance to the parent's cell with the
+	//split axis term replaced by the distance to the splitting plane
+	struct deferredNode {
+		double square;
+		int node;
+		bool inclusive;	//left children also hold points on the plane
+		int axis;		//split axis of the parent
+		double offset;	//distance from the query to the splitting plane
+		int undone;		//axis offsets recorded when it was put aside
+	};
+
+	//squared distance from a query to the cell of the node a search is in,
+	//with the per axis offsets it is made of. entering a far child logs the
+	//offset it replaces so the next far child restores the path it is on
+	struct cellDistance {
+		int dims;
+		double * offsets;	//distance to the cell on every axis
+		double stackOffsets[BOUNDS_STACK_DIMS];
+		vector<double> heapOffsets;	//for more than BOUNDS_STACK_DIMS axes
+		int logAxis[SEARCH_STACK];
+		double logOffset[SEARCH_STACK];
+		int logged;
+		double square;		//of the current node
+		double shrink;		//safety factor for rounding, bounds are multiplied by it
+
+		cellDistance(int dims);
+
+		//cell distance of the far child split at offset on axis
+		double farSquare(int axis, double offset) const;
+
+		//log position to hand enter once the far child comes off the stack
+		int mark() const;
+
+		//move to a far child put aside at log position undone
+		void enter(int undone, int axis, double offset, double farSquare);
+	};
+
+	//child put aside by nearPacket with the lanes that may still need it,
+	//near holds those for which it is the near side
+	struct packetNode {
+		int node;
+		int parent;
+		uint32_t mask;
+		uint32_t near;
+	};
+
+	//walk the tree once for lanes queries. cords holds PACKET_LANES queries
+	//as dims rows for the lane loops, queries points at each one, and the
+	//best arrays have PACKET_LANES entries. a lane takes part in a subtree
+	//until its plane or box is farther than the lane's own best. ties gets
+	//the lanes that met another point at their best distance, findNear may
+	//pick a different one of those
+	void nearPacket(const double * const * queries, const double * cords,
+			int lanes, int * bestSlots, double * bestSquares,
+			uint32_t& ties) const;
+
+	//recursive search called by findNearRecursive, works in squared distance.
+	//settle measures with the doubles, see scanLeaf
+	void nearRecur(const double * query, int node, int& bestSlot,
+			double& bestSquare, bool settle) const;
+
+	//iterative search called by nearSearch, visits nodes in the same order as
+	//nearRecur keeping deferred far children on a fixed size stack. a far child
+	//is entered only while its plane distance squared times scale is below the
+	//best, and the walk ends after maxLeaves leaves. with bounding boxes a
+	//far child the cell distance cannot rule out is measured by its box
+	void nearIter(const double * query, int& bestSlot, double& bestSquare,
+			double scale, int maxLeaves, searchStats * stats,
+			bool settle) const;
+
+	//nearest neighbor walk behind every findNear. a compact copy with the
+	//doubles kept is walked twice: over the copy, which caps the distance of
+	//the true nearest, then settling every point within that cap on the
+	//doubles. both walks visit the nodes of a double tree in its order and the
+	//second finds the first point at the smallest distance as it does, so
+	//exact answers are the same. an approximate search settles only its answer
+	void nearSearch(const double * query, int& bestSlot, double& bestSquare,
+			double scale, int maxLeaves, searchStats * stats) const;
+
+	//square widened by copyError: no point the copy puts within square is
+	//truly farther, and no point truly within square is farther on the copy
+	double settleSquare(double square) const;
+
+	//fill boxes from the leaves up, children always follow their parent
+	void makeBoxes();
+
+	//encode the coordinates at the current precision, dropping the doubles
+	//unless exact
+	void makeCompact();
+
+	//a value rounded the way the compact copy stores axis dim
+	double compactValue(int dim, double value) const;
+
+	//value the compact copy holds for one axis of a slot
+	double compactCord(int dim, int slot) const;
+
+	//bytes of the compact copy of the coordinates, codes excluded
+	size_t compactBytes() const;
+
+	//squared distances from query to count slots from first measured on the
+	//compact copy, the axes summed in the order leafSquares sums them
+	void compactSquares(const double * query, int first, int count,
+			double * out) const;
+
+	//squared distance from query to the bounding box of node, 0 inside it
+	double boxSquare(const double * query, int node) const;
+
+	//recursive search called by findKNearRecursive
+	void kNearRecur(const double * query, int node, nearHeap& heap,
+			bool settle) const;
+
+	//iterative search called by findKNear
+	void kNearIter(const double * query, nearHeap& heap, bool settle) const;
+
+	//walk every subtree the radius reaches, slots within it are appended to
+	//found unless it is nullptr, returns how many there were
+	int rangeSearch(const double * query, int node, double radiusSquare,
+			vector<int> * found) const;
+
+	//set up the update bookkeeping, mapped trees are copied into memory first.
+	//returns false if the tree holds an index twice
+	bool startUpdates();
+
+	//replace the subtree at node by one built over count row-major points with
+	//the given indices, or remove it when count is 0
+	void rebuildSubtree(int node, const double * rows, const int * ids,
+			int count);
+
+	//append the coordinates and indices of the points under node to rows and
+	//ids, deleted points are left out
+	void gatherLive(int node, vector<double>& rows, vector<int>& ids) const;
+
+	//hand out count consecutive unused slots, growing the capacity as needed
+	int takeSlots(int count);
+
+	//bounding box of one node from its points or its children
+	void boxNode(int node);
+
+	//squeeze out garbage once it outweighs the live tree
+	void collectGarbage();
+
+	//recursive function called by writeOut
+	void wRecur(ofstream& stream, int node) const;
+
+	//recursive function called by readTree, returns false on malformed input
+	bool recurIn(const char *& cursor, const char * end, int node,
+			vector<double>& rows);
+
+	//check every point of a leaf against the current best squared distance,
+	//measured on the compact copy when there is one. settle measures with the
+	//doubles instead, and only the points the copy cannot rule out
+	void scanLeaf(const double * query, const flatNode& leaf, int& bestSlot,
+			double& bestSquare, bool settle) const;
+
+	//offer every point of a leaf to the heap
+	void scanLeaf(const double * query, const flatNode& leaf, nearHeap& heap,
+			bool settle) const;
+
+public:
+	flatTree();
+
+	//trees may own a file mapping, so they are not copied
+	flatTree(const flatTree&) = delete;
+	flatTree& operator=(const flatTree&) = delete;
+
+	int getDims() const;
+
+	//true when searches run straight from a mapped binary file
+	bool isMapped() const;
+
+	//most points held by a single leaf
+	int getLeafSize() const;
+
+	//number of points stored in the tree
+	int getSize() const;
+
+	//nodes in the node array, replaced nodes of an updated tree included
+	int getNodeCount() const;
+
+	const flatNode& getNode(int n) const;
+
+	//original index of the point stored in a slot
+	int getIndex(int slot) const;
+
+	//coordinate of the point stored in a slot for a particular axis
+	const double getCord(int slot, int dim) const;
+
+	//coordinates of every slot one axis after the other, axis d of slot s
+	//is at [d * getSlotCount() + s]. nullptr for a reduced precision tree
+	//that did not keep its doubles
+	const double * getCords() const;
+
+	//original index of every slot
+	const int * getIndices() const;
+
+	//print out information about the point stored in a slot
+	void printPoint(int slot) const;
+
+	//get absolute distance between a query and the point stored in a slot
+	double getAbDist(const double * query, int slot) const;
+
+	//record a bounding box for every node in later builds and text reads,
+	//off by default. boxes take 8 * dims bytes per node and let searches
+	//skip subtrees the split planes alone cannot rule out, which pays off
+	//mostly for many dimensions or large leaves. writeBinary stores them
+	//in the file and a mapped tree uses them only from there, mapping
+	//never builds boxes
+	void setBoundingBoxes(bool on);
+
+	//true when the current tree has bounding boxes
+	bool hasBoxes() const;
+
+	//coordinate precision of later builds and text reads, one of the
+	//PRECISION_ modes. a reduced precision stores the coordinates as floats
+	//or 16 bits per axis that searches walk first, and measures on the
+	//doubles kept after them only the candidates the copy cannot rule out,
+	//so answers stay exact. tree files record their precision, which wins
+	//over this setting. updates work on the coordinates as doubles until
+	//compact() encodes them again
+	void setPrecision(int precision);
+
+	//PRECISION_ mode of the current tree
+	int getPrecision() const;
+
+	//keep the doubles next to a reduced precision copy in later builds and
+	//text reads of double trees, on by default. nearest neighbor and radius
+	//answers are then exactly those of a double tree, k nearest distances
+	//too, though points at exactly equal distance may be swapped. binary
+	//files store the doubles as their last section. off drops the doubles
+	//and the search is approximate: it measures and returns distances to
+	//the stored values, which lie within the largest error of the copy of
+	//the originals. tree files record whether they kept the doubles
+	void setExactCords(bool on);
+
+	//bytes the current tree holds or maps: nodes, coordinates, compact copy,
+	//indices and boxes
+	size_t getBytes() const;
+
+	//CURVE_ order batch searches run their queries in. queries close on the
+	//curve are close in space and walk mostly the same nodes, so the caches
+	//stay warm. answers are written back in input order
+	void setQueryOrder(int curve);
+
+	//queries walked down the tree together by exact findNearBatch searches,
+	//1 to PACKET_LANES. a packet enters a subtree once for all its queries
+	//that need it and measures a leaf point against all of them in one
+	//vector loop, which pays off when neighboring queries take nearly the
+	//same path: dense grids or batches in curve order. answers are the same
+	//as one query at a time
+	void setPacketSize(int lanes);
+
+	//CURVE_ order of nodes and leaf points in later builds and text reads,
+	//CURVE_NONE keeps the order the build visits them in
+	void setCurveLayout(int curve);
+
+	//ranges smaller than taskCut are built by one task, ranges of at least
+	//partitionCut points are split with the stable partition
+	void setBuildCutoffs(int taskCut, int partitionCut);
+
+	//build tree from a set of points, points are copied and left untouched.
+	//axisMode is one of the SPLIT_ strategies, other values split by range.
+	//leaves hold up to leafSize points, 1 gives the same tree as treeNode for
+	//inputs smaller than the partition cutoff. passing a pool builds subtrees
+	//in parallel, the result is identical to the sequential build
+	flatTree * makeTree(vector<nPoint*> const & points, int const totalDepth,
+			int axisMode, int leafSize = 1, taskPool * pool = nullptr);
+
+	//build tree from a block of points, the index of a point is its row
+	flatTree * makeTree(const pointBlock& block, int axisMode, int leafSize = 1,
+			taskPool * pool = nullptr);
+
+	//build tree from count row-major points of k values, ids gives the index
+	//of every row or is nullptr when the row number is the index
+	flatTree * makeTree(const double * rows, const int * ids, int count, int k,
+			int axisMode, int leafSize = 1, taskPool * pool = nullptr);
+
+	//nearest neighbor search, bestDistance is used as the initial bound.
+	//eps > 0 skips a far side when (1 + eps) times its distance from the query
+	//is at least the best distance, so the answer is at most (1 + eps) times
+	//farther than the true nearest. maxLeaves > 0 stops the search after that
+	//many leaves with whatever was found so far. the defaults give exact answers
+	void findNear(const double * query, int& bestSlot, double& bestDistance,
+			double eps = 0, int maxLeaves = 0) const;
+
+	//findNear that adds the nodes and leaves it visits to stats
+	void findNear(const double * query, int& bestSlot, double& bestDistance,
+			searchStats& stats, double eps = 0, int maxLeaves = 0) const;
+
+	//exact findNear in squared distance, bestSquare is the initial bound and
+	//is only lowered, so several trees can be searched with one shared bound
+	void findNearSquared(const double * query, int& bestSlot,
+			double& bestSquare) const;
+
+	//findNear done with one call per tree level, gives the same answers
+	void findNearRecursive(const double * query, int& bestSlot,
+			double& bestDistance) const;
+
+	//k nearest neighbors, heap.getCapacity() sets k. heap is emptied first and
+	//holds the answers closest first when the search returns
+	void findKNear(const double * query, nearHeap& heap) const;
+
+	//findKNear done with one call per tree level, gives the same answers
+	void findKNearRecursive(const double * query, nearHeap& heap) const;
+
+	//k nearest neighbors for count row-major queries, answers for query i are in
+	//entries i * kNear to i * kNear + kNear - 1, padded with -1 and DBL_MAX
+	//when the tree has fewer than kNear points
+	void findKNearBatch(const double * queries, int count, int kNear,
+			int * bestSlots, double * bestDistances,
+			taskPool * pool = nullptr) const;
+
+	//nearest neighbor for count row-major queries, answers are written to the
+	//matching entries of bestSlots and bestDistances. with a pool the queries
+	//are split into chunks across threads, each chunk owns its own answers
+	void findNearBatch(const double * queries, int count, int * bestSlots,
+			double * bestDistances, taskPool * pool = nullptr, double eps = 0,
+			int maxLeaves = 0) const;
+
+	//slots of every point within radius of query (distance <= radius) in slot
+	//order. found is cleared first and keeps its storage between calls, so a
+	//reused buffer stops allocating once it is big enough. returns the count
+	int findRange(const double * query, double radius, vector<int>& found) const;
+
+	//number of points within radius of query without collecting them
+	int countRange(const double * query, double radius) const;
+
+	//radius search for count row-major queries, counts[i] gets the number of
+	//points within radius of query i and found[i] their slots unless found is
+	//nullptr. split across the pool like findNearBatch
+	void findRangeBatch(const double * queries, int count, double radius,
+			int * counts, vector<int> * found, taskPool * pool = nullptr) const;
+
+	//add a point with the given index. the point goes down the tree by the
+	//split planes and its leaf is rebuilt with it, splitting the leaf once it
+	//holds more than leafSize points. a subtree is rebuilt, scapegoat style,
+	//when one child holds more than REBUILD_BALANCE of its points. returns
+	//false if the index is already stored
+	bool insert(const double * point, int index);
+
+	//delete the point with the given index. its slot becomes a tombstone that
+	//searches pass over, and a subtree is rebuilt without its tombstones once
+	//more than REBUILD_DEAD of its points are deleted. returns false if the
+	//index is not stored
+	bool remove(int index);
+
+	//slot holding index, -1 if it is not stored
+	int findSlot(int index) const;
+
+	//number of slots searches may return, getIndex gives TOMBSTONE for slots
+	//without a point. equal to getSize until the tree is updated
+	int getSlotCount() const;
+
+	//rewrite an updated tree without tombstones, leftover nodes or spare
+	//slots, keeping its splits. updated trees are compacted before writing
+	void compact();
+
+	//write tree to file using the same text format as treeNode. a reduced
+	//precision is recorded as a leading PRECISION,name, cell, followed by
+	//EXACT, when the doubles are kept, which only flatTree reads
+	void writeOut(const string fileName) const;
+
+	//write tree to file in the binary format, returns false on failure
+	bool writeBinary(const string fileName) const;
+
+	//read in tree from external file written by either tree type, binary
+	//files are mapped into memory and searched in place without a parse step.
+	//verify checks the binary checksum, which reads the whole file once
+	flatTree * readTree(const string fileName, const int k, bool verify = true);
+
+	//free all nodes and points
+	void clear();
+
+	~flatTree();
+};
+
+//contiguous row-major block of points, the fast path for reading csv files
+class pointBlock {
+protected:
+	int dims;
+	vector<double> cords;
+
+	//parse rows [firstRow, ...) from the lines in [begin, end)
+	void parseLines(const char * begin, const char * end, size_t firstRow);
+
+public:
+	pointBlock();
+
+	int getDims() const;
+
+	//number of points held
+	int getSize() const;
+
+	//coordinates of point i
+	const double * getPoint(int i) const;
+
+	//read a csv file into the block, the file is mapped and split into chunks
+	//that are parsed on the pool. values are bit for bit the ones getDataFile
+	//gets from atof. returns number of dimensions or -1 if unsuccessful
+	int readFile(string const fileName, taskPool * pool = nullptr);
+
+	//replace the contents with a copy of count row-major points
+	void assign(const double * data, int count, int k);
+};
+
+//writes text to a file on a thread of its own, so the caller can format or
+//search the next block while the last one is written. blocks are written in
+//the order they are handed over
+class resultWriter {
+protected:
+	FILE * file;
+	thread worker;
+	mutex lock;
+	condition_variable changed;
+	deque<string> blocks;	//handed over, not written yet
+	bool closing;
+	bool failed;			//a write failed, later blocks are dropped
+
+	void writeLoop();
+
+public:
+	resultWriter();
+
+	//open fileName for writing and start the thread, false on failure
+	bool open(const string fileName);
+
+	//queue a block, waits while RESULT_QUEUE blocks are pending
+	void write(string&& text);
+
+	//write everything queued and close the file, false if a write failed
+	bool close();
+
+	~resultWriter();
+};
+
 //helper functions
 
 //count commas to check dimensions of points
@@ -151,12 +936,101 @@ int countDims(string const fileName);
 //get data from csv file and put it in point vector
 int getDataFile(string const fileName, vector<nPoint*>& pointVector);
 
+//parse one csv cell the way atof does, end is one past the last character
+double parseCell(const char * begin, const char * end);
+
+//append value as an ostream set to max_digits10 precision writes it, the
+//shortest form that reads back as the same double is not always that text
+void appendDouble(string& out, double value);
+
+void appendInt(string& out, int value);
+
 //compares contents of two files and returns if they are identical
 //based on the code published at http://stackoverflow.com/questions/6163611/compare-two-files
 //by username Christoph
 bool compareFile(FILE* file_compared, FILE* file_checked);
 
 //find the dimension with the largest range for a given set of points
-int findLargestRange(vector<nPoint*> const points, int const totalDepth);
+int findLargestRange(vector<nPoint*> const & points, int const totalDepth);
+
+//find the dimension with the largest range for a range of points
+int findLargestRange(vector<nPoint*>::const_iterator first,
+		vector<nPoint*>::const_iterator last, int const totalDepth);
+
+//64 bit checksum of a block of bytes, FNV-1a applied to 8 bytes at a time,
+//pass the previous result as seed to continue over several blocks
+uint64_t checksum64(const void * data, size_t bytes,
+		uint64_t seed = 14695981039346656037ULL);
+
+//arrays of a tree as writeTreeFile lays them out, pointers that are nullptr
+//leave their section out
+struct treeSections {
+	const flatNode * nodes;
+	size_t nodeCount;
+	const double * cords;	//doubles one axis after the other
+	const int * indices;
+	size_t pointCount;
+	int precision;			//PRECISION_ of the compact copy
+	const double * codes;	//scale, offset and error per axis of the copy
+	const void * copy;		//compact coordinates
+	size_t copyBytes;
+	const float * boxes;	//per node lower then upper bounds
+};
+
+//write a binary tree file, the one writer of the format for every tree:
+//nodes, the doubles unless there is a compact copy, indices, the codes and
+//copy, boxes, then the doubles kept behind a copy, each section on a 64 byte
+//boundary with zeroed padding and the checksum chained in that order.
+//returns false if the file cannot be written
+bool writeTreeFile(const string fileName, int dims, int leafSize,
+		const treeSections& tree);
+
+//true if fileName starts with the binary tree file magic
+bool isBinaryTree(const string fileName);
+
+//position of a point along a space filling curve over the box [low, high].
+//each axis is cut into 2^bits steps, bits is 64 / dims up to CURVE_BITS and
+//only the first 64 axes count in higher dimensions
+uint64_t curveKey(const double * point, const double * low,
+		const double * high, int dims, int curve);
+
+//order of count row-major points along a curve over their bounding box,
+//points with the same key keep their input order
+void curveOrder(const double * rows, int count, int dims, int curve,
+		vector<int>& order);
+
+//name of a CURVE_ order: none, morton or hilbert
+string curveName(int curve);
+
+//CURVE_ order of a name, -1 if there is none
+int curveValue(const string name);
+
+//name of a PRECISION_ mode as written to tree files: double, float or quant16
+string precisionName(int precision);
+
+//PRECISION_ mode of a name, -1 if there is none
+int precisionValue(const string name);
+
+//compute the squared distance from a query to count points stored as structure
+//of arrays, values for axis d of the first point are at cords[d * stride].
+//sums longer than EARLY_EXIT_DIMS stop once they pass bound, so any result
+//above bound is only a partial sum. 1 to 8 dimensions have unrolled
+//kernels, AVX-512 or AVX2 are used when compiled for them and results match
+//the scalar loop exactly
+void leafSquares(const double * query, const double * cords, size_t stride,
+		int count, int dims, double bound, double * out);
+
+//find the dimension with the largest range for a range of indices into a
+//row-major coordinate block, returns -1 if every dimension has zero range
+int findLargestRange(const int * first, const int * last,
+		const double * work, int const totalDepth);
+
+//min and max of every axis for a range of indices into a row-major coordinate
+//block, found in one pass over the rows
+void axisBounds(const int * first, const int * last, const double * work,
+		int dims, double * low, double * high);
+
+//axis with the largest high - low, -1 if every axis has zero range
+int widestAxis(const double * low, const double * high, int dims);
 
 #endif /* KDTREE_H_ */
@@ -0,0 +1,268 @@
+//============================================================================
+// Name        : load_kdtree.cpp
+/*
+ This file is part of kdTree.
+
+ kdTree is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ kdTree is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with kdTree.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Description : Load generator for serve_kdtree, sends requests from a
+// number of concurrent clients and reports throughput and latency
+//============================================================================
+
+#include "queryServer.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+//settings shared by every client thread
+struct loadConfig {
+	string socketPath;
+	int requests;	//per client
+	int batch;		//queries per request
+	int k;
+	const pointBlock * queries;
+	const flatTree * check;	//answers are compared against it if not nullptr
+};
+
+//what one client saw
+struct clientResult {
+	vector<double> latencies;	//microseconds per request
+	long queries;
+	long wrong;		//answers that differ from the local tree
+	bool failed;
+};
+
+static int connectTo(const string path) {
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path)) {
+		return -1;
+	}
+	strcpy(address.sun_path, path.c_str());
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd >= 0 && connect(fd, (sockaddr *) &address, sizeof(address)) != 0) {
+		close(fd);
+		fd = -1;
+	}
+	return fd;
+}
+
+//send one request and read its response, false if the connection failed
+static bool exchange(int fd, requestHeader& head, const double * rows,
+		responseHeader& reply, vector<char>& payload) {
+	if (!writeFull(fd, &head, sizeof(head))
+			|| (head.count * head.dims > 0
+					&& !writeFull(fd, rows,
+							(size_t) head.count * head.dims * sizeof(double)))
+			|| !readFull(fd, &reply, sizeof(reply))
+			|| reply.magic != SERVE_RESPONSE_MAGIC || reply.id != head.id) {
+		return false;
+	}
+	size_t bytes = reply.status != SERVE_OK ? 0 :
+					reply.type == SERVE_STATS ?
+							sizeof(serveStats) :
+							(size_t) reply.count * reply.k * sizeof(serveAnswer);
+	payload.resize(bytes);
+	return bytes == 0 || readFull(fd, &payload[0], bytes);
+}
+
+static void runClient(const loadConfig& cfg, int client, clientResult& result) {
+	result.queries = 0;
+	result.wrong = 0;
+	result.failed = false;
+
+	int fd = connectTo(cfg.socketPath);
+	if (fd < 0) {
+		result.failed = true;
+		return;
+	}
+
+	int dims = cfg.queries->getDims();
+	int total = cfg.queries->getSize();
+	vector<double> rows((size_t) cfg.batch * dims);
+	vector<char> payload;
+	vector<int> slots((size_t) cfg.batch * cfg.k);
+	vector<double> distances((size_t) cfg.batch * cfg.k);
+
+	for (int r = 0; r < cfg.requests; r++) {
+		//every client walks the query file from its own starting point
+		size_t first = ((size_t) client * cfg.requests + r) * cfg.batch;
+		for (int q = 0; q < cfg.batch; q++) {
+			memcpy(&rows[(size_t) q * dims],
+					cfg.queries->getPoint((first + q) % total),
+					dims * sizeof(double));
+		}
+
+		requestHeader head = { SERVE_REQUEST_MAGIC, SERVE_NEAR, (uint32_t) r,
+				(uint32_t) cfg.k, (uint32_t) cfg.batch, (uint32_t) dims };
+		responseHeader reply;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		if (!exchange(fd, head, &rows[0], reply, payload)
+				|| reply.status != SERVE_OK) {
+			result.failed = true;
+			break;
+		}
+		result.latencies.push_back(
+				chrono::duration<double, micro>(
+						chrono::steady_clock::now() - start).count());
+		result.queries += cfg.batch;
+
+		if (cfg.check != nullptr) {
+			if (cfg.k == 1) {
+				cfg.check->findNearBatch(&rows[0], cfg.batch, &slots[0],
+						&distances[0]);
+			} else {
+				cfg.check->findKNearBatch(&rows[0], cfg.batch, cfg.k, &slots[0],
+						&distances[0]);
+			}
+			const serveAnswer * answers = (const serveAnswer *) &payload[0];
+			for (size_t a = 0; a < slots.size(); a++) {
+				int index = slots[a] >= 0 ? cfg.check->getIndex(slots[a]) : -1;
+				if (answers[a].index != index
+						|| (index >= 0 && answers[a].distance != distances[a])) {
+					result.wrong++;
+				}
+			}
+		}
+	}
+	close(fd);
+}
+
+//latency at fraction p of the sorted values
+static double percentile(vector<double>& sorted, double p) {
+	return sorted.empty() ? 0 : sorted[(size_t) ((sorted.size() - 1) * p)];
+}
+
+int main(int argc, char *argv[]) {
+
+	string socketPath = "kdtree.sock";
+	string input = "query_data.csv";
+	string checkFile; //tree file to compare the answers against
+	int clients = 4;
+	loadConfig cfg;
+	cfg.requests = 1000;
+	cfg.batch = 1;
+	cfg.k = 1;
+
+	int position = 0;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg.compare(0, 2, "--") == 0) {
+			if (i + 1 >= argc) {
+				cout << "Missing value for option " << arg << endl;
+				return 1;
+			}
+			if (arg == "--clients") {
+				clients = max(1, atoi(argv[++i]));
+			} else if (arg == "--requests") { //per client
+				cfg.requests = max(1, atoi(argv[++i]));
+			} else if (arg == "--batch") { //queries per request
+				cfg.batch = max(1, atoi(argv[++i]));
+			} else if (arg == "--knn") {
+				cfg.k = max(1, atoi(argv[++i]));
+			} else if (arg == "--check") {
+				checkFile = argv[++i];
+			} else {
+				cout << "Unknown option " << arg << endl;
+				return 1;
+			}
+		} else if (position == 0) {
+			socketPath = arg;
+			position++;
+		} else if (position == 1) {
+			input = arg;
+			position++;
+		}
+	}
+
+	pointBlock queries;
+	int k = queries.readFile(input);
+	if (k < 1 || queries.getSize() == 0) {
+		cout << "Could not read queries from " << input << endl;
+		return 1;
+	}
+	flatTree check;
+	if (!checkFile.empty() && !check.readTree(checkFile, k)) {
+		cout << "Error reading in tree from file, exiting\n";
+		return 1;
+	}
+	cfg.socketPath = socketPath;
+	cfg.queries = &queries;
+	cfg.check = checkFile.empty() ? nullptr : &check;
+
+	vector<clientResult> results(clients);
+	vector<thread> workers;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int c = 0; c < clients; c++) {
+		workers.push_back(thread(runClient, cref(cfg), c, ref(results[c])));
+	}
+	for (thread& t : workers) {
+		t.join();
+	}
+	double seconds = chrono::duration<double>(
+			chrono::steady_clock::now() - start).count();
+
+	vector<double> latencies;
+	long answered = 0;
+	long wrong = 0;
+	bool failed = false;
+	for (clientResult& r : results) {
+		latencies.insert(latencies.end(), r.latencies.begin(),
+				r.latencies.end());
+		answered += r.queries;
+		wrong += r.wrong;
+		failed = failed || r.failed;
+	}
+	sort(latencies.begin(), latencies.end());
+
+	cout << clients << " clients sent " << latencies.size() << " requests of "
+			<< cfg.batch << " queries in " << seconds << " s: "
+			<< (seconds > 0 ? latencies.size() / seconds : 0) << " requests/s, "
+			<< (seconds > 0 ? answered / seconds : 0) << " queries/s" << endl;
+	cout << "Round trip latency p50 " << percentile(latencies, 0.5)
+			<< " us, p99 " << percentile(latencies, 0.99) << " us, max "
+			<< percentile(latencies, 1) << " us" << endl;
+
+	//the server's own view, without the client side of the round trip
+	int fd = connectTo(socketPath);
+	requestHeader head = { SERVE_REQUEST_MAGIC, SERVE_STATS, 0, 0, 0, 0 };
+	responseHeader reply;
+	vector<char> payload;
+	if (fd >= 0 && exchange(fd, head, nullptr, reply, payload)
+			&& reply.status == SERVE_OK) {
+		serveStats stats;
+		memcpy(&stats, &payload[0], sizeof(stats));
+		cout << "Server answered " << stats.requests << " requests in "
+				<< stats.batches << " batches, latency p50 " << stats.p50
+				<< " us, p99 " << stats.p99 << " us" << endl;
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+
+	if (failed) {
+		cout << "ERROR, SOME REQUESTS FAILED" << endl;
+	}
+	if (cfg.check != nullptr) {
+		cout << (wrong == 0 ? "All answers match " : "Answers that differ from ")
+				<< checkFile;
+		if (wrong > 0) {
+			cout << ": " << wrong;
+		}
+		cout << endl;
+	}
+	return failed || wrong > 0 ? 1 : 0;
+}
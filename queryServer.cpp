@@ -0,0 +1,478 @@
+/*
+ * queryServer.cpp
+ */
+
+/*
+ This file is part of kdTree.
+
+ kdTree is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ kdTree is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with kdTree.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "queryServer.h"
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+bool readFull(int fd, void * data, size_t size) {
+	char * at = (char *) data;
+	while (size > 0) {
+		ssize_t got = read(fd, at, size);
+		if (got < 0 && errno == EINTR) {
+			continue;
+		}
+		if (got <= 0) {
+			return false;
+		}
+		at += got;
+		size -= got;
+	}
+	return true;
+}
+
+//sockets are written with send so a client that went away gives an error
+//instead of SIGPIPE, anything else with write
+bool writeFull(int fd, const void * data, size_t size) {
+	const char * at = (const char *) data;
+	bool socket = true;
+	while (size > 0) {
+		ssize_t put =
+				socket ? send(fd, at, size, MSG_NOSIGNAL) : write(fd, at, size);
+		if (put < 0 && socket && errno == ENOTSOCK) {
+			socket = false;
+			continue;
+		}
+		if (put < 0 && errno == EINTR) {
+			continue;
+		}
+		if (put <= 0) {
+			return false;
+		}
+		at += put;
+		size -= put;
+	}
+	return true;
+}
+
+queryServer::connection::connection(int in, int out) :
+		inFd(in), outFd(out), requests(0), bytes(0), broken(false), closing(
+				false) {
+}
+
+queryServer::connection::~connection() {
+	if (inFd > 2) {
+		close(inFd);
+	}
+	if (outFd > 2 && outFd != inFd) {
+		close(outFd);
+	}
+}
+
+queryServer::queryServer(const flatTree& tree, taskPool * pool) :
+		tree(tree), pool(pool), stopping(false), listening(false), latencies(
+				LATENCY_WINDOW) {
+	totals.requests = 0;
+	totals.queries = 0;
+	totals.batches = 0;
+	totals.p50 = 0;
+	totals.p99 = 0;
+	dispatcher = thread(&queryServer::dispatchLoop, this);
+}
+
+queryServer::~queryServer() {
+	stop();
+}
+
+void queryServer::serve(int inFd, int outFd) {
+	shared_ptr<connection> client = open(inFd, outFd);
+	{
+		lock_guard<mutex> hold(clientLock);
+		clients.push_back(client);
+	}
+	readRequests(client);
+}
+
+shared_ptr<queryServer::connection> queryServer::open(int inFd, int outFd) {
+	shared_ptr<connection> client = make_shared<connection>(inFd, outFd);
+	client->writer = thread(&queryServer::writeResponses, this, client.get());
+	return client;
+}
+
+void queryServer::readRequests(shared_ptr<connection> client) {
+	int inFd = client->inFd;
+	requestHeader head;
+	while (true) {
+		//a client that does not take its responses is not read from, so it
+		//cannot fill the server with work nobody collects
+		{
+			unique_lock<mutex> hold(client->lock);
+			client->changed.wait(hold, [&client]() {
+				return client->requests < SERVE_CLIENT_REQUESTS
+						&& client->bytes < SERVE_CLIENT_BYTES;
+			});
+		}
+		if (!readFull(inFd, &head, sizeof(head))) {
+			break;
+		}
+		size_t values = (size_t) head.count * head.dims;
+		if (head.magic != SERVE_REQUEST_MAGIC || values > SERVE_MAX_VALUES) {
+			cout << "ERROR, MALFORMED REQUEST, CLOSING CONNECTION" << endl;
+			break;
+		}
+
+		pendingRequest request;
+		request.client = client;
+		request.head = head;
+		request.status = SERVE_OK;
+		request.queries.resize(values);
+		if (values > 0
+				&& !readFull(inFd, &request.queries[0],
+						values * sizeof(double))) {
+			break;
+		}
+		request.arrival = chrono::steady_clock::now();
+
+		if (head.type != SERVE_NEAR && head.type != SERVE_STATS) {
+			request.status = SERVE_BAD_TYPE;
+		} else if (head.type == SERVE_NEAR
+				&& (int) head.dims != tree.getDims()) {
+			request.status = SERVE_BAD_DIMS;
+		} else if (head.type == SERVE_NEAR
+				&& (head.k < 1 || head.k > SERVE_MAX_K)) {
+			request.status = SERVE_BAD_K;
+		} else if (head.type == SERVE_NEAR
+				&& (size_t) head.count * head.k > SERVE_MAX_ANSWERS) {
+			request.status = SERVE_TOO_LARGE; //refused before anything is allocated
+		}
+		if (request.status != SERVE_OK || head.type != SERVE_NEAR) {
+			vector<double>().swap(request.queries);
+		}
+
+		{
+			lock_guard<mutex> hold(client->lock);
+			client->requests++;
+			client->bytes += request.queries.size() * sizeof(double);
+		}
+		lock_guard<mutex> hold(queueLock);
+		queue.push_back(move(request));
+		ready.notify_one();
+	}
+
+	//every request read is answered before the writer stops
+	{
+		unique_lock<mutex> hold(client->lock);
+		client->changed.wait(hold, [&client]() {
+			return client->requests == 0;
+		});
+		client->closing = true;
+		client->changed.notify_all();
+	}
+	client->writer.join();
+}
+
+void queryServer::writeResponses(connection * client) {
+	while (true) {
+		string response;
+		bool broken;
+		{
+			unique_lock<mutex> hold(client->lock);
+			client->changed.wait(hold, [client]() {
+				return client->closing || !client->output.empty();
+			});
+			if (client->output.empty()) {
+				return;
+			}
+			response = move(client->output.front());
+			client->output.pop_front();
+			broken = client->broken;
+		}
+
+		bool written = !broken
+				&& writeFull(client->outFd, response.data(), response.size());
+
+		lock_guard<mutex> hold(client->lock);
+		client->broken = !written;
+		client->requests--;
+		client->bytes -= response.size();
+		client->changed.notify_all();
+	}
+}
+
+void queryServer::addClient(int fd) {
+	lock_guard<mutex> hold(clientLock);
+
+	//join readers whose clients are gone before starting another
+	for (size_t r = 0; r < readers.size();) {
+		if (*readers[r].done) {
+			readers[r].worker.join();
+			readers[r] = move(readers.back());
+			readers.pop_back();
+		} else {
+			r++;
+		}
+	}
+	clients.erase(
+			remove_if(clients.begin(), clients.end(),
+					[](const weak_ptr<connection>& c) {
+						return c.expired();
+					}), clients.end());
+
+	//registered before its thread starts so stop always finds it
+	shared_ptr<connection> client = open(fd, fd);
+	clients.push_back(client);
+	reader next;
+	next.done = make_shared<atomic<bool> >(false);
+	shared_ptr<atomic<bool> > done = next.done;
+	next.worker = thread([this, client, done]() {
+		readRequests(client);
+		*done = true;
+	});
+	readers.push_back(move(next));
+}
+
+bool queryServer::listenOn(const string path) {
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path)) {
+		cout << "ERROR, SOCKET PATH TOO LONG: " << path << endl;
+		return false;
+	}
+	strcpy(address.sun_path, path.c_str());
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		cout << "ERROR, COULD NOT CREATE SOCKET" << endl;
+		return false;
+	}
+	unlink(path.c_str()); //left behind by a server that did not stop cleanly
+	if (bind(fd, (sockaddr *) &address, sizeof(address)) != 0
+			|| listen(fd, SOMAXCONN) != 0) {
+		cout << "ERROR, COULD NOT LISTEN ON " << path << endl;
+		close(fd);
+		return false;
+	}
+
+	//accept polls so stopListening is noticed without a connection
+	listening = true;
+	while (listening) {
+		pollfd wait = { fd, POLLIN, 0 };
+		if (poll(&wait, 1, 200) > 0) {
+			int client = accept(fd, nullptr, nullptr);
+			if (client >= 0) {
+				addClient(client);
+			}
+		}
+	}
+	close(fd);
+	unlink(path.c_str());
+	return true;
+}
+
+void queryServer::stopListening() {
+	listening = false;
+}
+
+void queryServer::stop() {
+	//no new requests: unblock every reader and wait for it
+	vector<reader> finishing;
+	{
+		lock_guard<mutex> hold(clientLock);
+		for (weak_ptr<connection>& c : clients) {
+			shared_ptr<connection> client = c.lock();
+			if (client) {
+				shutdown(client->inFd, SHUT_RD);
+			}
+		}
+		finishing.swap(readers);
+		clients.clear();
+	}
+	for (reader& r : finishing) {
+		r.worker.join();
+	}
+
+	{
+		lock_guard<mutex> hold(queueLock);
+		stopping = true;
+		ready.notify_one();
+	}
+	if (dispatcher.joinable()) {
+		dispatcher.join();
+	}
+}
+
+void queryServer::dispatchLoop() {
+	vector<pendingRequest> batch;
+	size_t dims = tree.getDims();
+	while (true) {
+		{
+			unique_lock<mutex> hold(queueLock);
+			ready.wait(hold, [this]() {
+				return stopping || !queue.empty();
+			});
+			if (queue.empty()) { //stopping with everything answered
+				return;
+			}
+			//everything queued up to SERVE_BATCH queries, at least one request
+			size_t queries = 0;
+			while (!queue.empty()
+					&& (batch.empty()
+							|| queries + queue.front().queries.size() / dims
+									<= SERVE_BATCH)) {
+				queries += queue.front().queries.size() / dims;
+				batch.push_back(move(queue.front()));
+				queue.pop_front();
+			}
+		}
+		answer(batch);
+		batch.clear();
+	}
+}
+
+void queryServer::answer(vector<pendingRequest>& batch) {
+	int dims = tree.getDims();
+
+	//distinct k of the searches in this batch
+	vector<uint32_t> ks;
+	for (pendingRequest& request : batch) {
+		if (request.status == SERVE_OK && request.head.type == SERVE_NEAR
+				&& find(ks.begin(), ks.end(), request.head.k) == ks.end()) {
+			ks.push_back(request.head.k);
+		}
+	}
+
+	//one search per k over the queries of every request asking for it
+	vector<vector<serveAnswer> > answers(batch.size());
+	vector<double> rows;
+	vector<int> slots;
+	vector<double> distances;
+	for (uint32_t k : ks) {
+		rows.clear();
+		for (pendingRequest& request : batch) {
+			if (request.status == SERVE_OK && request.head.type == SERVE_NEAR
+					&& request.head.k == k) {
+				rows.insert(rows.end(), request.queries.begin(),
+						request.queries.end());
+			}
+		}
+		int count = rows.size() / dims;
+		if (count == 0) {
+			continue;
+		}
+		slots.resize((size_t) count * k);
+		distances.resize((size_t) count * k);
+		if (k == 1) {
+			tree.findNearBatch(&rows[0], count, &slots[0], &distances[0], pool);
+		} else {
+			tree.findKNearBatch(&rows[0], count, k, &slots[0], &distances[0],
+					pool);
+		}
+
+		size_t at = 0;
+		for (size_t r = 0; r < batch.size(); r++) {
+			pendingRequest& request = batch[r];
+			if (request.status != SERVE_OK || request.head.type != SERVE_NEAR
+					|| request.head.k != k) {
+				continue;
+			}
+			answers[r].resize((size_t) request.head.count * k);
+			for (serveAnswer& a : answers[r]) {
+				a.index = slots[at] >= 0 ? tree.getIndex(slots[at]) : -1;
+				a.unused = 0;
+				a.distance = slots[at] >= 0 ? distances[at] : DBL_MAX;
+				at++;
+			}
+		}
+	}
+	if (!ks.empty()) {
+		lock_guard<mutex> hold(statsLock);
+		totals.batches++;
+	}
+
+	for (size_t r = 0; r < batch.size(); r++) {
+		pendingRequest& request = batch[r];
+		if (request.status == SERVE_OK && request.head.type == SERVE_STATS) {
+			serveStats stats = getStats();
+			respond(request, &stats, sizeof(stats));
+		} else {
+			respond(request, answers[r].empty() ? nullptr : &answers[r][0],
+					answers[r].size() * sizeof(serveAnswer));
+		}
+	}
+}
+
+void queryServer::respond(pendingRequest& request, const void * payload,
+		size_t bytes) {
+	responseHeader head;
+	head.magic = SERVE_RESPONSE_MAGIC;
+	head.type = request.head.type;
+	head.status = request.status;
+	head.id = request.head.id;
+	head.k = request.head.k;
+	head.count = request.status != SERVE_OK ? 0 :
+					request.head.type == SERVE_STATS ? 1 : request.head.count;
+
+	connection& client = *request.client;
+	bool broken;
+	{
+		lock_guard<mutex> hold(client.lock);
+		broken = client.broken;
+	}
+
+	record(request.arrival,
+			request.status == SERVE_OK && request.head.type == SERVE_NEAR ?
+					request.head.count : 0);
+
+	string response;
+	if (!broken) { //nobody reads it otherwise
+		response.reserve(sizeof(head) + bytes);
+		response.append((const char *) &head, sizeof(head));
+		if (bytes > 0) {
+			response.append((const char *) payload, bytes);
+		}
+	}
+
+	lock_guard<mutex> hold(client.lock);
+	client.bytes -= request.queries.size() * sizeof(double);
+	client.bytes += response.size();
+	client.output.push_back(move(response));
+	client.changed.notify_all();
+}
+
+void queryServer::record(chrono::steady_clock::time_point arrival,
+		uint32_t queries) {
+	double micros = chrono::duration<double, micro>(
+			chrono::steady_clock::now() - arrival).count();
+	lock_guard<mutex> hold(statsLock);
+	latencies[totals.requests % LATENCY_WINDOW] = micros;
+	totals.requests++;
+	totals.queries += queries;
+}
+
+serveStats queryServer::getStats() const {
+	lock_guard<mutex> hold(statsLock);
+	serveStats stats = totals;
+	size_t n = min((size_t) totals.requests, (size_t) LATENCY_WINDOW);
+	if (n > 0) {
+		vector<double> sorted(latencies.begin(), latencies.begin() + n);
+		size_t middle = (n - 1) / 2;
+		size_t high = (size_t) ((n - 1) * 0.99);
+		nth_element(sorted.begin(), sorted.begin() + middle, sorted.end());
+		stats.p50 = sorted[middle];
+		nth_element(sorted.begin(), sorted.begin() + high, sorted.end());
+		stats.p99 = sorted[high];
+	}
+	return stats;
+}
@@ -0,0 +1,211 @@
+/*
+ * queryServer.h
+ */
+
+/*
+ This file is part of kdTree.
+
+ kdTree is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ kdTree is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with kdTree.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QUERYSERVER_H_
+#define QUERYSERVER_H_
+
+#include "kdTree.h"
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+//frames on the wire are a header followed by its payload, every field in
+//native byte order since both ends run on the same machine. a request
+//carries count queries of dims doubles, the response to it count * k
+//serveAnswer entries, closest first for every query
+#define SERVE_REQUEST_MAGIC 0x5152444bu	//"KDRQ"
+#define SERVE_RESPONSE_MAGIC 0x5352444bu	//"KDRS"
+
+//request types
+#define SERVE_NEAR 0	//k nearest neighbors of every query
+#define SERVE_STATS 1	//serveStats of the server, no queries
+
+//response status
+#define SERVE_OK 0
+#define SERVE_BAD_DIMS 1	//queries do not match the tree, payload was skipped
+#define SERVE_BAD_K 2		//k is 0 or above SERVE_MAX_K
+#define SERVE_BAD_TYPE 3	//unknown request type
+#define SERVE_TOO_LARGE 4	//count * k above SERVE_MAX_ANSWERS, payload was skipped
+
+#define SERVE_MAX_K 1024				//most neighbors per query
+#define SERVE_MAX_VALUES (1 << 24)		//most doubles in one request, larger closes the connection
+#define SERVE_MAX_ANSWERS (1 << 22)		//most answers in one response, count * k
+#define SERVE_BATCH 65536				//queries answered together by one batch
+#define SERVE_CLIENT_REQUESTS 256		//requests of one connection read but not yet answered
+#define SERVE_CLIENT_BYTES (64 << 20)	//bytes those requests and their responses may hold
+#define LATENCY_WINDOW 65536			//latest requests kept for the percentiles
+
+struct requestHeader {
+	uint32_t magic;	//SERVE_REQUEST_MAGIC
+	uint32_t type;	//SERVE_NEAR or SERVE_STATS
+	uint32_t id;	//returned in the response
+	uint32_t k;		//neighbors per query, 1 for the nearest only
+	uint32_t count;	//queries in the payload
+	uint32_t dims;	//doubles per query
+};
+
+struct responseHeader {
+	uint32_t magic;		//SERVE_RESPONSE_MAGIC
+	uint32_t type;		//type of the request
+	uint32_t status;	//SERVE_OK or the reason nothing follows
+	uint32_t id;		//id of the request
+	uint32_t k;
+	uint32_t count;		//queries answered, 1 serveStats for SERVE_STATS
+};
+
+struct serveAnswer {
+	int32_t index;		//original index of the point, -1 past the tree size
+	uint32_t unused;
+	double distance;
+};
+
+//latency is from the moment a request is read to the moment its response
+//is handed to the writer of its connection, so a client that reads slowly
+//does not count, over the latest LATENCY_WINDOW requests
+struct serveStats {
+	uint64_t requests;	//answered since the server started
+	uint64_t queries;
+	uint64_t batches;	//searches the requests were grouped into
+	double p50;			//microseconds
+	double p99;
+};
+
+static_assert(sizeof(requestHeader) == 24, "requestHeader is sent byte for byte");
+static_assert(sizeof(responseHeader) == 24, "responseHeader is sent byte for byte");
+static_assert(sizeof(serveAnswer) == 16, "serveAnswer is sent byte for byte");
+static_assert(sizeof(serveStats) == 40, "serveStats is sent byte for byte");
+
+//read or write exactly size bytes, false on end of file or error
+bool readFull(int fd, void * data, size_t size);
+bool writeFull(int fd, const void * data, size_t size);
+
+//answers requests against one loaded tree for any number of connections.
+//every connection has a thread that reads its frames into a shared queue,
+//and one dispatch thread takes everything queued, searches it as a single
+//batch on the pool and hands the responses to the writer thread of each
+//connection, so a client that reads slowly holds up only itself. requests
+//that arrive while a batch runs wait for the next one, so under load the
+//batches grow and the pool stays busy, while a lone request is answered at
+//once. a connection with SERVE_CLIENT_REQUESTS requests or
+//SERVE_CLIENT_BYTES bytes outstanding is not read from until its writer
+//catches up
+class queryServer {
+protected:
+	//one client, closed once nothing refers to it
+	struct connection {
+		int inFd;
+		int outFd;
+
+		mutex lock;			//guards everything below
+		condition_variable changed;	//a response was queued or written
+		deque<string> output;	//responses for the writer, header and payload
+		size_t requests;	//read and not yet written
+		size_t bytes;		//of those requests and their queued responses
+		bool broken;		//a write failed, later responses are dropped
+		bool closing;		//no more responses will be queued
+		thread writer;
+
+		connection(int in, int out);
+		~connection();
+	};
+
+	struct pendingRequest {
+		shared_ptr<connection> client;
+		requestHeader head;
+		uint32_t status;
+		vector<double> queries;
+		chrono::steady_clock::time_point arrival;
+	};
+
+	const flatTree& tree;
+	taskPool * pool;		//searches batches in parallel, may be nullptr
+
+	mutex queueLock;
+	condition_variable ready;
+	deque<pendingRequest> queue;
+	bool stopping;			//guarded by queueLock
+	atomic<bool> listening;	//cleared to leave listenOn
+	thread dispatcher;
+
+	//thread reading one socket, joined once done is set
+	struct reader {
+		thread worker;
+		shared_ptr<atomic<bool> > done;
+	};
+
+	mutex clientLock;		//guards readers and clients
+	vector<reader> readers;
+	vector<weak_ptr<connection> > clients;
+
+	mutable mutex statsLock;
+	vector<double> latencies;	//ring of the latest microsecond latencies
+	serveStats totals;
+
+	//start the writer of a new connection
+	shared_ptr<connection> open(int inFd, int outFd);
+
+	//queue the requests of one client until its input ends, then wait for
+	//the last response and stop its writer
+	void readRequests(shared_ptr<connection> client);
+
+	//write the responses of one client in the order they were queued
+	void writeResponses(connection * client);
+
+	void dispatchLoop();
+
+	//search every request of a batch, requests with the same k as one
+	//search, and queue the responses in the order the requests came
+	void answer(vector<pendingRequest>& batch);
+
+	//hand one response to the writer of its connection
+	void respond(pendingRequest& request, const void * payload, size_t bytes);
+
+	void record(chrono::steady_clock::time_point arrival, uint32_t queries);
+
+public:
+	queryServer(const flatTree& tree, taskPool * pool = nullptr);
+
+	//stops the server and waits for its threads
+	~queryServer();
+
+	//read requests from inFd until the input ends or a frame is malformed.
+	//responses go to outFd in request order, and this returns once the last
+	//of them is written. both descriptors are closed after the last response
+	//unless they are the standard streams
+	void serve(int inFd, int outFd);
+
+	//serve a connected socket on a thread of its own
+	void addClient(int fd);
+
+	//accept connections on a unix domain socket at path until stopListening,
+	//returns false if the socket cannot be created
+	bool listenOn(const string path);
+
+	//make listenOn return, safe to call from a signal handler
+	void stopListening();
+
+	//answer what is queued, then close every connection and stop the threads
+	void stop();
+
+	serveStats getStats() const;
+};
+
+#endif /* QUERYSERVER_H_ */
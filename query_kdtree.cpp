@@ -23,55 +23,343 @@
 // Description : Read in a previously created tree and find the nearest
 // neighbor for a series of query points
 //============================================================================
-#include "kdTree.h"
+#include "fixedTree.h"
+#include <chrono>
+#include <memory>
 
-int main(int argc, char *argv[]) {
+//queries searched at a time by a quiet run, each block is written while the
+//next is searched
+#define RESULT_BLOCK 65536
+
+//true if a tree file holds a double tree, boxed is set when a binary one
+//carries bounding boxes. text trees at reduced precision start with PRECISION,
+static bool doubleTreeFile(const string fileName, bool binary, bool& boxed) {
+	ifstream file(fileName, ios::binary);
+	boxed = false;
+	if (!binary) {
+		char start[10];
+		return !file.read(start, sizeof(start))
+				|| memcmp(start, "PRECISION,", sizeof(start)) != 0;
+	}
+	treeFileHeader header;
+	file.read((char *) &header, sizeof(header));
+	boxed = file && header.boxOffset != 0;
+	return !file || header.precision == PRECISION_DOUBLE;
+}
+
+//append the results file lines of queries [first, last), for a flatTree or
+//the compiled tree that answered them
+template<typename Tree>
+static void formatResults(const Tree& tree, int first, int last, int kNear,
+		double radius, bool countOnly, const int * bestSlots,
+		const double * bestDistances, const int * rangeCounts,
+		const vector<int> * rangeSlots, string& out) {
+	vector<int> found;
+	for (int i = first; i < last; i++) {
+		if (radius >= 0) { //count then the indices found
+			appendInt(out, rangeCounts[i]);
+			if (!countOnly) {
+				found.clear();
+				for (int slot : rangeSlots[i]) {
+					found.push_back(tree.getIndex(slot));
+				}
+				sort(found.begin(), found.end());
+				for (int index : found) {
+					out += ',';
+					appendInt(out, index);
+				}
+			}
+		} else if (kNear == 0) {
+			appendInt(out, tree.getIndex(bestSlots[i]));
+			out += ',';
+			appendDouble(out, bestDistances[i]);
+		} else { //kNear index,distance pairs per line
+			for (int j = 0; j < kNear; j++) {
+				size_t at = (size_t) i * kNear + j;
+				if (bestSlots[at] < 0) { //tree holds fewer than kNear points
+					break;
+				}
+				if (j > 0) {
+					out += ',';
+				}
+				appendInt(out, tree.getIndex(bestSlots[at]));
+				out += ',';
+				appendDouble(out, bestDistances[at]);
+			}
+		}
+		out += '\n';
+	}
+}
 
-	vector<nPoint*> queries; //store data from csv
+int main(int argc, char *argv[]) {
 
-	string treeFile = "treeOut.txt";
+	string treeFile = "treeOut.kdt";
 	string input = "query_data.csv";
 	string output = "results.txt";
+	vector<int> threadCounts(1, 1);
+	int kNear = 0; //0 for the single nearest neighbor output format
+	bool verify = true; //check the checksum of binary tree files
+	double radius = -1; //negative for nearest neighbor searches
+	bool countOnly = false; //radius searches report only how many points matched
+	double eps = 0; //approximate nearest neighbor factor, 0 for exact answers
+	int maxLeaves = 0; //leaves visited per approximate query, 0 for no limit
+	int boxes = -1; //bounding boxes, -1 uses those a binary tree file carries
+	int order = CURVE_NONE; //curve the batch is searched along
+	int packet = 1; //queries walked down the tree together
+	bool quiet = false; //no line per query, results written while searching
+	bool compiled = false; //tree compiled for the dimension where it can answer
 
-	if (argc > 1) {
-		treeFile = argv[1];
-	}
-	if (argc > 2) {
-		input = argv[2];
+	//positional arguments are treeFile, input and output, options are --name value
+	int position = 0;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg.compare(0, 2, "--") == 0) {
+			if (i + 1 >= argc) {
+				cout << "Missing value for option " << arg << endl;
+				return 1;
+			}
+			if (arg == "--threads") { //comma separated list of thread counts
+				threadCounts.clear();
+				stringstream list(argv[++i]);
+				string cell;
+				while (getline(list, cell, ',')) {
+					threadCounts.push_back(atoi(cell.c_str()));
+				}
+				if (threadCounts.empty()
+						|| *min_element(threadCounts.begin(),
+								threadCounts.end()) < 1) {
+					cout << "Thread counts for --threads must be 1 or more"
+							<< endl;
+					return 1;
+				}
+			} else if (arg == "--verify") {
+				verify = atoi(argv[++i]) != 0;
+			} else if (arg == "--knn") {
+				kNear = atoi(argv[++i]);
+			} else if (arg == "--radius") {
+				radius = atof(argv[++i]);
+			} else if (arg == "--boxes") {
+				boxes = atoi(argv[++i]);
+			} else if (arg == "--eps") {
+				eps = atof(argv[++i]);
+			} else if (arg == "--leaves") {
+				maxLeaves = atoi(argv[++i]);
+			} else if (arg == "--count") {
+				countOnly = atoi(argv[++i]) != 0;
+			} else if (arg == "--order") { //none, morton or hilbert
+				string name = argv[++i];
+				order = curveValue(name);
+				if (order < 0) {
+					cout << "Unknown query order " << name
+							<< ", expected none, morton or hilbert" << endl;
+					return 1;
+				}
+			} else if (arg == "--packet") {
+				packet = atoi(argv[++i]);
+			} else if (arg == "--quiet") {
+				quiet = atoi(argv[++i]) != 0;
+			} else if (arg == "--fixed") {
+				compiled = atoi(argv[++i]) != 0;
+			} else {
+				cout << "Unknown option " << arg << endl;
+				return 1;
+			}
+		} else if (position == 0) {
+			treeFile = arg;
+			position++;
+		} else if (position == 1) {
+			input = arg;
+			position++;
+		} else if (position == 2) {
+			output = arg;
+			position++;
+		}
 	}
-	if (argc > 3) {
-		output = argv[3];
+
+	//approximate searches only answer the single nearest neighbor
+	if ((eps > 0 || maxLeaves > 0) && (kNear > 0 || radius >= 0)) {
+		cout << "ERROR, --eps AND --leaves CANNOT BE COMBINED WITH --knn OR --radius"
+				<< endl;
+		return 1;
 	}
 
 	cout << "Reading in query data from " << input << endl;
-	int k = getDataFile(input, queries); //return how many dimensions (k) data is
-	treeNode * root = new treeNode;
-	if( root->readTree(treeFile, k)){//create tree from file, also test for success
+	pointBlock queries; //store data from csv
+	taskPool readPool(*max_element(threadCounts.begin(), threadCounts.end()));
+	int k = queries.readFile(input, &readPool); //return how many dimensions (k) data is
+	bool approximate = eps > 0 || maxLeaves > 0;
+	bool binary = isBinaryTree(treeFile);
+
+	//with --fixed 1 plain exact nearest neighbor searches of up to
+	//MAX_FIXED_DIMS dimensions run on the tree compiled for the dimension,
+	//which reads the same files and gives the same answers with a recursive
+	//walk. boxes, query orders, packets and reduced precision are flatTree
+	//only, so asking for any of them, or a file with boxes or at reduced
+	//precision, keeps flatTree
+	bool boxed = false;
+	bool doubles = doubleTreeFile(treeFile, binary, boxed);
+	unique_ptr<searchTree> fixed;
+	if (compiled && kNear == 0 && radius < 0 && !approximate
+			&& order == CURVE_NONE && packet <= 1 && k >= 1
+			&& k <= MAX_FIXED_DIMS && doubles
+			&& (boxes == 0 || (boxes < 0 && !boxed))) {
+		fixed.reset(makeSearchTree(k));
+	}
+
+	flatTree tree;
+	tree.setBoundingBoxes(boxes > 0 || (boxes < 0 && binary));
+	tree.setQueryOrder(order);
+	tree.setPacketSize(packet);
+	if (fixed != nullptr ?
+			fixed->readTree(treeFile, verify) :
+			tree.readTree(treeFile, k, verify) != nullptr) { //create tree from file, also test for success
 		cout << "Tree read in success" << endl << endl;
 	}else{
 		cout << "Error reading in tree from file, exiting\n";
 		exit(1);
 	}
 
+	int count = queries.getSize();
+	int perQuery = max(kNear, 1);
+	vector<int> bestSlots((size_t) count * perQuery);
+	vector<double> bestDistances((size_t) count * perQuery);
+	vector<int> rangeCounts(radius >= 0 ? count : 0);
+	vector<vector<int> > rangeSlots(radius >= 0 && !countOnly ? count : 0);
+
+	//results and points come from whichever tree answered
+	auto format = [&](int first, int last, string& text) {
+		const int * slots = bestSlots.empty() ? nullptr : &bestSlots[0];
+		const double * distances =
+				bestDistances.empty() ? nullptr : &bestDistances[0];
+		const int * counts = rangeCounts.empty() ? nullptr : &rangeCounts[0];
+		const vector<int> * found = rangeSlots.empty() ? nullptr : &rangeSlots[0];
+		if (fixed != nullptr) {
+			formatResults(*fixed, first, last, kNear, radius, countOnly, slots,
+					distances, counts, found, text);
+		} else {
+			formatResults(tree, first, last, kNear, radius, countOnly, slots,
+					distances, counts, found, text);
+		}
+	};
+	auto printPoint = [&](int slot) {
+		if (fixed != nullptr) {
+			fixed->printPoint(slot);
+		} else {
+			tree.printPoint(slot);
+		}
+	};
+
+	//a quiet run writes the results of its last search as it goes
+	resultWriter writer;
+	bool writing = quiet && writer.open(output);
+	bool written = false;
+
+	//search the whole batch once per thread count, answers are identical every time
+	for (size_t run = 0; run < threadCounts.size(); run++) {
+		int threads = threadCounts[run];
+		taskPool pool(threads);
+		bool overlap = writing && run + 1 == threadCounts.size();
+		int block = overlap ? RESULT_BLOCK : max(count, 1);
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (int first = 0; first < count; first += block) {
+			int n = min(block, count - first);
+			size_t at = (size_t) first * perQuery;
+			if (radius >= 0) {
+				tree.findRangeBatch(queries.getPoint(first), n, radius,
+						&rangeCounts[first],
+						countOnly ? nullptr : &rangeSlots[first], &pool);
+			} else if (kNear > 0) {
+				tree.findKNearBatch(queries.getPoint(first), n, kNear,
+						&bestSlots[at], &bestDistances[at], &pool);
+			} else if (fixed != nullptr) {
+				fixed->findNearBatch(queries.getPoint(first), n, &bestSlots[at],
+						&bestDistances[at], &pool);
+			} else {
+				tree.findNearBatch(queries.getPoint(first), n, &bestSlots[at],
+						&bestDistances[at], &pool, eps, maxLeaves);
+			}
+			if (overlap) {
+				string text;
+				format(first, first + n, text);
+				writer.write(move(text));
+			}
+		}
+		if (overlap) {
+			written = writer.close();
+		}
+		double seconds = chrono::duration<double>(
+				chrono::steady_clock::now() - start).count();
+		cout << "Searched " << count << " queries with " << threads
+				<< " threads at " << (seconds > 0 ? count / seconds : 0)
+				<< " queries per second" << (overlap ? ", results written" : "")
+				<< endl;
+
+		if (approximate && count > 0) { //exact run to compare against
+			vector<int> exactSlots(count);
+			vector<double> exactDistances(count);
+			start = chrono::steady_clock::now();
+			tree.findNearBatch(queries.getPoint(0), count, &exactSlots[0],
+					&exactDistances[0], &pool);
+			double exactSeconds = chrono::duration<double>(
+					chrono::steady_clock::now() - start).count();
+
+			int hits = 0;
+			double worst = 1;
+			for (int i = 0; i < count; i++) {
+				if (bestDistances[i] == exactDistances[i]) { //ties count as found
+					hits++;
+				} else if (exactDistances[i] > 0) {
+					worst = max(worst, bestDistances[i] / exactDistances[i]);
+				}
+			}
+			cout << "Approximate search with eps " << eps << " and "
+					<< maxLeaves << " leaves: recall " << (double) hits / count
+					<< ", speedup " << (seconds > 0 ? exactSeconds / seconds : 0)
+					<< ", worst distance ratio " << worst << endl;
+		}
+	}
+	cout << endl;
+
+	if (quiet) {
+		if (written) {
+			cout << "Successful write out to " << output << endl;
+			return 0;
+		}
+		cout << "could not write results to " << output << endl;
+		return 1;
+	}
 
-	double bestDistance = DBL_MAX; //max value for double
-	nPoint * bestPt = nullptr;
 	ofstream myfile(output);
 
-	myfile.precision(dbl::max_digits10); //max precision for writing to file
 	if (myfile.is_open()) {
 
-		for (int i = 0; i < queries.size(); i++) { //iterate through all queries and search tree to find nearest neighbor
-			queries.at(i)->findNear(root, bestPt, bestDistance, k);
-
+		for (int i = 0; i < count && radius >= 0; i++) { //count then the indices found
+			cout << "For query " << i << " found " << rangeCounts[i]
+					<< " nodes within " << radius << "\n";
+		}
+		for (int i = 0; i < count && kNear == 0 && radius < 0; i++) { //report answers in input order
 			cout << "For query " << i << " closest node was ";
-			bestPt->print();
-			cout << " with distance of " << bestDistance << endl;
-			myfile << bestPt->getIndex() << "," << bestDistance << endl; //write to file
-
-			bestDistance = DBL_MAX;
-			bestPt = nullptr;
+			printPoint(bestSlots[i]);
+			cout << " with distance of " << bestDistances[i] << "\n";
 		}
+		for (int i = 0; i < count && kNear > 0 && radius < 0; i++) { //kNear index,distance pairs per line
+			cout << "For query " << i << " closest " << kNear << " nodes were";
+			for (int j = 0; j < kNear; j++) {
+				size_t at = (size_t) i * kNear + j;
+				if (bestSlots[at] < 0) { //tree holds fewer than kNear points
+					break;
+				}
+				cout << (j > 0 ? ", " : " ");
+				printPoint(bestSlots[at]);
+				cout << " with distance of " << bestDistances[at];
+			}
+			cout << "\n";
+		}
+
+		//the file gets the same text a quiet run writes, in one piece
+		string text;
+		format(0, count, text);
+		myfile.write(text.data(), text.size());
 		cout << "Successful write out to " << output << endl;
 		myfile.close();
 
@@ -79,11 +367,4 @@ int main(int argc, char *argv[]) {
 		cout << "could not open file to read queries\n";
 	}
 
-	delete bestPt;
-
-	delete root; //delete entire tree, including associated data
-
-	queries.clear();
-
 }
-
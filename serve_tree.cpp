@@ -0,0 +1,149 @@
+//============================================================================
+// Name        : serve_kdtree.cpp
+/*
+ This file is part of kdTree.
+
+ kdTree is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ kdTree is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with kdTree.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Description : Load a tree once and answer nearest neighbor requests
+// arriving on a unix domain socket or stdin until interrupted
+//============================================================================
+
+#include "queryServer.h"
+#include <csignal>
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void onSignal(int) {
+	interrupted = 1;
+}
+
+static void printStats(const serveStats& stats) {
+	cout << "Answered " << stats.requests << " requests, " << stats.queries
+			<< " queries in " << stats.batches << " batches, latency p50 "
+			<< stats.p50 << " us, p99 " << stats.p99 << " us" << endl;
+}
+
+int main(int argc, char *argv[]) {
+
+	string treeFile = "treeOut.kdt";
+	string socketPath = "kdtree.sock";
+	bool useStdin = false; //frames on stdin, responses on stdout
+	int threads = 1;
+	int dims = 0; //0 takes the dimensions from a binary tree file
+	bool verify = true;
+	int boxes = -1; //-1 uses the bounding boxes a binary tree file carries
+	int packet = 1;
+	int report = 10; //seconds between latency reports, 0 for none
+
+	int position = 0;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg.compare(0, 2, "--") == 0) {
+			if (i + 1 >= argc) {
+				cout << "Missing value for option " << arg << endl;
+				return 1;
+			}
+			if (arg == "--socket") {
+				socketPath = argv[++i];
+			} else if (arg == "--stdin") {
+				useStdin = atoi(argv[++i]) != 0;
+			} else if (arg == "--threads") {
+				threads = max(1, atoi(argv[++i]));
+			} else if (arg == "--dims") {
+				dims = atoi(argv[++i]);
+			} else if (arg == "--verify") {
+				verify = atoi(argv[++i]) != 0;
+			} else if (arg == "--boxes") {
+				boxes = atoi(argv[++i]);
+			} else if (arg == "--packet") {
+				packet = atoi(argv[++i]);
+			} else if (arg == "--report") {
+				report = atoi(argv[++i]);
+			} else {
+				cout << "Unknown option " << arg << endl;
+				return 1;
+			}
+		} else if (position == 0) {
+			treeFile = arg;
+			position++;
+		}
+	}
+
+	//stdout carries the responses, so every message goes to stderr
+	if (useStdin) {
+		cout.rdbuf(cerr.rdbuf());
+	}
+
+	if (dims == 0 && isBinaryTree(treeFile)) {
+		treeFileHeader header;
+		ifstream file(treeFile, ios::binary);
+		file.read((char *) &header, sizeof(header));
+		dims = file ? header.dims : 0;
+	}
+	if (dims < 1) {
+		cout << "Give the tree dimensions with --dims for a text tree" << endl;
+		return 1;
+	}
+
+	flatTree tree;
+	tree.setBoundingBoxes(boxes > 0 || (boxes < 0 && isBinaryTree(treeFile)));
+	tree.setPacketSize(packet);
+	if (!tree.readTree(treeFile, dims, verify)) {
+		cout << "Error reading in tree from file, exiting\n";
+		return 1;
+	}
+	cout << "Tree read in success, " << tree.getSize() << " points in "
+			<< dims << " dimensions" << endl;
+
+	taskPool pool(threads);
+	queryServer server(tree, &pool);
+
+	if (useStdin) {
+		server.serve(0, 1);
+		server.stop();
+		printStats(server.getStats());
+		return 0;
+	}
+
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+	bool listened = true;
+	thread acceptor([&server, &listened, socketPath]() {
+		listened = server.listenOn(socketPath);
+		if (!listened) {
+			interrupted = 1;
+		}
+	});
+	cout << "Listening on " << socketPath << " with " << threads
+			<< " threads" << endl;
+
+	uint64_t reported = 0;
+	for (int tick = 1; !interrupted; tick++) {
+		this_thread::sleep_for(chrono::milliseconds(100));
+		serveStats stats = server.getStats();
+		if (report > 0 && tick % (report * 10) == 0
+				&& stats.requests != reported) {
+			printStats(stats);
+			reported = stats.requests;
+		}
+	}
+
+	server.stopListening();
+	acceptor.join();
+	server.stop();
+	printStats(server.getStats());
+	return listened ? 0 : 1;
+}
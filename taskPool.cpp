@@ -0,0 +1,144 @@
+/*
+ * taskPool.cpp
+ */
+
+/*
+ This file is part of kdTree.
+
+ kdTree is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ kdTree is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with kdTree.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "taskPool.h"
+
+//pool and queue owned by the current thread, workers set these once at start
+static thread_local const taskPool * ownerPool = nullptr;
+static thread_local int ownerQueue = 0;
+
+taskPool::taskPool(int threads) :
+		threads(threads < 1 ? 1 : threads), queues(this->threads), stopping(
+				false), queued(0) {
+	for (int i = 1; i < this->threads; i++) {
+		workers.push_back(thread(&taskPool::workerLoop, this, i));
+	}
+}
+
+taskPool::~taskPool() {
+	{
+		lock_guard<mutex> guard(sleepLock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (thread& t : workers) {
+		t.join();
+	}
+}
+
+int taskPool::getThreads() const {
+	return threads;
+}
+
+int taskPool::currentQueue() const {
+	return ownerPool == this ? ownerQueue : 0;
+}
+
+void taskPool::spawn(taskGroup& group, function<void()> run) {
+	group.pending++;
+
+	workQueue& q = queues[currentQueue()];
+	{
+		lock_guard<mutex> guard(q.lock);
+		q.tasks.push_back(task { run, &group });
+	}
+	queued++;
+
+	if (threads > 1) {
+		lock_guard<mutex> guard(sleepLock); //pairs with the predicate check in workerLoop
+		wake.notify_one();
+	}
+}
+
+//newest own task first keeps the working set hot, oldest stolen task first
+//hands the thief the biggest piece of work
+bool taskPool::findTask(int self, task& out) {
+	if (queued.load() == 0) {
+		return false;
+	}
+	for (int i = 0; i < threads; i++) {
+		int victim = (self + i) % threads;
+		workQueue& q = queues[victim];
+		lock_guard<mutex> guard(q.lock);
+		if (!q.tasks.empty()) {
+			if (i == 0) {
+				out = move(q.tasks.back());
+				q.tasks.pop_back();
+			} else {
+				out = move(q.tasks.front());
+				q.tasks.pop_front();
+			}
+			queued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+void taskPool::runTask(task& t) {
+	t.run();
+	t.group->pending--;
+}
+
+void taskPool::workerLoop(int self) {
+	ownerPool = this;
+	ownerQueue = self;
+
+	task t;
+	while (true) {
+		if (findTask(self, t)) {
+			runTask(t);
+			continue;
+		}
+		unique_lock<mutex> guard(sleepLock);
+		if (stopping) {
+			return;
+		}
+		wake.wait(guard, [this] {return stopping || queued.load() > 0;});
+	}
+}
+
+void taskPool::wait(taskGroup& group) {
+	int self = currentQueue();
+	task t;
+	while (group.pending.load() > 0) {
+		if (findTask(self, t)) {
+			runTask(t);
+		} else {
+			this_thread::yield(); //remaining tasks are running on other threads
+		}
+	}
+}
+
+void taskPool::parallelFor(size_t total, int count,
+		function<void(size_t, size_t)> body) {
+	if (count < 1) {
+		count = 1;
+	}
+	taskGroup group;
+	for (int c = 1; c < count; c++) {
+		size_t begin = total * c / count;
+		size_t end = total * (c + 1) / count;
+		spawn(group, [body, begin, end] {body(begin, end);});
+	}
+	body(0, total / count); //first chunk runs on the calling thread
+	wait(group);
+}
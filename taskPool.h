@@ -0,0 +1,98 @@
+/*
+ * taskPool.h
+ */
+
+/*
+ This file is part of kdTree.
+
+ kdTree is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ kdTree is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with kdTree.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TASKPOOL_H_
+#define TASKPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+//counts the tasks of one job that have not finished yet
+struct taskGroup {
+	atomic<int> pending;
+
+	taskGroup() :
+			pending(0) {
+	}
+};
+
+//work-stealing pool: every thread owns a deque, pushes and pops its own work
+//at the back and steals from the front of the others when it runs dry.
+//the thread that calls wait() works as thread 0, so a pool of n threads
+//starts n - 1 workers and a pool of one thread runs everything inline
+class taskPool {
+protected:
+	struct task {
+		function<void()> run;
+		taskGroup * group;
+	};
+
+	//one deque per thread, padded so neighbouring locks do not share a line
+	struct workQueue {
+		mutex lock;
+		deque<task> tasks;
+		char pad[64];
+	};
+
+	int threads;
+	vector<workQueue> queues;
+	vector<thread> workers;
+	atomic<bool> stopping;
+	atomic<int> queued;	//tasks sitting in any deque
+	mutex sleepLock;
+	condition_variable wake;
+
+	//queue of the calling thread, 0 for threads outside the pool
+	int currentQueue() const;
+
+	//pop own work or steal, returns false if every deque is empty
+	bool findTask(int self, task& out);
+
+	void runTask(task& t);
+
+	void workerLoop(int self);
+
+public:
+	taskPool(int threads);
+
+	int getThreads() const;
+
+	//queue a task as part of group
+	void spawn(taskGroup& group, function<void()> run);
+
+	//run queued tasks until every task of group has finished
+	void wait(taskGroup& group);
+
+	//call body(begin, end) on count chunks of [0, total) and wait for all of them
+	void parallelFor(size_t total, int count,
+			function<void(size_t, size_t)> body);
+
+	~taskPool();
+};
+
+#endif /* TASKPOOL_H_ */
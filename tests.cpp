@@ -22,7 +22,13 @@
 
 // Description : Tests functions from kdTree.h and kdTree.cpp
 //============================================================================
-#include "kdTree.h"
+#include "fixedTree.h"
+#include "treeForest.h"
+#include "queryServer.h"
+#include <random>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 //fill vector with points from csv
 vector<double*> fillVector(vector<double*> arr, string file) {
@@ -230,7 +236,7 @@ bool testDist(vector<double*>& tree, vector<double*>& Q, treeNode * root,
 			}
 		}
 
-		queries.at(q)->findNear(root, bestPt, bestDistance, dims); //use nearest neighbor algorithim
+		queries.at(q)->findNear(root, bestPt, bestDistance); //use nearest neighbor algorithim
 
 		if (bestPt->getIndex() == cIndex && bestDistance == sqrt(minDist)) {
 		} else {
@@ -252,6 +258,2087 @@ bool testDist(vector<double*>& tree, vector<double*>& Q, treeNode * root,
 	return someTestFail;
 }
 
+//compare two files on disk, returns if they are identical
+bool sameFiles(string first, string second) {
+	FILE * pFile = fopen(first.c_str(), "r");
+	FILE * qFile = fopen(second.c_str(), "r");
+	bool isId = false;
+	if (pFile != NULL && qFile != NULL) {
+		isId = compareFile(pFile, qFile);
+	} else {
+		cout << "ERROR, comparison files " << first << " and " << second
+				<< " could not be located\n";
+	}
+	if (pFile != NULL)
+		fclose(pFile);
+	if (qFile != NULL)
+		fclose(qFile);
+	return isId;
+}
+
+//test the flat tree layout against the pointer-linked tree, returns if any tests failed
+bool testFlat(vector<nPoint*>& pointVector, vector<nPoint*>& queries,
+		treeNode * root, int k, int axisMode) {
+
+	bool someTestFail = false;
+
+	flatTree flat;
+	if (flat.makeTree(pointVector, k, axisMode) == nullptr) {
+		cout << "\nFLAT TREE CREATION FAILED\n";
+		return true;
+	}
+
+	//flat tree must write exactly the same file as the linked tree
+	root->writeOut("newTree.txt", k);
+	flat.writeOut("flatTree.txt");
+	if (sameFiles("newTree.txt", "flatTree.txt")) {
+		cout << "\nFLAT TREE WRITE PASSED\n";
+	} else {
+		cout << "\nFLAT TREE WRITE FAILED\n";
+		someTestFail = true;
+	}
+
+	//read back and write again
+	flatTree readBack;
+	if (readBack.readTree("flatTree.txt", k) == nullptr) {
+		cout << "\nFLAT TREE READ FAILED\n";
+		return true;
+	}
+	readBack.writeOut("flatRe-write.txt");
+	if (sameFiles("flatTree.txt", "flatRe-write.txt")) {
+		cout << "\nFLAT TREE REWRITE PASSED\n";
+	} else {
+		cout << "\nFLAT TREE REWRITE FAILED\n";
+		someTestFail = true;
+	}
+
+	//every query must give the same answer in both layouts
+	int mismatch = 0;
+	for (size_t i = 0; i < queries.size(); i++) {
+		double bestDistance = DBL_MAX;
+		nPoint * bestPt = nullptr;
+		queries[i]->findNear(root, bestPt, bestDistance);
+
+		double flatDistance = DBL_MAX;
+		int bestSlot = -1;
+		queries[i]->findNear(&readBack, bestSlot, flatDistance);
+
+		if (bestSlot < 0 || readBack.getIndex(bestSlot) != bestPt->getIndex()
+				|| flatDistance != bestDistance) {
+			mismatch++;
+		}
+	}
+	if (mismatch == 0) {
+		cout << "\nFLAT TREE QUERRIES PASSED\n";
+	} else {
+		cout << "\nFLAT TREE QUERRIES FAILED FOR " << mismatch << " QUERRIES\n";
+		someTestFail = true;
+	}
+
+	//batch search on several threads must answer in input order
+	int count = queries.size();
+	vector<double> block((size_t) count * k);
+	for (int i = 0; i < count; i++) {
+		memcpy(&block[(size_t) i * k], queries[i]->getCords(), k * sizeof(double));
+	}
+	vector<int> batchSlots(count);
+	vector<double> batchDistances(count);
+	taskPool pool(4);
+	readBack.findNearBatch(&block[0], count, &batchSlots[0], &batchDistances[0],
+			&pool);
+	mismatch = 0;
+	for (int i = 0; i < count; i++) {
+		double bestDistance = DBL_MAX;
+		int bestSlot = -1;
+		queries[i]->findNear(&readBack, bestSlot, bestDistance);
+		if (batchSlots[i] != bestSlot || batchDistances[i] != bestDistance) {
+			mismatch++;
+		}
+	}
+	if (mismatch == 0) {
+		cout << "\nBATCH QUERRIES PASSED\n";
+	} else {
+		cout << "\nBATCH QUERRIES FAILED FOR " << mismatch << " QUERRIES\n";
+		someTestFail = true;
+	}
+
+	//bucketed leaves must survive a round trip and give the same distances
+	int leafSizes[3] = { 2, 8, 32 };
+	for (int leafSize : leafSizes) {
+		flatTree bucket;
+		bucket.makeTree(pointVector, k, axisMode, leafSize);
+		bucket.writeOut("bucketTree.txt");
+
+		flatTree bucketBack;
+		if (bucketBack.readTree("bucketTree.txt", k) == nullptr
+				|| bucketBack.getLeafSize() != leafSize) {
+			cout << "\nBUCKET TREE READ FAILED FOR LEAF SIZE " << leafSize << "\n";
+			someTestFail = true;
+			continue;
+		}
+		bucketBack.writeOut("bucketRe-write.txt");
+		if (!sameFiles("bucketTree.txt", "bucketRe-write.txt")) {
+			cout << "\nBUCKET TREE REWRITE FAILED FOR LEAF SIZE " << leafSize
+					<< "\n";
+			someTestFail = true;
+		}
+
+		mismatch = 0;
+		for (size_t i = 0; i < queries.size(); i++) {
+			double bestDistance = DBL_MAX;
+			nPoint * bestPt = nullptr;
+			queries[i]->findNear(root, bestPt, bestDistance);
+
+			double bucketDistance = DBL_MAX;
+			int bestSlot = -1;
+			queries[i]->findNear(&bucketBack, bestSlot, bucketDistance);
+
+			if (bestSlot < 0 || bucketDistance != bestDistance) {
+				mismatch++;
+			}
+		}
+		if (mismatch == 0) {
+			cout << "\nBUCKET TREE QUERRIES PASSED FOR LEAF SIZE " << leafSize
+					<< "\n";
+		} else {
+			cout << "\nBUCKET TREE QUERRIES FAILED FOR LEAF SIZE " << leafSize
+					<< "\n";
+			someTestFail = true;
+		}
+	}
+
+	return someTestFail;
+}
+
+//parallel builds must give exactly the sequential tree, returns if any tests failed
+bool testParallel(vector<nPoint*>& pointVector, int k, int axisMode) {
+
+	bool someTestFail = false;
+	taskPool pool(4);
+
+	//default cutoffs, must still match the linked tree written to newTree.txt
+	flatTree parallel;
+	parallel.makeTree(pointVector, k, axisMode, 1, &pool);
+	parallel.writeOut("parallelTree.txt");
+	if (sameFiles("newTree.txt", "parallelTree.txt")) {
+		cout << "\nPARALLEL TREE WRITE PASSED\n";
+	} else {
+		cout << "\nPARALLEL TREE WRITE FAILED\n";
+		someTestFail = true;
+	}
+
+	//tiny cutoffs so tasks and the stable partition run on every level
+	int leafSizes[2] = { 1, 8 };
+	for (int leafSize : leafSizes) {
+		flatTree sequential;
+		sequential.setBuildCutoffs(16, 64);
+		sequential.makeTree(pointVector, k, axisMode, leafSize);
+		sequential.writeOut("sequentialTree.txt");
+
+		for (int threads = 1; threads <= 4; threads *= 2) {
+			taskPool small(threads);
+			flatTree split;
+			split.setBuildCutoffs(16, 64);
+			split.makeTree(pointVector, k, axisMode, leafSize, &small);
+			split.writeOut("parallelTree.txt");
+
+			bool sameNodes = split.getNodeCount() == sequential.getNodeCount();
+			for (int n = 0; sameNodes && n < split.getNodeCount(); n++) {
+				sameNodes = memcmp(&split.getNode(n), &sequential.getNode(n),
+						sizeof(flatNode)) == 0;
+			}
+			if (!sameNodes || !sameFiles("sequentialTree.txt", "parallelTree.txt")) {
+				cout << "\nPARALLEL BUILD FAILED FOR " << threads
+						<< " THREADS AND LEAF SIZE " << leafSize << "\n";
+				someTestFail = true;
+			}
+		}
+	}
+	if (!someTestFail) {
+		cout << "\nPARALLEL BUILDS MATCH SEQUENTIAL BUILDS PASSED\n";
+	}
+
+	return someTestFail;
+}
+
+//arena trees must build and read exactly the heap tree, returns if any tests failed
+bool testArena(vector<nPoint*>& pointVector, vector<nPoint*>& queries,
+		treeNode * root, int k, int axisMode) {
+
+	bool someTestFail = false;
+
+	//built from the same points, must write the file of the heap tree
+	arenaTree built;
+	if (built.makeTree(pointVector, k, axisMode) == nullptr) {
+		cout << "\nARENA TREE CREATION FAILED\n";
+		return true;
+	}
+	built.getRoot()->writeOut("arenaTree.txt", k);
+	if (sameFiles("newTree.txt", "arenaTree.txt")) {
+		cout << "\nARENA TREE WRITE PASSED\n";
+	} else {
+		cout << "\nARENA TREE WRITE FAILED\n";
+		someTestFail = true;
+	}
+
+	//read back into a second arena and write again
+	arenaTree readBack;
+	if (readBack.readTree("arenaTree.txt", k) == nullptr) {
+		cout << "\nARENA TREE READ FAILED\n";
+		return true;
+	}
+	readBack.getRoot()->writeOut("arenaRe-write.txt", k);
+	if (sameFiles("arenaTree.txt", "arenaRe-write.txt")) {
+		cout << "\nARENA TREE REWRITE PASSED\n";
+	} else {
+		cout << "\nARENA TREE REWRITE FAILED\n";
+		someTestFail = true;
+	}
+
+	//every query must give the same answer from both arena trees
+	int mismatch = 0;
+	for (size_t i = 0; i < queries.size(); i++) {
+		double bestDistance = DBL_MAX;
+		nPoint * bestPt = nullptr;
+		queries[i]->findNear(root, bestPt, bestDistance);
+
+		arenaTree * trees[2] = { &built, &readBack };
+		for (arenaTree * tree : trees) {
+			double arenaDistance = DBL_MAX;
+			nPoint * arenaPt = nullptr;
+			queries[i]->findNear(tree->getRoot(), arenaPt, arenaDistance);
+			if (arenaPt == nullptr || arenaPt->getIndex() != bestPt->getIndex()
+					|| arenaDistance != bestDistance) {
+				mismatch++;
+			}
+		}
+	}
+	if (mismatch == 0) {
+		cout << "\nARENA TREE QUERRIES PASSED\n";
+	} else {
+		cout << "\nARENA TREE QUERRIES FAILED FOR " << mismatch << " QUERRIES\n";
+		someTestFail = true;
+	}
+
+	//a cleared tree can be built again in the same arena
+	built.clear();
+	if (built.getRoot() != nullptr || built.getBytes() != 0
+			|| built.makeTree(pointVector, k, axisMode) == nullptr) {
+		cout << "\nARENA TREE REUSE FAILED\n";
+		someTestFail = true;
+	}
+
+	return someTestFail;
+}
+
+//k nearest neighbor search against brute force, returns if any tests failed
+bool testKNear(vector<double*>& tree, vector<double*>& Q, flatTree& flat,
+		int dims) {
+
+	bool someTestFail = false;
+	int kNears[3] = { 1, 5, 20 };
+	nearHeap heap;
+
+	for (int kNear : kNears) {
+		heap.reset(kNear);
+		for (int q = 0; q < 50; q++) {
+			//brute force distances, sorted closest first
+			vector<double> all;
+			for (size_t t = 0; t < tree.size(); t++) {
+				double sum = 0;
+				for (int dim = 0; dim < dims; dim++) {
+					double dif = Q[q][dim] - tree[t][dim];
+					sum += dif * dif;
+				}
+				all.push_back(sqrt(sum));
+			}
+			sort(all.begin(), all.end());
+
+			flat.findKNear(Q[q], heap);
+			if (heap.getSize() != kNear) {
+				someTestFail = true;
+				continue;
+			}
+			for (int j = 0; j < kNear; j++) {
+				if (heap.getDistance(j) != all[j]
+						|| flat.getAbDist(Q[q], heap.getSlot(j)) != all[j]) {
+					someTestFail = true;
+				}
+			}
+		}
+	}
+	if (someTestFail) {
+		cout << "\nK NEAREST NEIGHBOR TESTS FAILED\n";
+	} else {
+		cout << "\nK NEAREST NEIGHBOR TESTS PASSED\n";
+	}
+	return someTestFail;
+}
+
+//binary tree files must map back to the same tree, returns if any tests failed
+bool testBinary(flatTree& flat, vector<nPoint*>& queries, int k) {
+
+	bool someTestFail = false;
+
+	flat.writeOut("binarySource.txt");
+	if (!flat.writeBinary("binaryTree.kdt")) {
+		cout << "\nBINARY TREE WRITE FAILED\n";
+		return true;
+	}
+
+	flatTree mapped;
+	if (mapped.readTree("binaryTree.kdt", k) == nullptr || !mapped.isMapped()) {
+		cout << "\nBINARY TREE MAP FAILED\n";
+		return true;
+	}
+	mapped.writeOut("binaryExport.txt");
+	if (sameFiles("binarySource.txt", "binaryExport.txt")) {
+		cout << "\nBINARY TREE EXPORT PASSED\n";
+	} else {
+		cout << "\nBINARY TREE EXPORT FAILED\n";
+		someTestFail = true;
+	}
+
+	int mismatch = 0;
+	for (size_t i = 0; i < queries.size(); i++) {
+		double bestDistance = DBL_MAX;
+		int bestSlot = -1;
+		queries[i]->findNear(&flat, bestSlot, bestDistance);
+
+		double mappedDistance = DBL_MAX;
+		int mappedSlot = -1;
+		queries[i]->findNear(&mapped, mappedSlot, mappedDistance);
+		if (bestSlot != mappedSlot || bestDistance != mappedDistance) {
+			mismatch++;
+		}
+	}
+	if (mismatch == 0) {
+		cout << "\nBINARY TREE QUERRIES PASSED\n";
+	} else {
+		cout << "\nBINARY TREE QUERRIES FAILED\n";
+		someTestFail = true;
+	}
+
+	//flip one coordinate byte, the checksum must catch it
+	fstream corrupt("binaryTree.kdt", ios::in | ios::out | ios::binary);
+	treeFileHeader header;
+	corrupt.read((char *) &header, sizeof(header));
+	corrupt.seekg(header.cordOffset);
+	char byte = corrupt.get();
+	corrupt.seekp(header.cordOffset);
+	corrupt.put(byte ^ 1);
+	corrupt.close();
+
+	flatTree damaged;
+	if (damaged.readTree("binaryTree.kdt", k) == nullptr
+			&& damaged.readTree("binaryTree.kdt", k, false) != nullptr) {
+		cout << "\nBINARY TREE CHECKSUM PASSED\n";
+	} else {
+		cout << "\nBINARY TREE CHECKSUM FAILED\n";
+		someTestFail = true;
+	}
+
+	//a child past the node array and sizes that overflow must be refused
+	//even without the checksum
+	flatNode root;
+	corrupt.open("binaryTree.kdt", ios::in | ios::out | ios::binary);
+	corrupt.seekg(header.nodeOffset);
+	corrupt.read((char *) &root, sizeof(root));
+	root.child = header.nodeCount;
+	corrupt.seekp(header.nodeOffset);
+	corrupt.write((const char *) &root, sizeof(root));
+	corrupt.close();
+	bool badChild = damaged.readTree("binaryTree.kdt", k, false) == nullptr;
+
+	treeFileHeader huge = header;
+	huge.pointCount = UINT64_MAX / 8 + 2;
+	corrupt.open("binaryTree.kdt", ios::in | ios::out | ios::binary);
+	corrupt.write((const char *) &huge, sizeof(huge));
+	corrupt.close();
+	bool badSize = damaged.readTree("binaryTree.kdt", k, false) == nullptr;
+
+	if (badChild && badSize) {
+		cout << "\nBINARY TREE BOUNDS PASSED\n";
+	} else {
+		cout << "\nBINARY TREE BOUNDS FAILED\n";
+		someTestFail = true;
+	}
+
+	return someTestFail;
+}
+
+//pointBlock must parse every cell to the same bits as getDataFile
+bool sameParse(string file, taskPool * pool) {
+	vector<nPoint*> points;
+	int k = getDataFile(file, points);
+
+	pointBlock block;
+	bool same = block.readFile(file, pool) == k
+			&& block.getSize() == (int) points.size();
+	for (int i = 0; same && i < block.getSize(); i++) {
+		same = memcmp(block.getPoint(i), points[i]->getCords(),
+				k * sizeof(double)) == 0;
+	}
+
+	for (nPoint * p : points) {
+		delete p;
+	}
+	return same;
+}
+
+bool testCsv(string fileName, string qFile) {
+
+	bool someTestFail = false;
+
+	//signs, spaces, hex, overflow, windows line endings and empty cells all
+	//take the atof path and a last line without a newline still counts
+	ofstream tricky("csvTricky.txt");
+	tricky << "+1.5, 2.25,0x1p3\n" << "1e400,-0,.5\r\n" << "7,,-1e-320\n"
+			<< "3.14159265358979311599796346854,1,2";
+	tricky.close();
+
+	taskPool pool(4);
+	string files[] = { fileName, qFile, "csvTricky.txt" };
+	for (string file : files) {
+		if (!sameParse(file, nullptr) || !sameParse(file, &pool)) {
+			cout << "\nCSV PARSE FAILED ON " << file << "\n";
+			someTestFail = true;
+		}
+	}
+	if (!someTestFail) {
+		cout << "\nCSV PARSE PASSED\n";
+	}
+
+	return someTestFail;
+}
+
+//squared distance search with the unrolled and the early exit kernels must
+//find the same distances as brute force
+bool testSquared() {
+
+	bool someTestFail = false;
+	mt19937 gen(2016);
+	uniform_real_distribution<double> dist(-1.0, 1.0);
+
+	int dimList[] = { 2, 3, 7 };
+	for (int k : dimList) {
+		vector<nPoint*> points;
+		vector<nPoint*> queries;
+		for (int i = 0; i < 3000; i++) {
+			double * pCords = new double[k];
+			for (int d = 0; d < k; d++) {
+				pCords[d] = dist(gen);
+			}
+			(i < 2000 ? points : queries).push_back(new nPoint(i, k, pCords));
+		}
+
+		flatTree flat;
+		flat.makeTree(points, k, 1, 8);
+		nearHeap heap(5);
+		int mismatch = 0;
+		for (nPoint * q : queries) {
+			vector<double> all;
+			for (nPoint * p : points) {
+				all.push_back(q->getAbDist(p));
+			}
+			sort(all.begin(), all.end());
+
+			int bestSlot = -1;
+			double bestDistance = DBL_MAX;
+			q->findNear(&flat, bestSlot, bestDistance);
+			flat.findKNear(q->getCords(), heap);
+			if (bestDistance != all[0]
+					|| flat.getAbDist(q->getCords(), bestSlot) != all[0]) {
+				mismatch++;
+			}
+			for (int j = 0; j < heap.getSize(); j++) {
+				if (heap.getDistance(j) != all[j]) {
+					mismatch++;
+				}
+			}
+		}
+		if (mismatch > 0) {
+			cout << "\nSQUARED DISTANCE SEARCH FAILED FOR " << k
+					<< " DIMENSIONS\n";
+			someTestFail = true;
+		}
+
+		for (nPoint * p : points) {
+			delete p;
+		}
+		for (nPoint * p : queries) {
+			delete p;
+		}
+	}
+	if (!someTestFail) {
+		cout << "\nSQUARED DISTANCE SEARCH PASSED\n";
+	}
+
+	return someTestFail;
+}
+
+//compiled trees from the dispatcher must give exactly the flatTree answers,
+//the float tree must find points at the same distance up to float rounding
+bool testFixed(string fileName, string qFile) {
+
+	bool someTestFail = false;
+	mt19937 gen(2016);
+	uniform_real_distribution<double> dist(-1.0, 1.0);
+
+	pointBlock data;
+	pointBlock queries;
+	data.readFile(fileName);
+	queries.readFile(qFile);
+	vector<pointBlock> dataSets(1, data);
+	vector<pointBlock> querySets(1, queries);
+
+	int dimList[] = { 1, 2, 8, 11 }; //11 runs on the flatTree fallback
+	for (int k : dimList) {
+		vector<double> cords(2000 * k);
+		for (double& c : cords) {
+			c = dist(gen);
+		}
+		dataSets.push_back(pointBlock());
+		dataSets.back().assign(&cords[0], 1500, k);
+		querySets.push_back(pointBlock());
+		querySets.back().assign(&cords[1500 * k], 500, k);
+	}
+
+	for (size_t set = 0; set < dataSets.size(); set++) {
+		const pointBlock& points = dataSets[set];
+		const pointBlock& Q = querySets[set];
+		int k = points.getDims();
+		int count = Q.getSize();
+
+		flatTree flat;
+		flat.makeTree(points, 1, 4);
+		searchTree * fixed = makeSearchTree(k);
+		fixed->build(points, 1, 4);
+
+		vector<int> flatSlots(count);
+		vector<double> flatDistances(count);
+		vector<int> fixedSlots(count);
+		vector<double> fixedDistances(count);
+		flat.findNearBatch(Q.getPoint(0), count, &flatSlots[0],
+				&flatDistances[0]);
+		fixed->findNearBatch(Q.getPoint(0), count, &fixedSlots[0],
+				&fixedDistances[0]);
+
+		int mismatch = 0;
+		for (int i = 0; i < count; i++) {
+			if (flat.getIndex(flatSlots[i]) != fixed->getIndex(fixedSlots[i])
+					|| flatDistances[i] != fixedDistances[i]) {
+				mismatch++;
+			}
+		}
+		if (mismatch > 0) {
+			cout << "\nFIXED TREE FAILED FOR " << k << " DIMENSIONS\n";
+			someTestFail = true;
+		}
+
+		//a file written by either tree reads back into the other with the
+		//same answers
+		flatTree written;
+		searchTree * reloaded = makeSearchTree(k);
+		if (!fixed->writeBinary("fixedTree.kdt")
+				|| written.readTree("fixedTree.kdt", k) == nullptr
+				|| !flat.writeBinary("fixedTree.kdt")
+				|| !reloaded->readTree("fixedTree.kdt")) {
+			cout << "\nFIXED TREE FILES FAILED FOR " << k << " DIMENSIONS\n";
+			someTestFail = true;
+		} else {
+			vector<int> writtenSlots(count);
+			vector<double> writtenDistances(count);
+			written.findNearBatch(Q.getPoint(0), count, &writtenSlots[0],
+					&writtenDistances[0]);
+			reloaded->findNearBatch(Q.getPoint(0), count, &fixedSlots[0],
+					&fixedDistances[0]);
+			for (int i = 0; i < count; i++) {
+				if (written.getIndex(writtenSlots[i])
+						!= flat.getIndex(flatSlots[i])
+						|| reloaded->getIndex(fixedSlots[i])
+								!= flat.getIndex(flatSlots[i])
+						|| writtenDistances[i] != flatDistances[i]
+						|| fixedDistances[i] != flatDistances[i]) {
+					cout << "\nFIXED TREE FILES FAILED FOR " << k
+							<< " DIMENSIONS\n";
+					someTestFail = true;
+					break;
+				}
+			}
+		}
+		delete reloaded;
+		delete fixed;
+	}
+
+	kdTree<3, float> small;
+	small.build(data, 1);
+	vector<int> slots(queries.getSize());
+	vector<double> distances(queries.getSize());
+	small.findNearBatch(queries.getPoint(0), queries.getSize(), &slots[0],
+			&distances[0]);
+	flatTree flat;
+	flat.makeTree(data, 1);
+	for (int i = 0; i < queries.getSize(); i++) {
+		int bestSlot = -1;
+		double bestDistance = DBL_MAX;
+		flat.findNear(queries.getPoint(i), bestSlot, bestDistance);
+		if (fabs(distances[i] - bestDistance) > 1e-5 * (1 + bestDistance)) {
+			cout << "\nFLOAT TREE FAILED ON QUERY " << i << "\n";
+			someTestFail = true;
+			break;
+		}
+	}
+
+	//a float tree reads the doubles of a text tree file
+	flat.writeOut("fixedTree.txt");
+	kdTree<3, float> loaded;
+	if (!loaded.readTree("fixedTree.txt") || loaded.getSize() != flat.getSize()) {
+		cout << "\nFLOAT TREE FAILED TO READ A TEXT TREE\n";
+		someTestFail = true;
+	} else {
+		loaded.findNearBatch(queries.getPoint(0), queries.getSize(), &slots[0],
+				&distances[0]);
+		for (int i = 0; i < queries.getSize(); i++) {
+			int bestSlot = -1;
+			double bestDistance = DBL_MAX;
+			flat.findNear(queries.getPoint(i), bestSlot, bestDistance);
+			if (fabs(distances[i] - bestDistance) > 1e-5 * (1 + bestDistance)) {
+				cout << "\nFLOAT TREE FAILED ON READ QUERY " << i << "\n";
+				someTestFail = true;
+				break;
+			}
+		}
+	}
+
+	if (!someTestFail) {
+		cout << "\nFIXED TREE PASSED\n";
+	}
+
+	return someTestFail;
+}
+
+//the iterative searches must visit the same points as the recursive ones,
+//including on a chain deeper than the search stack
+bool testIterative(string fileName, string qFile) {
+
+	bool someTestFail = false;
+
+	pointBlock data;
+	pointBlock queries;
+	data.readFile(fileName);
+	queries.readFile(qFile);
+
+	//every split holds one point on the left and the rest of the chain on
+	//the right, so the tree is 300 levels deep
+	int chain = 300;
+	ofstream deep("deepTree.txt");
+	deep.precision(dbl::max_digits10);
+	for (int i = 0; i < chain - 1; i++) {
+		deep << "0," << i << ",NOT_LEAF,0," << i << "," << i << ",1," << i
+				<< ",NULL,NULL,";
+	}
+	deep << "0," << chain - 1 << "," << chain - 1 << ",1," << chain - 1
+			<< ",NULL,NULL,";
+	deep.close();
+
+	flatTree trees[3];
+	trees[0].makeTree(data, 1);
+	trees[1].makeTree(data, 1, 8);
+	if (trees[2].readTree("deepTree.txt", 1) == nullptr) {
+		cout << "\nDEEP TREE READ FAILED\n";
+		return true;
+	}
+
+	nearHeap heap(4);
+	nearHeap recurHeap(4);
+	int mismatch = 0;
+	for (flatTree& tree : trees) {
+		int count = tree.getDims() == 1 ? chain * 2 : queries.getSize();
+		for (int i = 0; i < count; i++) {
+			double chainQuery = i * 0.5 - 0.25;
+			const double * query =
+					tree.getDims() == 1 ? &chainQuery : queries.getPoint(i);
+
+			int bestSlot = -1;
+			double bestDistance = DBL_MAX;
+			tree.findNear(query, bestSlot, bestDistance);
+			int recurSlot = -1;
+			double recurDistance = DBL_MAX;
+			tree.findNearRecursive(query, recurSlot, recurDistance);
+			if (bestSlot != recurSlot || bestDistance != recurDistance) {
+				mismatch++;
+			}
+
+			tree.findKNear(query, heap);
+			tree.findKNearRecursive(query, recurHeap);
+			for (int j = 0; j < heap.getSize(); j++) {
+				if (heap.getSlot(j) != recurHeap.getSlot(j)
+						|| heap.getDistance(j) != recurHeap.getDistance(j)) {
+					mismatch++;
+				}
+			}
+		}
+	}
+
+	if (mismatch == 0) {
+		cout << "\nITERATIVE SEARCH PASSED\n";
+	} else {
+		cout << "\nITERATIVE SEARCH FAILED\n";
+		someTestFail = true;
+	}
+
+	return someTestFail;
+}
+
+//radius search must return exactly the points brute force finds within the
+//radius, points on the boundary included
+bool testRange(string fileName, string qFile) {
+
+	bool someTestFail = false;
+
+	pointBlock data;
+	pointBlock queries;
+	data.readFile(fileName);
+	queries.readFile(qFile);
+	int k = data.getDims();
+
+	//grid with many duplicates so points sit on split planes and on the
+	//boundary of the radius
+	vector<double> grid;
+	for (int i = 0; i < 3000; i++) {
+		grid.push_back(i % 7);
+		grid.push_back(i % 5);
+	}
+	pointBlock gridPoints;
+	gridPoints.assign(&grid[0], 3000, 2);
+
+	struct rangeCase {
+		const pointBlock * points;
+		const pointBlock * queries;
+		double radius;
+	};
+	rangeCase cases[] = { { &data, &queries, 0.05 }, { &data, &queries, 0.3 },
+			{ &gridPoints, &gridPoints, 0 }, { &gridPoints, &gridPoints, 1 },
+			{ &gridPoints, &gridPoints, 2.5 } };
+
+	taskPool pool(4);
+	vector<int> found;
+	int leafSizes[] = { 1, 8 };
+	for (rangeCase& test : cases) {
+		k = test.points->getDims();
+		int count = min(test.queries->getSize(), 200);
+		for (int leafSize : leafSizes) {
+			flatTree tree;
+			tree.makeTree(*test.points, 1, leafSize);
+
+			vector<int> counts(count);
+			vector<vector<int> > batch(count);
+			tree.findRangeBatch(test.queries->getPoint(0), count, test.radius,
+					&counts[0], &batch[0], &pool);
+
+			int mismatch = 0;
+			for (int i = 0; i < count; i++) {
+				const double * q = test.queries->getPoint(i);
+				vector<int> expect;
+				for (int p = 0; p < test.points->getSize(); p++) {
+					double sum = 0;
+					for (int d = 0; d < k; d++) {
+						double dif = q[d] - test.points->getPoint(p)[d];
+						sum += dif * dif;
+					}
+					if (sum <= test.radius * test.radius) {
+						expect.push_back(p);
+					}
+				}
+
+				tree.findRange(q, test.radius, found);
+				vector<int> got;
+				for (int slot : found) {
+					got.push_back(tree.getIndex(slot));
+				}
+				sort(got.begin(), got.end());
+				if (got != expect || tree.countRange(q, test.radius)
+						!= (int) expect.size() || counts[i] != (int) expect.size()
+						|| batch[i] != found) {
+					mismatch++;
+				}
+			}
+			if (mismatch > 0) {
+				cout << "\nRANGE SEARCH FAILED FOR RADIUS " << test.radius
+						<< " LEAF SIZE " << leafSize << "\n";
+				someTestFail = true;
+			}
+		}
+	}
+	if (!someTestFail) {
+		cout << "\nRANGE SEARCH PASSED\n";
+	}
+
+	return someTestFail;
+}
+
+//approximate answers must stay within (1 + eps) of the exact distance and a
+//leaf budget must still return a real point
+bool testApprox(string fileName, string qFile) {
+
+	bool someTestFail = false;
+
+	pointBlock data;
+	pointBlock queries;
+	data.readFile(fileName);
+	queries.readFile(qFile);
+
+	flatTree tree;
+	tree.makeTree(data, 1, 4);
+
+	double epsList[] = { 0, 0.1, 0.5, 2 };
+	int leafList[] = { 0, 1, 3 };
+	int failures = 0;
+	for (double eps : epsList) {
+		for (int maxLeaves : leafList) {
+			for (int i = 0; i < queries.getSize(); i++) {
+				const double * q = queries.getPoint(i);
+				int exactSlot = -1;
+				double exactDistance = DBL_MAX;
+				tree.findNear(q, exactSlot, exactDistance);
+
+				int slot = -1;
+				double distance = DBL_MAX;
+				tree.findNear(q, slot, distance, eps, maxLeaves);
+				if (slot < 0 || distance != tree.getAbDist(q, slot)) {
+					failures++;
+				} else if (maxLeaves == 0
+						&& distance > (1 + eps) * exactDistance) {
+					failures++;
+				} else if (maxLeaves == 0 && eps == 0
+						&& (slot != exactSlot || distance != exactDistance)) {
+					failures++;
+				}
+			}
+		}
+	}
+
+	if (failures == 0) {
+		cout << "\nAPPROXIMATE SEARCH PASSED\n";
+	} else {
+		cout << "\nAPPROXIMATE SEARCH FAILED\n";
+		someTestFail = true;
+	}
+
+	return someTestFail;
+}
+
+//bounding boxes must contain their points, leave every answer unchanged and
+//never make a search visit more nodes
+bool testBoxes(string fileName, string qFile) {
+
+	bool someTestFail = false;
+
+	pointBlock data;
+	pointBlock queries;
+	data.readFile(fileName);
+	queries.readFile(qFile);
+	int k = data.getDims();
+
+	flatTree boxed;
+	flatTree plain;
+	boxed.setBoundingBoxes(true);
+	boxed.makeTree(data, 1, 2);
+	plain.makeTree(data, 1, 2);
+	if (!boxed.hasBoxes() || plain.hasBoxes()) {
+		cout << "\nBOUNDING BOX OPTION FAILED\n";
+		return true;
+	}
+
+	searchStats boxedStats;
+	searchStats plainStats;
+	nearHeap boxedHeap(5);
+	nearHeap plainHeap(5);
+	vector<int> boxedFound;
+	vector<int> plainFound;
+	int mismatch = 0;
+	for (int i = 0; i < queries.getSize(); i++) {
+		const double * q = queries.getPoint(i);
+
+		int boxedSlot = -1;
+		double boxedDistance = DBL_MAX;
+		boxed.findNear(q, boxedSlot, boxedDistance, boxedStats);
+		int plainSlot = -1;
+		double plainDistance = DBL_MAX;
+		plain.findNear(q, plainSlot, plainDistance, plainStats);
+		if (boxedSlot != plainSlot || boxedDistance != plainDistance) {
+			mismatch++;
+		}
+
+		boxed.findKNear(q, boxedHeap);
+		plain.findKNear(q, plainHeap);
+		for (int j = 0; j < boxedHeap.getSize(); j++) {
+			if (boxedHeap.getDistance(j) != plainHeap.getDistance(j)) {
+				mismatch++;
+			}
+		}
+
+		boxed.findRange(q, 0.1, boxedFound);
+		plain.findRange(q, 0.1, plainFound);
+		if (boxedFound != plainFound) {
+			mismatch++;
+		}
+	}
+	if (mismatch > 0 || boxedStats.nodes > plainStats.nodes) {
+		someTestFail = true;
+	}
+
+	//boxes written with the tree are mapped with it, and a file without
+	//them gets none
+	boxed.writeBinary("boxedTree.kdt");
+	plain.writeBinary("plainTree.kdt");
+	flatTree mappedBoxes;
+	flatTree mappedPlain;
+	mappedBoxes.setBoundingBoxes(true);
+	mappedPlain.setBoundingBoxes(true);
+	if (!mappedBoxes.readTree("boxedTree.kdt", k) || !mappedBoxes.hasBoxes()
+			|| !mappedPlain.readTree("plainTree.kdt", k)
+			|| mappedPlain.hasBoxes()) {
+		cout << "\nBOUNDING BOXES IN TREE FILE FAILED\n";
+		someTestFail = true;
+	} else {
+		searchStats mappedStats;
+		for (int i = 0; i < queries.getSize(); i++) {
+			const double * q = queries.getPoint(i);
+			int mappedSlot = -1;
+			double mappedDistance = DBL_MAX;
+			mappedBoxes.findNear(q, mappedSlot, mappedDistance, mappedStats);
+			int plainSlot = -1;
+			double plainDistance = DBL_MAX;
+			plain.findNear(q, plainSlot, plainDistance);
+			if (mappedSlot != plainSlot || mappedDistance != plainDistance) {
+				mismatch++;
+			}
+		}
+		if (mismatch > 0 || mappedStats.nodes != boxedStats.nodes) {
+			cout << "\nBOUNDING BOXES IN TREE FILE FAILED\n";
+			someTestFail = true;
+		}
+	}
+
+	//a search for a stored point only finds it at distance 0 if no box on
+	//the way cuts it off
+	flatTree check;
+	check.setBoundingBoxes(true);
+	check.makeTree(data, 1);
+	vector<double> point(k);
+	for (int s = 0; s < check.getSize(); s++) {
+		for (int d = 0; d < k; d++) {
+			point[d] = check.getCord(s, d);
+		}
+		int slot = -1;
+		double distance = DBL_MAX;
+		check.findNear(&point[0], slot, distance);
+		if (distance != 0) {
+			cout << "\nBOUNDING BOX MISSES POINT " << check.getIndex(s) << "\n";
+			someTestFail = true;
+			break;
+		}
+	}
+
+	if (!someTestFail) {
+		cout << "\nBOUNDING BOX SEARCH PASSED (" << boxedStats.nodes
+				<< " nodes with boxes, " << plainStats.nodes << " without)\n";
+	} else {
+		cout << "\nBOUNDING BOX SEARCH FAILED\n";
+	}
+
+	return someTestFail;
+}
+
+//every split strategy must give the brute force answers, on the sample data
+//and on tight clusters with duplicates where sliding and cost splits are
+//most uneven
+bool testSplits(string fileName, string qFile) {
+
+	bool someTestFail = false;
+
+	pointBlock data;
+	pointBlock queries;
+	data.readFile(fileName);
+	queries.readFile(qFile);
+
+	mt19937 gen(15);
+	normal_distribution<double> spread(0, 0.01);
+	uniform_real_distribution<double> unit(0, 1);
+	vector<double> centers;
+	for (int c = 0; c < 6 * 3; c++) {
+		centers.push_back(unit(gen));
+	}
+	vector<double> clusters;
+	for (int i = 0; i < 4000; i++) {
+		int c = i % 6;
+		for (int d = 0; d < 3; d++) {
+			//every fifth point is a copy of its cluster center
+			clusters.push_back(centers[c * 3 + d] + (i % 5 ? spread(gen) : 0));
+		}
+	}
+	pointBlock clusterPoints;
+	clusterPoints.assign(&clusters[0], 4000, 3);
+	vector<double> probes;
+	for (int i = 0; i < 200 * 3; i++) {
+		probes.push_back(unit(gen));
+	}
+	pointBlock clusterQueries;
+	clusterQueries.assign(&probes[0], 200, 3);
+
+	const pointBlock * sets[][2] = { { &data, &queries }, { &clusterPoints,
+			&clusterQueries } };
+	const char * names[] = { "rotate", "range", "variance", "midpoint", "cost" };
+
+	vector<int> found;
+	vector<double> squares;
+	for (auto& set : sets) {
+		const pointBlock& points = *set[0];
+		const pointBlock& probe = *set[1];
+		int k = points.getDims();
+		int count = min(probe.getSize(), 200);
+		double radius = 0.1;
+
+		for (int mode = SPLIT_ROTATE; mode <= SPLIT_COST; mode++) {
+			for (int leafSize : { 1, 6 }) {
+				flatTree tree;
+				tree.makeTree(points, mode, leafSize);
+				nearHeap heap(5);
+
+				int mismatch = 0;
+				for (int i = 0; i < count; i++) {
+					const double * q = probe.getPoint(i);
+					squares.clear();
+					vector<int> expect;
+					for (int p = 0; p < points.getSize(); p++) {
+						double sum = 0;
+						for (int d = 0; d < k; d++) {
+							double dif = q[d] - points.getPoint(p)[d];
+							sum += dif * dif;
+						}
+						squares.push_back(sum);
+						if (sum <= radius * radius) {
+							expect.push_back(p);
+						}
+					}
+					sort(squares.begin(), squares.end());
+
+					int slot = -1;
+					double distance = DBL_MAX;
+					tree.findNear(q, slot, distance);
+					if (distance != sqrt(squares[0])) {
+						mismatch++;
+					}
+
+					tree.findKNear(q, heap);
+					for (int j = 0; j < heap.getSize(); j++) {
+						if (heap.getDistance(j) != sqrt(squares[j])) {
+							mismatch++;
+						}
+					}
+
+					tree.findRange(q, radius, found);
+					vector<int> got;
+					for (int s : found) {
+						got.push_back(tree.getIndex(s));
+					}
+					sort(got.begin(), got.end());
+					if (got != expect) {
+						mismatch++;
+					}
+				}
+				if (mismatch > 0) {
+					cout << "\nSPLIT STRATEGY " << names[mode]
+							<< " FAILED FOR LEAF SIZE " << leafSize << "\n";
+					someTestFail = true;
+				}
+			}
+		}
+	}
+	if (!someTestFail) {
+		cout << "\nSPLIT STRATEGIES PASSED\n";
+	}
+
+	return someTestFail;
+}
+
+//random inserts and deletes checked against brute force over the points the
+//tree should hold, before and after compact()
+bool testUpdates(string fileName, string qFile) {
+
+	bool someTestFail = false;
+
+	pointBlock data;
+	pointBlock queries;
+	data.readFile(fileName);
+	queries.readFile(qFile);
+	int k = data.getDims();
+	int n = data.getSize();
+
+	//points the tree should hold, by index
+	struct held {
+		vector<double> cords;
+		bool live;
+	};
+
+	mt19937 gen(17);
+	uniform_real_distribution<double> unit(0, 1);
+	vector<int> found;
+	nearHeap heap(4);
+
+	for (int leafSize : { 1, 8 }) {
+		for (int boxesOn = 0; boxesOn < 2; boxesOn++) {
+			flatTree tree;
+			tree.setBoundingBoxes(boxesOn == 1);
+			tree.makeTree(data, 1, leafSize);
+
+			vector<held> points(n);
+			for (int i = 0; i < n; i++) {
+				points[i].cords.assign(data.getPoint(i), data.getPoint(i) + k);
+				points[i].live = true;
+			}
+			int liveCount = n;
+
+			//checks every search against brute force, counts mismatches
+			auto check = [&]() {
+				int mismatch = 0;
+				if (tree.getSize() != liveCount) {
+					mismatch++;
+				}
+				for (int i = 0; i < min(queries.getSize(), 50); i++) {
+					const double * q = queries.getPoint(i);
+					vector<double> squares;
+					vector<int> inside;
+					for (size_t p = 0; p < points.size(); p++) {
+						if (!points[p].live) {
+							continue;
+						}
+						double sum = 0;
+						for (int d = 0; d < k; d++) {
+							double dif = q[d] - points[p].cords[d];
+							sum += dif * dif;
+						}
+						squares.push_back(sum);
+						if (sum <= 0.2 * 0.2) {
+							inside.push_back(p);
+						}
+					}
+					sort(squares.begin(), squares.end());
+
+					int slot = -1;
+					double distance = DBL_MAX;
+					tree.findNear(q, slot, distance);
+					if (squares.empty() ? slot != -1 :
+							distance != sqrt(squares[0])
+									|| !points[tree.getIndex(slot)].live) {
+						mismatch++;
+					}
+					tree.findKNear(q, heap);
+					if (heap.getSize() != min(4, (int) squares.size())) {
+						mismatch++;
+					}
+					for (int j = 0; j < heap.getSize(); j++) {
+						if (heap.getDistance(j) != sqrt(squares[j])) {
+							mismatch++;
+						}
+					}
+					tree.findRange(q, 0.2, found);
+					vector<int> got;
+					for (int s : found) {
+						got.push_back(tree.getIndex(s));
+					}
+					sort(got.begin(), got.end());
+					if (got != inside || tree.countRange(q, 0.2) != (int) inside.size()) {
+						mismatch++;
+					}
+				}
+				return mismatch;
+			};
+
+			int mismatch = 0;
+			for (int round = 0; round < 6; round++) {
+				for (int step = 0; step < 300; step++) {
+					if (unit(gen) < 0.5) { //insert a new point, sometimes a copy
+						vector<double> point(k);
+						int source = gen() % points.size();
+						for (int d = 0; d < k; d++) {
+							point[d] = step % 4 == 0 ? points[source].cords[d] : unit(gen);
+						}
+						if (!tree.insert(&point[0], points.size())) {
+							mismatch++;
+						}
+						points.push_back(held { point, true });
+						liveCount++;
+					} else { //delete a random live point
+						int index = gen() % points.size();
+						if (points[index].live) {
+							if (!tree.remove(index)) {
+								mismatch++;
+							}
+							points[index].live = false;
+							liveCount--;
+						}
+					}
+				}
+				mismatch += check();
+			}
+
+			//deleted and unknown indices are refused
+			if (tree.remove(-5) || tree.findSlot(points.size()) != -1) {
+				mismatch++;
+			}
+
+			tree.compact();
+			mismatch += check();
+
+			//down to nothing and back
+			for (size_t p = 0; p < points.size(); p++) {
+				if (points[p].live) {
+					tree.remove(p);
+					points[p].live = false;
+				}
+			}
+			liveCount = 0;
+			mismatch += check();
+			for (int p = 0; p < 20; p++) {
+				tree.insert(&points[p].cords[0], p);
+				points[p].live = true;
+			}
+			liveCount = 20;
+			mismatch += check();
+
+			if (mismatch > 0) {
+				cout << "\nTREE UPDATES FAILED FOR LEAF SIZE " << leafSize
+						<< (boxesOn ? " WITH" : " WITHOUT") << " BOXES\n";
+				someTestFail = true;
+			}
+		}
+	}
+
+	//an updated mapped tree, written back and read again
+	flatTree original;
+	original.makeTree(data, 1, 4);
+	original.writeBinary("updateTree.kdt");
+	flatTree mapped;
+	mapped.readTree("updateTree.kdt", k);
+	vector<double> extra(queries.getPoint(0), queries.getPoint(0) + k);
+	mapped.insert(&extra[0], n);
+	mapped.remove(0);
+	if (mapped.isMapped() || mapped.writeBinary("updateTree.kdt")) {
+		someTestFail = true; //updated trees are compacted before writing
+	}
+	mapped.compact();
+	mapped.writeBinary("updateTree.kdt");
+	flatTree reread;
+	reread.readTree("updateTree.kdt", k);
+	int slot = -1;
+	double distance = DBL_MAX;
+	reread.findNear(&extra[0], slot, distance);
+	if (reread.getSize() != n || distance != 0 || reread.getIndex(slot) != n
+			|| reread.findSlot(0) != -1) {
+		cout << "\nUPDATED TREE DID NOT SURVIVE A WRITE\n";
+		someTestFail = true;
+	}
+
+	if (!someTestFail) {
+		cout << "\nTREE UPDATES PASSED\n";
+	}
+
+	return someTestFail;
+}
+
+//the forest must answer like brute force over everything inserted so far,
+//keep one tree per set bit of the number of full buffers, and give searches
+//running beside the inserts answers that were right when they started
+bool testForest(string fileName, string qFile) {
+
+	bool someTestFail = false;
+
+	pointBlock data;
+	pointBlock queries;
+	data.readFile(fileName);
+	queries.readFile(qFile);
+	int k = data.getDims();
+	int n = data.getSize();
+	int bufferSize = 16;
+
+	//closest squared distance among the first count data points
+	auto bruteSquare = [&](const double * q, int count) {
+		double best = DBL_MAX;
+		for (int p = 0; p < count; p++) {
+			double sum = 0;
+			for (int d = 0; d < k; d++) {
+				double dif = q[d] - data.getPoint(p)[d];
+				sum += dif * dif;
+			}
+			best = min(best, sum);
+		}
+		return best;
+	};
+
+	treeForest forest(k, 1, 4, bufferSize);
+	int mismatch = 0;
+	for (int i = 0; i < n; i++) {
+		forest.insert(data.getPoint(i), i);
+		if (i % 97 == 0 || i == n - 1) {
+			int full = (i + 1) / bufferSize;
+			if (forest.getSize() != i + 1
+					|| forest.getTreeCount() != __builtin_popcount(full)) {
+				mismatch++;
+			}
+			for (int j = 0; j < 20; j++) {
+				const double * q = queries.getPoint(j);
+				int index = -1;
+				double distance = DBL_MAX;
+				forest.findNear(q, index, distance);
+				if (index < 0 || index > i
+						|| distance != sqrt(bruteSquare(q, i + 1))) {
+					mismatch++;
+				}
+			}
+		}
+	}
+
+	int count = queries.getSize();
+	vector<int> indices(count);
+	vector<double> distances(count);
+	taskPool pool(4);
+	forest.findNearBatch(queries.getPoint(0), count, &indices[0],
+			&distances[0], &pool);
+	for (int j = 0; j < count; j++) {
+		if (distances[j] != sqrt(bruteSquare(queries.getPoint(j), n))) {
+			mismatch++;
+		}
+	}
+	if (mismatch > 0) {
+		cout << "\nFOREST SEARCH FAILED\n";
+		someTestFail = true;
+	}
+
+	//searches beside the inserts: every point inserted before a search began
+	//is seen by it, and whatever it returns is a real point at that distance
+	treeForest streaming(k, 1, 4, bufferSize);
+	atomic<bool> done(false);
+	atomic<int> wrong(0);
+	thread reader([&]() {
+		int j = 0;
+		while (!done.load()) {
+			const double * q = queries.getPoint(j++ % 50);
+			int before = streaming.getSize();
+			int index = -1;
+			double distance = DBL_MAX;
+			streaming.findNear(q, index, distance);
+			if (before == 0) {
+				continue;
+			}
+			if (index < 0 || index >= n) {
+				wrong++;
+				continue;
+			}
+			double square = 0;
+			for (int d = 0; d < k; d++) {
+				double dif = q[d] - data.getPoint(index)[d];
+				square += dif * dif;
+			}
+			if (distance != sqrt(square) || square > bruteSquare(q, before)) {
+				wrong++;
+			}
+		}
+	});
+	for (int i = 0; i < n; i++) {
+		streaming.insert(data.getPoint(i), i);
+	}
+	done = true;
+	reader.join();
+	if (wrong > 0) {
+		cout << "\nFOREST SEARCH DURING INSERTS FAILED\n";
+		someTestFail = true;
+	}
+
+	if (!someTestFail) {
+		cout << "\nFOREST SEARCH PASSED\n";
+	}
+
+	return someTestFail;
+}
+
+//reduced precision trees that keep the doubles must give exactly the answers
+//of double trees, and trees that drop them exactly the answers of a brute
+//force search over the coordinates they store, on the sample data and on
+//points far from the origin closer together than a float step, after
+//writing and reading both formats and after updates
+bool testPrecision(string fileName, string qFile) {
+
+	bool someTestFail = false;
+
+	pointBlock sample;
+	pointBlock sampleQueries;
+	sample.readFile(fileName);
+	sampleQueries.readFile(qFile);
+
+	//tight points near 1e6 with duplicates, queries on and between them
+	mt19937_64 gen(2016);
+	uniform_real_distribution<double> dist(0.0, 1e-3);
+	int k = 3;
+	int n = 3000;
+	vector<double> rows((size_t) n * k);
+	vector<double> queryRows((size_t) n * k);
+	for (int i = 0; i < n; i++) {
+		for (int d = 0; d < k; d++) {
+			rows[i * k + d] = i % 7 == 0 && i > 0 ?
+					rows[(i - 1) * k + d] : 1e6 + d + dist(gen);
+			queryRows[i * k + d] =
+					i % 2 == 0 ? rows[i * k + d] : 1e6 + d + dist(gen);
+		}
+	}
+	pointBlock tight;
+	pointBlock tightQueries;
+	tight.assign(&rows[0], n, k);
+	tightQueries.assign(&queryRows[0], n, k);
+
+	pointBlock * sets[2][2] = { { &sample, &sampleQueries }, { &tight,
+			&tightQueries } };
+	int precisions[2] = { PRECISION_FLOAT, PRECISION_QUANT16 };
+	int leafSizes[2] = { 1, 8 };
+
+	//squared distance to the coordinates a tree stores, summed in axis order
+	auto square = [](const flatTree& tree, const double * q, int slot) {
+		double sum = 0;
+		for (int d = 0; d < tree.getDims(); d++) {
+			double dif = q[d] - tree.getCord(slot, d);
+			sum += dif * dif;
+		}
+		return sum;
+	};
+
+	//every query must give the same nearest and 5 nearest distances in both
+	//trees, the same nearest point, and k nearest that are at the distances
+	//given. points tied at the 5th distance may be any of them
+	nearHeap heap(5);
+	nearHeap plainHeap(5);
+	auto sameAnswers = [&](const flatTree& tree, const flatTree& plain,
+			const pointBlock& queries) {
+		int mismatch = 0;
+		for (int i = 0; i < queries.getSize(); i++) {
+			const double * q = queries.getPoint(i);
+			int slot = -1;
+			double distance = DBL_MAX;
+			tree.findNear(q, slot, distance);
+			int plainSlot = -1;
+			double plainDistance = DBL_MAX;
+			plain.findNear(q, plainSlot, plainDistance);
+			if (slot < 0 || plainSlot < 0 || distance != plainDistance
+					|| tree.getIndex(slot) != plain.getIndex(plainSlot)) {
+				mismatch++;
+			}
+
+			tree.findKNear(q, heap);
+			plain.findKNear(q, plainHeap);
+			if (heap.getSize() != plainHeap.getSize()) {
+				mismatch++;
+				continue;
+			}
+			for (int j = 0; j < plainHeap.getSize(); j++) {
+				if (heap.getDistance(j) != plainHeap.getDistance(j)
+						|| sqrt(square(tree, q, heap.getSlot(j)))
+								!= heap.getDistance(j)) {
+					mismatch++;
+				}
+			}
+		}
+		return mismatch;
+	};
+
+	//the same against every point the tree stores
+	vector<double> squares;
+	auto storedAnswers = [&](const flatTree& tree, const pointBlock& queries) {
+		int mismatch = 0;
+		for (int i = 0; i < queries.getSize(); i++) {
+			const double * q = queries.getPoint(i);
+			squares.clear();
+			for (int s = 0; s < tree.getSlotCount(); s++) {
+				if (tree.getIndex(s) != TOMBSTONE) {
+					squares.push_back(square(tree, q, s));
+				}
+			}
+			int size = min(5, (int) squares.size());
+			partial_sort(squares.begin(), squares.begin() + size,
+					squares.end());
+
+			int slot = -1;
+			double distance = DBL_MAX;
+			tree.findNear(q, slot, distance);
+			if (slot < 0 || distance != sqrt(squares[0])
+					|| square(tree, q, slot) != squares[0]) {
+				mismatch++;
+			}
+
+			tree.findKNear(q, heap);
+			if (heap.getSize() != size) {
+				mismatch++;
+				continue;
+			}
+			for (int j = 0; j < size; j++) {
+				if (heap.getDistance(j) != sqrt(squares[j])
+						|| square(tree, q, heap.getSlot(j)) != squares[j]) {
+					mismatch++;
+				}
+			}
+		}
+		return mismatch;
+	};
+
+	for (auto& set : sets) {
+		const pointBlock& data = *set[0];
+		const pointBlock& queries = *set[1];
+		for (int precision : precisions) {
+			for (int leafSize : leafSizes) {
+				flatTree plain;
+				plain.makeTree(data, 1, leafSize);
+				plain.writeBinary("precisionTree.kdt");
+				ifstream plainFile("precisionTree.kdt",
+						ios::binary | ios::ate);
+				streamoff plainBytes = plainFile.tellg();
+				plainFile.close();
+
+				for (int exact = 0; exact < 2; exact++) {
+					flatTree tree;
+					tree.setPrecision(precision);
+					tree.setExactCords(exact);
+					tree.makeTree(data, 1, leafSize);
+
+					auto check = [&](const flatTree& tree) {
+						if (!exact && tree.getCords() != nullptr) {
+							cout << "\nDOUBLES KEPT BY A REDUCED PRECISION TREE\n";
+							someTestFail = true;
+						}
+						return exact ? sameAnswers(tree, plain, queries) :
+								storedAnswers(tree, queries);
+					};
+					int mismatch = check(tree);
+
+					//both formats must record the precision and read back the
+					//same tree, a binary file without the doubles is smaller
+					tree.writeBinary("precisionTree.kdt");
+					tree.writeOut("precisionTree.txt");
+					ifstream treeFile("precisionTree.kdt",
+							ios::binary | ios::ate);
+					if (!exact && treeFile.tellg() >= plainBytes) {
+						cout << "\n" << precisionName(precision)
+								<< " TREE FILE NOT SMALLER THAN DOUBLES\n";
+						someTestFail = true;
+					}
+					treeFile.close();
+					flatTree mapped;
+					flatTree text;
+					mapped.readTree("precisionTree.kdt", data.getDims());
+					text.readTree("precisionTree.txt", data.getDims());
+					if (mapped.getPrecision() != precision
+							|| text.getPrecision() != precision) {
+						cout << "\nPRECISION NOT RECORDED IN TREE FILES\n";
+						someTestFail = true;
+					}
+					mismatch += check(mapped);
+					mismatch += check(text);
+
+					//updates search the coordinates, compact encodes them again
+					flatTree updated;
+					updated.setPrecision(precision);
+					updated.setExactCords(exact);
+					updated.makeTree(data, 1, leafSize);
+					flatTree plainUpdated;
+					plainUpdated.makeTree(data, 1, leafSize);
+					updated.remove(plain.getIndex(0));
+					plainUpdated.remove(plain.getIndex(0));
+					updated.insert(queries.getPoint(1), -1);
+					plainUpdated.insert(queries.getPoint(1), -1);
+					mismatch += exact ?
+							sameAnswers(updated, plainUpdated, queries) :
+							storedAnswers(updated, queries);
+					updated.compact();
+					plainUpdated.compact();
+					if (updated.getPrecision() != precision) {
+						someTestFail = true;
+					}
+					mismatch += exact ?
+							sameAnswers(updated, plainUpdated, queries) :
+							check(updated);
+
+					if (mismatch > 0) {
+						cout << "\n" << precisionName(precision)
+								<< (exact ? " EXACT" : "")
+								<< " PRECISION FAILED FOR " << mismatch
+								<< " ANSWERS WITH LEAF SIZE " << leafSize << "\n";
+						someTestFail = true;
+					}
+				}
+			}
+		}
+	}
+
+	if (!someTestFail) {
+		cout << "\nREDUCED PRECISION SEARCH PASSED\n";
+	}
+
+	return someTestFail;
+}
+
+//curve keys must walk an 8 by 8 grid the documented way, and batches run in
+//curve order and trees laid out along a curve must give the same answers
+bool testCurves(string fileName, string qFile) {
+
+	bool someTestFail = false;
+
+	//grid cells i << 18 of the 21 bit keys used in two dimensions
+	double low[2] = { 0, 0 };
+	double high[2] = { 1, 1 };
+	double top = (1 << CURVE_BITS) - 1;
+	vector<double> grid;
+	for (int x = 0; x < 8; x++) {
+		for (int y = 0; y < 8; y++) {
+			grid.push_back(((x << 18) + 0.5) / top);
+			grid.push_back(((y << 18) + 0.5) / top);
+		}
+	}
+	vector<int> order;
+	curveOrder(&grid[0], 64, 2, CURVE_HILBERT, order);
+	for (int i = 1; i < 64; i++) { //every step moves to a neighboring cell
+		int dx = abs(order[i] / 8 - order[i - 1] / 8);
+		int dy = abs(order[i] % 8 - order[i - 1] % 8);
+		if (dx + dy != 1) {
+			cout << "\nHILBERT ORDER JUMPS AT STEP " << i << "\n";
+			someTestFail = true;
+			break;
+		}
+	}
+	double corner[2] = { grid[2 * 9], grid[2 * 9 + 1] }; //cell (1, 1)
+	if (curveKey(corner, low, high, 2, CURVE_MORTON) != (3ULL << 36)) {
+		cout << "\nMORTON KEY FAILED\n";
+		someTestFail = true;
+	}
+
+	pointBlock data;
+	pointBlock queries;
+	data.readFile(fileName);
+	queries.readFile(qFile);
+	int count = queries.getSize();
+
+	flatTree plain;
+	plain.makeTree(data, 1, 4);
+	vector<int> plainSlots(count * 3);
+	vector<double> plainDistances(count * 3);
+	vector<int> plainCounts(count);
+	vector<vector<int> > plainFound(count);
+	plain.findKNearBatch(queries.getPoint(0), count, 3, &plainSlots[0],
+			&plainDistances[0]);
+	plain.findRangeBatch(queries.getPoint(0), count, 0.1, &plainCounts[0],
+			&plainFound[0]);
+	plain.writeOut("curveTree.txt");
+
+	int curves[2] = { CURVE_MORTON, CURVE_HILBERT };
+	int mismatch = 0;
+	for (int layout : curves) {
+		for (int queryOrder : curves) {
+			flatTree tree;
+			tree.setCurveLayout(layout);
+			tree.setQueryOrder(queryOrder);
+			tree.makeTree(data, 1, 4);
+
+			vector<int> slots(count);
+			vector<double> distances(count);
+			tree.findNearBatch(queries.getPoint(0), count, &slots[0],
+					&distances[0]);
+			for (int i = 0; i < count; i++) {
+				int slot = -1;
+				double distance = DBL_MAX;
+				plain.findNear(queries.getPoint(i), slot, distance);
+				if (tree.getIndex(slots[i]) != plain.getIndex(slot)
+						|| distances[i] != distance) {
+					mismatch++;
+				}
+			}
+
+			vector<int> kSlots(count * 3);
+			vector<double> kDistances(count * 3);
+			tree.findKNearBatch(queries.getPoint(0), count, 3, &kSlots[0],
+					&kDistances[0]);
+			for (int i = 0; i < count * 3; i++) {
+				if (tree.getIndex(kSlots[i]) != plain.getIndex(plainSlots[i])
+						|| kDistances[i] != plainDistances[i]) {
+					mismatch++;
+				}
+			}
+
+			//range answers are sorted slots, compare the indices they hold
+			vector<int> counts(count);
+			vector<vector<int> > found(count);
+			tree.findRangeBatch(queries.getPoint(0), count, 0.1, &counts[0],
+					&found[0]);
+			for (int i = 0; i < count; i++) {
+				vector<int> mine;
+				vector<int> theirs;
+				for (int slot : found[i]) {
+					mine.push_back(tree.getIndex(slot));
+				}
+				for (int slot : plainFound[i]) {
+					theirs.push_back(plain.getIndex(slot));
+				}
+				sort(mine.begin(), mine.end());
+				sort(theirs.begin(), theirs.end());
+				if (counts[i] != plainCounts[i] || mine != theirs
+						|| !is_sorted(found[i].begin(), found[i].end())) {
+					mismatch++;
+				}
+			}
+
+			//the text format walks the tree, so it does not see the layout
+			tree.writeOut("curveRe-write.txt");
+			if (!sameFiles("curveTree.txt", "curveRe-write.txt")) {
+				cout << "\n" << curveName(layout)
+						<< " LAYOUT CHANGED THE WRITTEN TREE\n";
+				someTestFail = true;
+			}
+		}
+	}
+	if (mismatch > 0) {
+		cout << "\nCURVE ORDER FAILED FOR " << mismatch << " ANSWERS\n";
+		someTestFail = true;
+	}
+
+	if (!someTestFail) {
+		cout << "\nCURVE ORDER SEARCH PASSED\n";
+	}
+
+	return someTestFail;
+}
+
+//packet searches against findNear one query at a time, including a grid of
+//points with many equal distances and a tree with removed points
+bool testPacket(string fileName, string qFile) {
+
+	bool someTestFail = false;
+
+	pointBlock data;
+	pointBlock queries;
+	data.readFile(fileName);
+	queries.readFile(qFile);
+
+	//integer grid with every point twice, grid queries tie all the time
+	vector<double> cells;
+	vector<double> halves;
+	for (int x = 0; x < 10; x++) {
+		for (int y = 0; y < 10; y++) {
+			for (int z = 0; z < 5; z++) {
+				for (int copy = 0; copy < 2; copy++) {
+					cells.insert(cells.end(), { (double) x, (double) y,
+							(double) z });
+				}
+				halves.insert(halves.end(), { x + 0.5, y + 0.5, (double) z });
+			}
+		}
+	}
+	pointBlock ties;
+	pointBlock tieQueries;
+	ties.assign(&cells[0], cells.size() / 3, 3);
+	tieQueries.assign(&halves[0], halves.size() / 3, 3);
+
+	pointBlock * sets[2][2] = { { &data, &queries }, { &ties, &tieQueries } };
+	int lanes[3] = { 4, 8, PACKET_LANES };
+	int mismatch = 0;
+	for (auto& set : sets) {
+		int count = set[1]->getSize();
+		for (int removed = 0; removed < 2; removed++) {
+			for (int curve = CURVE_NONE; curve <= CURVE_HILBERT; curve++) {
+				for (int packet : lanes) {
+					flatTree tree;
+					tree.makeTree(*set[0], 1, 4);
+					tree.setBoundingBoxes(curve != CURVE_MORTON);
+					if (removed) {
+						for (int i = 0; i < set[0]->getSize(); i += 3) {
+							tree.remove(i);
+						}
+					}
+					tree.setQueryOrder(curve);
+					tree.setPacketSize(packet);
+
+					vector<int> slots(count);
+					vector<double> distances(count);
+					tree.findNearBatch(set[1]->getPoint(0), count, &slots[0],
+							&distances[0]);
+					for (int i = 0; i < count; i++) {
+						int slot = -1;
+						double distance = DBL_MAX;
+						tree.findNear(set[1]->getPoint(i), slot, distance);
+						if (slots[i] != slot || distances[i] != distance) {
+							mismatch++;
+						}
+					}
+				}
+			}
+		}
+	}
+	if (mismatch > 0) {
+		cout << "\nPACKET SEARCH FAILED FOR " << mismatch << " ANSWERS\n";
+		someTestFail = true;
+	}
+
+	if (!someTestFail) {
+		cout << "\nPACKET SEARCH PASSED\n";
+	}
+
+	return someTestFail;
+}
+
+//requests over a socket pair against the tree searched directly: a batch
+//of nearest neighbors, k nearest, bad requests and the server statistics,
+//all sent before any response is read so they can share batches
+bool testServer(string fileName, string qFile) {
+
+	bool someTestFail = false;
+
+	pointBlock data;
+	pointBlock queries;
+	data.readFile(fileName);
+	queries.readFile(qFile);
+	int count = queries.getSize();
+	int dims = queries.getDims();
+
+	flatTree tree;
+	tree.makeTree(data, 1, 4);
+	vector<int> slots(count * 3);
+	vector<double> distances(count * 3);
+
+	int ends[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, ends) != 0) {
+		cout << "\nSERVER TEST COULD NOT OPEN A SOCKET PAIR\n";
+		return true;
+	}
+	taskPool pool(2);
+	queryServer server(tree, &pool);
+	server.addClient(ends[0]);
+
+	//the client writes on its own thread so a full socket cannot stall it
+	requestHeader near = { SERVE_REQUEST_MAGIC, SERVE_NEAR, 1, 1,
+			(uint32_t) count, (uint32_t) dims };
+	requestHeader kNear = { SERVE_REQUEST_MAGIC, SERVE_NEAR, 2, 3, 100,
+			(uint32_t) dims };
+	requestHeader wrong = { SERVE_REQUEST_MAGIC, SERVE_NEAR, 3, 1, 1,
+			(uint32_t) dims + 1 };
+	requestHeader huge = { SERVE_REQUEST_MAGIC, SERVE_NEAR, 4, SERVE_MAX_K,
+			SERVE_MAX_ANSWERS / SERVE_MAX_K + 1, (uint32_t) dims };
+	requestHeader stats = { SERVE_REQUEST_MAGIC, SERVE_STATS, 5, 0, 0, 0 };
+	vector<double> extra(dims + 1);
+	vector<double> hugeRows((size_t) huge.count * dims);
+	thread client([&]() {
+		writeFull(ends[1], &near, sizeof(near));
+		writeFull(ends[1], queries.getPoint(0),
+				(size_t) count * dims * sizeof(double));
+		writeFull(ends[1], &kNear, sizeof(kNear));
+		writeFull(ends[1], queries.getPoint(0), 100 * dims * sizeof(double));
+		writeFull(ends[1], &wrong, sizeof(wrong));
+		writeFull(ends[1], &extra[0], extra.size() * sizeof(double));
+		writeFull(ends[1], &huge, sizeof(huge));
+		writeFull(ends[1], &hugeRows[0], hugeRows.size() * sizeof(double));
+		writeFull(ends[1], &stats, sizeof(stats));
+	});
+
+	int mismatch = 0;
+	responseHeader reply;
+	vector<serveAnswer> answers(count);
+	tree.findNearBatch(queries.getPoint(0), count, &slots[0], &distances[0]);
+	if (!readFull(ends[1], &reply, sizeof(reply)) || reply.id != 1
+			|| reply.status != SERVE_OK || (int) reply.count != count
+			|| !readFull(ends[1], &answers[0], count * sizeof(serveAnswer))) {
+		mismatch++;
+	} else {
+		for (int i = 0; i < count; i++) {
+			if (answers[i].index != tree.getIndex(slots[i])
+					|| answers[i].distance != distances[i]) {
+				mismatch++;
+			}
+		}
+	}
+
+	answers.resize(300);
+	tree.findKNearBatch(queries.getPoint(0), 100, 3, &slots[0], &distances[0]);
+	if (!readFull(ends[1], &reply, sizeof(reply)) || reply.id != 2
+			|| reply.status != SERVE_OK || reply.count != 100 || reply.k != 3
+			|| !readFull(ends[1], &answers[0], 300 * sizeof(serveAnswer))) {
+		mismatch++;
+	} else {
+		for (int i = 0; i < 300; i++) {
+			if (answers[i].index != tree.getIndex(slots[i])
+					|| answers[i].distance != distances[i]) {
+				mismatch++;
+			}
+		}
+	}
+
+	if (!readFull(ends[1], &reply, sizeof(reply)) || reply.id != 3
+			|| reply.status != SERVE_BAD_DIMS || reply.count != 0) {
+		cout << "\nSERVER ACCEPTED QUERIES OF THE WRONG DIMENSION\n";
+		someTestFail = true;
+	}
+
+	if (!readFull(ends[1], &reply, sizeof(reply)) || reply.id != 4
+			|| reply.status != SERVE_TOO_LARGE || reply.count != 0) {
+		cout << "\nSERVER ACCEPTED A RESPONSE ABOVE SERVE_MAX_ANSWERS\n";
+		someTestFail = true;
+	}
+
+	serveStats seen;
+	if (!readFull(ends[1], &reply, sizeof(reply)) || reply.id != 5
+			|| reply.status != SERVE_OK
+			|| !readFull(ends[1], &seen, sizeof(seen)) || seen.requests != 4
+			|| seen.queries != (uint64_t) count + 100 || seen.p99 < seen.p50) {
+		cout << "\nSERVER STATISTICS FAILED\n";
+		someTestFail = true;
+	}
+
+	client.join();
+	close(ends[1]);
+
+	//a client that never reads its responses must not hold up another one,
+	//and is not read from once it has too many requests outstanding
+	int slow[2];
+	int fast[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, slow) != 0
+			|| socketpair(AF_UNIX, SOCK_STREAM, 0, fast) != 0) {
+		cout << "\nSERVER TEST COULD NOT OPEN A SOCKET PAIR\n";
+		return true;
+	}
+	server.addClient(slow[0]);
+	server.addClient(fast[0]);
+	int flooded = 4 * SERVE_CLIENT_REQUESTS;
+	int batch = min(count, 1000);
+	requestHeader large = { SERVE_REQUEST_MAGIC, SERVE_NEAR, 5, 1,
+			(uint32_t) batch, (uint32_t) dims };
+	thread flood([&]() {
+		for (int r = 0; r < flooded; r++) {
+			if (!writeFull(slow[1], &large, sizeof(large))
+					|| !writeFull(slow[1], queries.getPoint(0),
+							(size_t) batch * dims * sizeof(double))) {
+				break;
+			}
+		}
+	});
+	this_thread::sleep_for(chrono::milliseconds(500));
+
+	requestHeader one = { SERVE_REQUEST_MAGIC, SERVE_NEAR, 6, 1, 1,
+			(uint32_t) dims };
+	pollfd wait = { fast[1], POLLIN, 0 };
+	serveAnswer answer;
+	if (!writeFull(fast[1], &one, sizeof(one))
+			|| !writeFull(fast[1], queries.getPoint(0), dims * sizeof(double))
+			|| poll(&wait, 1, 5000) != 1
+			|| !readFull(fast[1], &reply, sizeof(reply)) || reply.id != 6
+			|| !readFull(fast[1], &answer, sizeof(answer))
+			|| answer.index != tree.getIndex(slots[0])) {
+		cout << "\nSERVER STALLED BEHIND A CLIENT THAT DOES NOT READ\n";
+		someTestFail = true;
+	}
+	uint64_t answered = server.getStats().requests;
+	if (answered >= 4 + (uint64_t) flooded) {
+		cout << "\nSERVER KEPT READING FROM A CLIENT OVER ITS LIMIT\n";
+		someTestFail = true;
+	}
+	shutdown(slow[1], SHUT_RDWR); //the server's writes fail and it drops the rest
+	flood.join();
+	close(slow[1]);
+	close(fast[1]);
+
+	server.stop();
+	if (server.getStats().requests < 5) {
+		cout << "\nSERVER DID NOT ANSWER EVERY REQUEST\n";
+		someTestFail = true;
+	}
+
+	if (mismatch > 0) {
+		cout << "\nSERVER RETURNED " << mismatch << " WRONG ANSWERS\n";
+		someTestFail = true;
+	}
+
+	if (!someTestFail) {
+		cout << "\nQUERY SERVER PASSED\n";
+	}
+
+	return someTestFail;
+}
+
+//appendDouble against an ostream at max_digits10 and a resultWriter file
+//against the same text written by ofstream
+bool testResults() {
+
+	bool someTestFail = false;
+
+	vector<double> values = { 0.0, -0.0, 1.0, 0.1, 1e21, 1e-7, 123456789012345678.0,
+			DBL_MAX, DBL_MIN, DBL_MIN / 3, -DBL_MAX, INFINITY, -INFINITY,
+			0.047011084303853271 };
+	mt19937_64 gen(2016);
+	uniform_real_distribution<double> unit(0.0, 1.0);
+	for (int i = 0; i < 100000; i++) {
+		uint64_t bits = gen();
+		double any;
+		memcpy(&any, &bits, sizeof(any));
+		if (!std::isnan(any)) {
+			values.push_back(any);
+		}
+		values.push_back(unit(gen) * pow(10.0, (int) (gen() % 40) - 20));
+	}
+
+	ostringstream expected;
+	expected.precision(dbl::max_digits10);
+	int mismatch = 0;
+	vector<string> blocks(1);
+	for (size_t i = 0; i < values.size(); i++) {
+		ostringstream one;
+		one.precision(dbl::max_digits10);
+		one << values[i];
+		string mine;
+		appendDouble(mine, values[i]);
+		if (mine != one.str()) {
+			if (mismatch++ < 5) {
+				cout << "\n" << mine << " IS NOT " << one.str();
+			}
+		}
+		expected << (int) i << "," << values[i] << endl;
+		if (blocks.back().size() > 4096) {
+			blocks.push_back(string());
+		}
+		appendInt(blocks.back(), i);
+		blocks.back() += ',';
+		appendDouble(blocks.back(), values[i]);
+		blocks.back() += '\n';
+	}
+	if (mismatch > 0) {
+		cout << "\nAPPENDDOUBLE DIFFERS FROM OSTREAM FOR " << mismatch
+				<< " VALUES\n";
+		someTestFail = true;
+	}
+
+	ofstream reference("resultsReference.txt");
+	reference << expected.str();
+	reference.close();
+	resultWriter writer;
+	bool written = writer.open("resultsWritten.txt");
+	for (string& block : blocks) {
+		writer.write(move(block));
+	}
+	written = writer.close() && written;
+	if (!written || !sameFiles("resultsReference.txt", "resultsWritten.txt")) {
+		cout << "\nRESULT WRITER FILE DIFFERS\n";
+		someTestFail = true;
+	}
+
+	if (!someTestFail) {
+		cout << "\nBUFFERED RESULT OUTPUT PASSED\n";
+	}
+
+	return someTestFail;
+}
+
 //runs all tests
 int main(int argc, char *argv[]) {
 	//track if any tests fail
@@ -330,7 +2417,7 @@ int main(int argc, char *argv[]) {
 	double bestDistance = DBL_MAX;
 	nPoint * bestPt = nullptr;
 	for (int i = 0; i < 10; i++) {
-		queries.at(i)->findNear(root, bestPt, bestDistance, k);
+		queries.at(i)->findNear(root, bestPt, bestDistance);
 
 		cout << "For querry point " << i << " best node was ";
 		bestPt->print();
@@ -395,6 +2482,19 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	//flat layout must reproduce the linked tree exactly
+	if (testFlat(pointVector, queries, root, k, axisMode)) {
+		anyTestFail = true;
+	}
+
+	if (testParallel(pointVector, k, axisMode)) {
+		anyTestFail = true;
+	}
+
+	if (testArena(pointVector, queries, root, k, axisMode)) {
+		anyTestFail = true;
+	}
+
 	//test destructor and correct copying by deleting original tree
 	delete root;
 
@@ -410,7 +2510,7 @@ int main(int argc, char *argv[]) {
 			<< endl << endl;
 
 	for (int i = 0; i < 10; i++) {
-		queries.at(i)->findNear(otherTree, bestPt, bestDistance, k); //use new build tree
+		queries.at(i)->findNear(otherTree, bestPt, bestDistance); //use new build tree
 
 		cout << "For querry point " << i << " best node was ";
 		bestPt->print();
@@ -463,7 +2563,63 @@ int main(int argc, char *argv[]) {
 
 	//begin distance method testing
 	//also conducts brute force testing against nearest neighbor algorithm
-	anyTestFail = testDist(treeArr, Q, otherTree, queries, k);
+	if (testDist(treeArr, Q, otherTree, queries, k)) {
+		anyTestFail = true;
+	}
+
+	flatTree bucket;
+	bucket.readTree("bucketTree.txt", k);
+	if (testKNear(treeArr, Q, bucket, k)) {
+		anyTestFail = true;
+	}
+	if (testBinary(bucket, queries, k)) {
+		anyTestFail = true;
+	}
+	if (testCsv(fileName, qFile)) {
+		anyTestFail = true;
+	}
+	if (testSquared()) {
+		anyTestFail = true;
+	}
+	if (testFixed(fileName, qFile)) {
+		anyTestFail = true;
+	}
+	if (testIterative(fileName, qFile)) {
+		anyTestFail = true;
+	}
+	if (testRange(fileName, qFile)) {
+		anyTestFail = true;
+	}
+	if (testApprox(fileName, qFile)) {
+		anyTestFail = true;
+	}
+	if (testBoxes(fileName, qFile)) {
+		anyTestFail = true;
+	}
+	if (testSplits(fileName, qFile)) {
+		anyTestFail = true;
+	}
+	if (testUpdates(fileName, qFile)) {
+		anyTestFail = true;
+	}
+	if (testForest(fileName, qFile)) {
+		anyTestFail = true;
+	}
+	if (testPrecision(fileName, qFile)) {
+		anyTestFail = true;
+	}
+	if (testCurves(fileName, qFile)) {
+		anyTestFail = true;
+	}
+	if (testPacket(fileName, qFile)) {
+		anyTestFail = true;
+	}
+	if (testServer(fileName, qFile)) {
+		anyTestFail = true;
+	}
+	if (testResults()) {
+		anyTestFail = true;
+	}
 
 	//final cleanup
 	//delete tree and clean up vectors
@@ -474,11 +2630,11 @@ int main(int argc, char *argv[]) {
 	}
 	queries.clear();
 	for (double * p : Q) {
-		delete p;
+		delete[] p;
 	}
 	Q.clear();
 	for (double * p : treeArr) {
-		delete p;
+		delete[] p;
 	}
 	treeArr.clear();
 	cout << "\nAll deletions successful\n";
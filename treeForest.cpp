@@ -0,0 +1,183 @@
+/*
+ * treeForest.cpp
+ */
+
+/*
+ This file is part of kdTree.
+
+ kdTree is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ kdTree is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with kdTree.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "treeForest.h"
+
+treeForest::treeForest(int dims, int axisMode, int leafSize, int bufferSize,
+		taskPool * pool) :
+		dims(dims), axisMode(axisMode), leafSize(leafSize), bufferSize(
+				bufferSize < 1 ? 1 : bufferSize), pool(pool) {
+	forestView * first = new forestView;
+	first->buffer = make_shared<pointBuffer>();
+	first->buffer->rows.resize((size_t) this->bufferSize * dims);
+	first->buffer->ids.resize(this->bufferSize);
+	first->buffer->count = 0;
+	first->stored = 0;
+	view.reset(first);
+}
+
+shared_ptr<const treeForest::forestView> treeForest::current() const {
+	lock_guard<mutex> hold(viewLock);
+	return view;
+}
+
+int treeForest::getDims() const {
+	return dims;
+}
+
+long treeForest::getSize() const {
+	shared_ptr<const forestView> v = current();
+	return v->stored + v->buffer->count.load(memory_order_acquire);
+}
+
+int treeForest::getTreeCount() const {
+	shared_ptr<const forestView> v = current();
+	int count = 0;
+	for (const shared_ptr<const flatTree>& tree : v->trees) {
+		count += tree != nullptr;
+	}
+	return count;
+}
+
+void treeForest::insert(const double * point, int index) {
+	lock_guard<mutex> hold(insertLock);
+	pointBuffer& buffer = *view->buffer; //only this thread replaces view
+	int slot = buffer.count.load(memory_order_relaxed);
+	memcpy(&buffer.rows[(size_t) slot * dims], point, dims * sizeof(double));
+	buffer.ids[slot] = index;
+	buffer.count.store(slot + 1, memory_order_release); //now visible to searches
+	if (slot + 1 == bufferSize) {
+		merge();
+	}
+}
+
+void treeForest::insertBatch(const double * rows, int count, int firstIndex) {
+	for (int i = 0; i < count; i++) {
+		insert(rows + (size_t) i * dims, firstIndex + i);
+	}
+}
+
+//called with insertLock held and a full buffer. the old view stays valid for
+//searches already running, the new one is swapped in when the tree is ready
+void treeForest::merge() {
+	const forestView& old = *view;
+
+	vector<double> rows(old.buffer->rows);
+	vector<int> ids(old.buffer->ids);
+	size_t level = 0;
+	for (; level < old.trees.size() && old.trees[level] != nullptr; level++) {
+		const flatTree& tree = *old.trees[level];
+		for (int slot = 0; slot < tree.getSize(); slot++) {
+			for (int d = 0; d < dims; d++) {
+				rows.push_back(tree.getCord(slot, d));
+			}
+			ids.push_back(tree.getIndex(slot));
+		}
+	}
+
+	flatTree * merged = new flatTree;
+	merged->makeTree(&rows[0], &ids[0], ids.size(), dims, axisMode, leafSize,
+			pool);
+
+	forestView * next = new forestView;
+	next->trees = old.trees;
+	if (level == next->trees.size()) {
+		next->trees.push_back(nullptr);
+	}
+	for (size_t i = 0; i < level; i++) {
+		next->trees[i] = nullptr;
+	}
+	next->trees[level].reset(merged);
+	next->stored = old.stored + bufferSize;
+	next->buffer = make_shared<pointBuffer>();
+	next->buffer->rows.resize((size_t) bufferSize * dims);
+	next->buffer->ids.resize(bufferSize);
+	next->buffer->count = 0;
+
+	lock_guard<mutex> hold(viewLock);
+	view.reset(next);
+}
+
+void treeForest::nearView(const forestView& v, const double * query,
+		int& bestIndex, double& bestSquare) const {
+
+	//largest tree first, it most likely holds the answer and its bound
+	//prunes the smaller trees
+	for (size_t level = v.trees.size(); level-- > 0;) {
+		const flatTree * tree = v.trees[level].get();
+		if (tree == nullptr) {
+			continue;
+		}
+		int slot = -1;
+		tree->findNearSquared(query, slot, bestSquare);
+		if (slot >= 0) {
+			bestIndex = tree->getIndex(slot);
+		}
+	}
+
+	const pointBuffer& buffer = *v.buffer;
+	int count = buffer.count.load(memory_order_acquire);
+	for (int i = 0; i < count; i++) {
+		const double * row = &buffer.rows[(size_t) i * dims];
+		double sum = 0;
+		for (int d = 0; d < dims; d++) {
+			double dif = query[d] - row[d];
+			sum += dif * dif;
+		}
+		if (sum < bestSquare) {
+			bestSquare = sum;
+			bestIndex = buffer.ids[i];
+		}
+	}
+}
+
+void treeForest::findNear(const double * query, int& bestIndex,
+		double& bestDistance) const {
+	shared_ptr<const forestView> v = current();
+	int start = bestIndex;
+	double bestSquare = bestDistance * bestDistance;
+	nearView(*v, query, bestIndex, bestSquare);
+	if (bestIndex != start) {
+		bestDistance = sqrt(bestSquare);
+	}
+}
+
+void treeForest::findNearBatch(const double * queries, int count,
+		int * bestIndices, double * bestDistances, taskPool * pool) const {
+
+	shared_ptr<const forestView> v = current();
+	auto search = [this, &v, queries, bestIndices, bestDistances](size_t begin,
+			size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			bestIndices[i] = -1;
+			double bestSquare = DBL_MAX;
+			nearView(*v, queries + i * dims, bestIndices[i], bestSquare);
+			bestDistances[i] = bestIndices[i] >= 0 ? sqrt(bestSquare) : DBL_MAX;
+		}
+	};
+
+	if (pool == nullptr || pool->getThreads() == 1) {
+		search(0, count);
+	} else {
+		pool->parallelFor(count, (count + QUERY_CHUNK - 1) / QUERY_CHUNK,
+				search);
+	}
+}
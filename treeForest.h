@@ -0,0 +1,109 @@
+/*
+ * treeForest.h
+ */
+
+/*
+ This file is part of kdTree.
+
+ kdTree is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ kdTree is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with kdTree.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TREEFOREST_H_
+#define TREEFOREST_H_
+
+#include "kdTree.h"
+#include <memory>
+#include <mutex>
+
+//points held in the buffer before they are built into the smallest tree
+#define FOREST_BUFFER 1024
+
+//streaming index for points that keep arriving: new points go into a small
+//buffer that is searched point by point, and a full buffer is built into a
+//static flatTree. trees hold bufferSize * 2^i points for distinct i, and a new
+//tree absorbs every smaller one (Bentley-Saxe logarithmic method), so each
+//point is rebuilt O(log n) times and at most log2(n / bufferSize) + 1 trees
+//are searched. one thread at a time inserts, any number of threads search:
+//searches work on the trees and buffer published when they start, and the
+//inserting thread builds new trees beside them
+class treeForest {
+protected:
+	//unsorted points waiting for the next build, rows below count are final
+	struct pointBuffer {
+		vector<double> rows;
+		vector<int> ids;
+		atomic<int> count;
+	};
+
+	//everything a search reads, never changed once published
+	struct forestView {
+		vector<shared_ptr<const flatTree> > trees;	//by level, nullptr if empty
+		shared_ptr<pointBuffer> buffer;
+		long stored;	//points in the trees
+	};
+
+	int dims;
+	int axisMode;
+	int leafSize;
+	int bufferSize;
+	taskPool * pool;		//builds merged trees in parallel, may be nullptr
+	mutex insertLock;		//one insert at a time
+	mutable mutex viewLock;	//guards view, held only to copy or swap it
+	shared_ptr<const forestView> view;
+
+	shared_ptr<const forestView> current() const;
+
+	//build the full buffer and every tree below the first empty level into
+	//one tree at that level
+	void merge();
+
+	//squared distance search of one view with a shared bound
+	void nearView(const forestView& v, const double * query, int& bestIndex,
+			double& bestSquare) const;
+
+public:
+	//trees are built with axisMode and leafSize, merges use pool if given
+	treeForest(int dims, int axisMode = 1, int leafSize = 8, int bufferSize =
+			FOREST_BUFFER, taskPool * pool = nullptr);
+
+	treeForest(const treeForest&) = delete;
+	treeForest& operator=(const treeForest&) = delete;
+
+	int getDims() const;
+
+	//points stored, the buffer included
+	long getSize() const;
+
+	//number of trees currently searched besides the buffer
+	int getTreeCount() const;
+
+	//add a point, indices are not checked for repeats
+	void insert(const double * point, int index);
+
+	//add count row-major points, index i gets firstIndex + i
+	void insertBatch(const double * rows, int count, int firstIndex);
+
+	//nearest neighbor over every tree and the buffer, sharing one bound.
+	//bestIndex is the original index of the point, -1 if nothing was closer
+	//than bestDistance
+	void findNear(const double * query, int& bestIndex,
+			double& bestDistance) const;
+
+	//nearest neighbor for count row-major queries, all against the same
+	//published view and split across the pool like flatTree::findNearBatch
+	void findNearBatch(const double * queries, int count, int * bestIndices,
+			double * bestDistances, taskPool * pool = nullptr) const;
+};
+
+#endif /* TREEFOREST_H_ */
@@ -0,0 +1,128 @@
+//============================================================================
+// Name        : update_kdtree.cpp
+/*
+ This file is part of kdTree.
+
+ kdTree is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ kdTree is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with kdTree.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Description : Insert points into and delete points from a tree written by
+// build_kdtree without building it again from the full csv
+//============================================================================
+#include "kdTree.h"
+
+int main(int argc, char *argv[]) {
+
+	string treeFile = "treeOut.kdt";
+	string dest = "";
+	string insertFile = ""; //csv of points to add
+	string deleteFile = ""; //indices to delete, one per line
+	int k = 0; //taken from the insert file unless given
+
+	//positional arguments are tree and dest, options are --name value
+	int position = 0;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg.compare(0, 2, "--") == 0) {
+			if (i + 1 >= argc) {
+				cout << "Missing value for option " << arg << endl;
+				return 1;
+			}
+			if (arg == "--insert") {
+				insertFile = argv[++i];
+			} else if (arg == "--delete") {
+				deleteFile = argv[++i];
+			} else if (arg == "--dims") {
+				k = atoi(argv[++i]);
+			} else {
+				cout << "Unknown option " << arg << endl;
+				return 1;
+			}
+		} else if (position == 0) {
+			treeFile = arg;
+			position++;
+		} else if (position == 1) {
+			dest = arg;
+			position++;
+		}
+	}
+	if (dest.empty()) { //update in place
+		dest = treeFile;
+	}
+
+	pointBlock points;
+	if (!insertFile.empty()) {
+		cout << "Reading in points to insert from " << insertFile << endl;
+		int fileDims = points.readFile(insertFile);
+		if (fileDims < 1 || (k > 0 && fileDims != k)) {
+			cout << "Insert file does not hold points of the tree's dimensions"
+					<< endl;
+			return 1;
+		}
+		k = fileDims;
+	}
+	if (k < 1) {
+		cout << "Give --dims when there is no insert file" << endl;
+		return 1;
+	}
+
+	bool binary = isBinaryTree(treeFile);
+	flatTree tree;
+	tree.setBoundingBoxes(binary);
+	if (!tree.readTree(treeFile, k)) {
+		cout << "Error reading in tree from file, exiting\n";
+		return 1;
+	}
+	tree.setBoundingBoxes(tree.hasBoxes()); //written back only if it had them
+
+	//new points are numbered after the largest index in the tree
+	int next = 0;
+	for (int slot = 0; slot < tree.getSlotCount(); slot++) {
+		next = max(next, tree.getIndex(slot) + 1);
+	}
+
+	//deletes first, so a file can delete points and insert their new values
+	int deleted = 0;
+	if (!deleteFile.empty()) {
+		ifstream ids(deleteFile);
+		if (!ids.is_open()) {
+			cout << "Unable to open delete file " << deleteFile << endl;
+			return 1;
+		}
+		int index;
+		while (ids >> index) {
+			deleted += tree.remove(index);
+		}
+	}
+
+	for (int i = 0; i < points.getSize(); i++) {
+		tree.insert(points.getPoint(i), next + i);
+	}
+
+	cout << "Deleted " << deleted << " points and inserted " << points.getSize()
+			<< " points numbered from " << next << ", the tree holds "
+			<< tree.getSize() << " points" << endl;
+
+	tree.compact();
+	if (binary) {
+		if (!tree.writeBinary(dest)) {
+			return 1;
+		}
+	} else {
+		tree.writeOut(dest);
+	}
+	cout << "Tree output to " << dest << endl;
+
+	return 0;
+}